@@ -1,8 +1,9 @@
-#include "Chess.h"
+#include "chess.h"
 
+#include <algorithm>
 #include <iostream>
 
-bool ChessEngine::PerformMoveAction( const pieceHandle_t pieceHdl, const num_t targetX, const num_t targetY )
+bool ChessEngine::PerformMoveAction( const pieceHandle_t pieceHdl, const num_t targetX, const num_t targetY, const pieceType_t promotion, moveDelta_t* delta )
 {
 	Piece* piece = m_state.GetPiece( pieceHdl );
 	if ( piece == nullptr ) {
@@ -13,112 +14,285 @@ bool ChessEngine::PerformMoveAction( const pieceHandle_t pieceHdl, const num_t t
 	if ( legalMove == moveType_t::NONE ) {
 		return false;
 	}
-	piece->Move( legalMove, targetX, targetY );
 
-	CalculateGameState( legalMove, pieceHdl );
+	const uint64_t keyBefore = GetPositionKey();
+	const bool pawnMove = ( piece->type == pieceType_t::PAWN );
+	const num_t enemyCount = m_state.GetTeam( GetOpposingTeam( piece->team ) ).livingCount;
+	SetCheckSources( piece, targetX, targetY );
+	if ( delta != nullptr ) {
+		BeginMoveDelta( *delta, targetX, targetY );
+	}
+
+	piece->Move( legalMove, targetX, targetY, promotion );
+
+	m_currentTurn = ( m_currentTurn == teamCode_t::WHITE ) ? teamCode_t::BLACK : teamCode_t::WHITE;
+	++m_turnCount;
+
+	const bool capture = ( m_state.GetTeam( GetOpposingTeam( piece->team ) ).livingCount != enemyCount );
+	RecordGameMove( keyBefore, pawnMove || capture );
+	UpdateGameState();
 
+	if ( delta != nullptr ) {
+		EndMoveDelta( *delta );
+	}
 	return true;
 }
 
 
-void ChessEngine::CalculateGameState( const moveType_t& moveType, const pieceHandle_t movedPieceHdl )
+void ChessEngine::SetCheckSources( const Piece* piece, const num_t targetX, const num_t targetY )
 {
-	Piece* piece = m_state.GetPiece( movedPieceHdl );
-	if ( piece == nullptr ) {
-		return;
+	m_checkSources = checkSources_t();
+	m_checkSources.moved = piece->m_handle;
+	m_checkSources.vacated[ m_checkSources.vacatedCount++ ] = { piece->X(), piece->Y() };
+
+	if ( ( piece->type == pieceType_t::KING ) && ( abs( targetX - piece->X() ) == 2 ) ) {
+		m_checkSources.rook = m_state.GetHandle( ( targetX > piece->X() ) ? ( BoardSize - 1 ) : 0, piece->Y() );
 	}
 
-	// Check / Checkmate
+	if ( ( piece->type == pieceType_t::PAWN ) && ( targetX != piece->X() ) && ( m_state.GetHandle( targetX, targetY ) == NoPiece ) )
 	{
-		const teamCode_t opposingTeam = GetOpposingTeam( piece->team );
+		const Piece* pawn = m_state.GetEnpassant( targetX, targetY );
+		if ( pawn != nullptr ) {
+			m_checkSources.vacated[ m_checkSources.vacatedCount++ ] = { pawn->X(), pawn->Y() };
+		}
+	}
+}
 
-		const pieceHandle_t kingHdl = FindPiece( opposingTeam, pieceType_t::KING, 0 );
-		const Piece* king = m_state.GetPiece( kingHdl );
 
-		m_checkedTeam = teamCode_t::NONE;
-		if ( king == nullptr )
-		{
-			m_winner = piece->team;
+void ChessEngine::BeginMoveDelta( moveDelta_t& delta, const num_t targetX, const num_t targetY ) const
+{
+	delta = moveDelta_t();
+	delta.moved = GetInfo( m_checkSources.moved );
+	delta.vacated[ delta.vacatedCount++ ] = m_checkSources.vacated[ 0 ];
+
+	delta.enpassant = ( m_checkSources.vacatedCount > 1 );
+	const position_t capturedAt = delta.enpassant ? m_checkSources.vacated[ 1 ] : position_t{ targetX, targetY };
+	delta.captured = GetInfo( m_state.GetHandle( capturedAt.x, capturedAt.y ) );
+	if ( delta.captured.isPiece )
+	{
+		delta.captured.onBoard = false;
+		delta.capturedAt = capturedAt;
+		if ( delta.enpassant ) {
+			delta.vacated[ delta.vacatedCount++ ] = capturedAt;
 		}
+	}
 
-		const bool notCapturedAfterMove = ( king != nullptr );
+	const Piece* rook = m_state.GetPiece( m_checkSources.rook );
+	if ( rook != nullptr )
+	{
+		delta.castle = true;
+		delta.rookFrom = { rook->X(), rook->Y() };
+		delta.vacated[ delta.vacatedCount++ ] = delta.rookFrom;
+	}
+}
 
-		if ( notCapturedAfterMove && m_state.IsOpenToAttack( king ) )
-		{
-			m_checkedTeam = opposingTeam;
 
-			if ( m_state.IsCheckMate( piece, moveType, opposingTeam ) )
-			{
-				m_winner = piece->team;
-			}
-		}
-		else
-		{
-			if ( m_state.IsStalemate( opposingTeam ) )
-			{
-				m_stalemate = true;
-			}
+void ChessEngine::EndMoveDelta( moveDelta_t& delta ) const
+{
+	const Piece* piece = m_state.GetPiece( m_checkSources.moved );
+	if ( piece->type != delta.moved.pieceType ) {
+		delta.promotion = piece->type;
+	}
+	delta.moved = GetInfo( m_checkSources.moved );
+	delta.occupied[ delta.occupiedCount++ ] = { piece->X(), piece->Y() };
+
+	const Piece* rook = m_state.GetPiece( m_checkSources.rook );
+	if ( rook != nullptr )
+	{
+		delta.rookTo = { rook->X(), rook->Y() };
+		delta.occupied[ delta.occupiedCount++ ] = delta.rookTo;
+	}
+
+	delta.checkedTeam = GetCheckedTeam();
+	delta.result = GetGameResult();
+}
+
+
+void ChessEngine::UpdateGameState()
+{
+	m_gameStatePending = m_lazyGameState;
+	if ( m_gameStatePending == false ) {
+		CalculateGameState();
+	}
+}
+
+
+void ChessEngine::CalculateGameState()
+{
+	m_gameStatePending = false;
+
+	// Check / Checkmate, from the side now to move
+	const pieceHandle_t kingHdl = FindPiece( m_currentTurn, pieceType_t::KING, 0 );
+	const Piece* king = m_state.GetPiece( kingHdl );
+
+	// Without a last move, as after InitFromFen(), any piece may be giving check
+	const bool lastMove = ( m_checkSources.moved != NoPiece );
+	const bool checked = ( king != nullptr ) && ( lastMove ? m_state.IsCheckedAfter( king, m_checkSources ) : m_state.IsChecked( m_currentTurn ) );
+	m_checkedTeam = checked ? m_currentTurn : teamCode_t::NONE;
+
+	if ( king == nullptr )
+	{
+		m_winner = GetOpposingTeam( m_currentTurn );
+	}
+	else if ( m_state.HasAnyLegalMove( m_currentTurn ) == false )
+	{
+		if ( checked ) {
+			m_winner = GetOpposingTeam( m_currentTurn );
+		} else {
+			m_stalemate = true;
 		}
 	}
 
-	m_currentTurn = ( m_currentTurn == teamCode_t::WHITE ) ? teamCode_t::BLACK : teamCode_t::WHITE;
+	// Mate and stalemate on the same move take precedence over the draw rules
+	if ( ( m_winner != teamCode_t::NONE ) || m_stalemate ) {
+		m_draw = RESULT_SUCCESS;
+	}
+}
 
-	++m_turnCount;
+
+resultCode_t ChessEngine::ExecuteMove( const move_t& move, moveDelta_t* delta )
+{
+	if ( IsKnownGameOver() ) {
+		return GetGameResult();
+	}
+
+	if ( IsGeneratedMove( move ) == false ) {
+		return IsGameOver() ? GetGameResult() : resultCode_t::RESULT_GAME_INVALID_MOVE;
+	}
+
+	return ExecuteTrusted( move, delta );
 }
 
 
-int32_t ChessEngine::Search( int32_t depth )
+resultCode_t ChessEngine::ExecuteTrusted( const move_t& move, moveDelta_t* delta )
 {
-	// Perft search
+	if ( IsKnownGameOver() ) {
+		return GetGameResult();
+	}
 
-	int32_t nodes = 0;
+	assert( IsGeneratedMove( move ) );
 
-	if ( depth == 0 ) {
-		return 1;
+	const uint64_t keyBefore = GetPositionKey();
+	const bool irreversible = ( m_pieces[ move.piece ]->type == pieceType_t::PAWN ) || ( m_state.GetHandle( move.x, move.y ) != NoPiece );
+
+	SetCheckSources( m_pieces[ move.piece ], move.x, move.y );
+	if ( delta != nullptr ) {
+		BeginMoveDelta( *delta, move.x, move.y );
 	}
 
-	position_t moveList[ 256 ] = {};
+	moveUndo_t undo;
+	MakeMove( move, undo );
 
-	const int32_t pieceCount = GetPieceCount();
+	RecordGameMove( keyBefore, irreversible );
+	UpdateGameState();
 
-	ChessState searchState;
+	if ( delta != nullptr ) {
+		EndMoveDelta( *delta );
+	}
 
-	for( int32_t pieceId = 0; pieceId < pieceCount; ++pieceId )
-	{
-		Piece* piece = m_pieces[ pieceId ];
+	return IsKnownGameOver() ? GetGameResult() : resultCode_t::RESULT_SUCCESS;
+}
 
-		const int32_t moveCount = piece->ComputeAllMoveActions( moveList );
-		if( moveCount == 0 ) {
-			continue;
-		}
 
-		for ( int32_t moveIx = 0; moveIx < moveCount; ++moveIx )
+bool ChessEngine::IsGeneratedMove( const move_t& move ) const
+{
+	move_t moves[ MaxMoves ];
+	const int32_t moveCount = GenerateMoves( moves );
+	return std::find( moves, moves + moveCount, move ) != ( moves + moveCount );
+}
+
+
+bool ChessEngine::InitFromFen( const std::string& fen )
+{
+	packedPosition_t position;
+	if ( ParseFen( fen, position ) == false ) {
+		return false;
+	}
+
+	std::istringstream fields( fen );
+	std::string placement;
+	std::string side = "w";
+	std::string castling = "-";
+	std::string enpassant = "-";
+	int32_t halfMoves = 0;
+	int32_t fullMoves = 1;
+	fields >> placement >> side >> castling >> enpassant >> halfMoves >> fullMoves;
+
+	gameConfig_t cfg;
+	int32_t teamCounts[ TeamCount ] = {};
+	int32_t kingCounts[ TeamCount ] = {};
+	for ( int32_t y = 0; y < BoardSize; ++y )
+	{
+		for ( int32_t x = 0; x < BoardSize; ++x )
 		{
-			// FIXME: Legality check. Does redundant work so optimize this later
-			moveType_t move = m_state.IsLegalMove( piece, moveList[ moveIx ].x, moveList[ moveIx ].y );
-			if ( move == moveType_t::NONE )
-			{
+			const uint8_t code = position.squares[ y ][ x ];
+			pieceInfo_t& square = cfg.board[ y ][ x ];
+			square = pieceInfo_t{ teamCode_t::NONE, pieceType_t::NONE, 0, false, false };
+			if ( code == PackedEmpty ) {
 				continue;
 			}
 
-			// Make move
-			{
-				searchState.CopyFrom( m_state );
-				piece->BindBoard( &searchState, piece->m_handle );
-				piece->PlaceAt( piece->X(), piece->Y() );
+			square.team = static_cast<teamCode_t>( code >> 3 );
+			square.pieceType = static_cast<pieceType_t>( ( code & 7 ) - 1 );
+			square.onBoard = true;
+			++teamCounts[ (int32_t)square.team ];
+			kingCounts[ (int32_t)square.team ] += ( square.pieceType == pieceType_t::KING ) ? 1 : 0;
+		}
+	}
 
-				piece->Move( move, moveList[ moveIx ].x, moveList[ moveIx ].y );
-			}
+	for ( int32_t t = 0; t < TeamCount; ++t )
+	{
+		if ( ( kingCounts[ t ] != 1 ) || ( teamCounts[ t ] > TeamPieceCount ) ) {
+			return false;
+		}
+	}
 
-			nodes += Search( depth - 1 );
-			
-			// Undo move
-			{
-				// Nothing, using a copied state currently
-			}
+	// A new position keeps the hash table, its entries are keyed by the whole position
+	std::vector< ttEntry_t > hashTable;
+	hashTable.swap( m_hashTable );
+	Init( cfg );
+	m_hashTable.swap( hashTable );
+
+	m_currentTurn = ( side == "b" ) ? teamCode_t::BLACK : teamCode_t::WHITE;
+	m_turnCount = 2 * ( std::max( fullMoves, 1 ) - 1 ) + ( ( m_currentTurn == teamCode_t::BLACK ) ? 1 : 0 );
+	m_halfMoveClock = std::max( halfMoves, 0 );
+
+	// Castling rights and pawn double steps both come from move counts
+	for ( int32_t i = 0; i < m_pieceNum; ++i )
+	{
+		Piece* piece = m_pieces[ i ];
+		const bool white = ( piece->team == teamCode_t::WHITE );
+		const num_t homeRank = white ? ( BoardSize - 1 ) : 0;
+
+		bool unmoved = false;
+		if ( piece->type == pieceType_t::PAWN ) {
+			unmoved = ( piece->Y() == ( white ? ( BoardSize - 2 ) : 1 ) );
+		} else if ( piece->type == pieceType_t::KING ) {
+			unmoved = ( piece->Y() == homeRank ) && ( piece->X() == 4 ) && ( castling.find_first_of( white ? "KQ" : "kq" ) != std::string::npos );
+		} else if ( ( piece->type == pieceType_t::ROOK ) && ( piece->Y() == homeRank ) ) {
+			unmoved = ( ( piece->X() == ( BoardSize - 1 ) ) && ( castling.find( white ? 'K' : 'k' ) != std::string::npos ) ) ||
+					  ( ( piece->X() == 0 ) && ( castling.find( white ? 'Q' : 'q' ) != std::string::npos ) );
 		}
+		piece->m_moveCount = unmoved ? 0 : 1;
 	}
-	return nodes;
+
+	// The pawn that just double stepped sits one rank past the target square
+	if ( enpassant.size() == 2 )
+	{
+		const int32_t x = GetFileNum( enpassant[ 0 ] );
+		const int32_t y = GetRankNum( enpassant[ 1 ] );
+		const int32_t pawnY = y + ( ( m_currentTurn == teamCode_t::WHITE ) ? 1 : -1 );
+		const Piece* pawn = m_state.GetPiece( x, pawnY );
+		if ( ( x >= 0 ) && ( y >= 0 ) && ( pawn != nullptr ) && ( pawn->type == pieceType_t::PAWN ) && ( pawn->team != m_currentTurn ) ) {
+			m_state.m_enpassantPawn = pawn->m_handle;
+		}
+	}
+
+	// The side to move may already be mated or stalemated
+	UpdateGameState();
+
+	ClearEvalCache();
+	return true;
 }
 
 
@@ -146,6 +320,15 @@ void ChessEngine::SetBoard( const gameConfig_t& cfg )
 {
 	m_turnCount = 0;
 	m_currentTurn = teamCode_t::WHITE;
+	m_state.m_hash = 0;
+	m_state.m_enpassantPawn = NoPiece;
+	m_state.m_accumulator.dirty[ 0 ] = true;
+	m_state.m_accumulator.dirty[ 1 ] = true;
+
+	for ( int32_t i = 0; i < TeamCount; ++i ) {
+		m_state.m_teams[ i ] = team_t();
+	}
+	m_state.m_snapshot = boardSnapshot_t();
 
 	for ( int32_t i = 0; i < BoardSize; ++i )
 	{
@@ -189,6 +372,90 @@ void ChessEngine::EnterPieceInGame( Piece* piece, const num_t x, const num_t y )
 }
 
 
+void ChessEngine::CopyFrom( const ChessEngine& src )
+{
+	memset( m_pieces, 0, sizeof( Piece* ) * PieceCount );
+	for ( int32_t i = 0; i < src.m_pieceNum; ++i )
+	{
+		m_pieces[ i ] = new Piece( *src.m_pieces[ i ] );
+		m_pieces[ i ]->m_state = ( src.m_pieces[ i ]->m_state != nullptr ) ? &m_state : nullptr;		// Captured pieces stay unbound
+	}
+
+	m_state.CopyFrom( src.m_state );
+	m_state.m_game = this;
+
+	memcpy( m_promotionCallback, src.m_promotionCallback, sizeof( m_promotionCallback ) );
+	m_pieceNum = src.m_pieceNum;
+	m_turnCount = src.m_turnCount;
+	m_currentTurn = src.m_currentTurn;
+	m_winner = src.m_winner;
+	m_checkedTeam = src.m_checkedTeam;
+	m_stalemate = src.m_stalemate;
+	m_draw = src.m_draw;
+	m_lazyGameState = src.m_lazyGameState;
+	m_gameStatePending = src.m_gameStatePending;
+	m_checkSources = src.m_checkSources;
+	m_halfMoveClock = src.m_halfMoveClock;
+	m_keyHistory = src.m_keyHistory;
+	m_config = src.m_config;
+
+	m_network = src.m_network;
+	m_book = src.m_book;
+	m_bookRandom = src.m_bookRandom;
+	m_tablebases = src.m_tablebases;
+
+	// Caches start cold, the hash table is sized on the first search
+	ClearMaterialTable();
+	ClearEvalCache();
+}
+
+uint64_t ChessEngine::GetPositionKey() const
+{
+	uint64_t key = m_state.m_hash;
+
+	// Castling rights: unmoved king with an unmoved rook in its corner
+	for ( int32_t t = 0; t < TeamCount; ++t )
+	{
+		const teamCode_t teamCode = static_cast<teamCode_t>( t );
+		const Piece* king = m_state.GetPiece( FindPiece( teamCode, pieceType_t::KING, 0 ) );
+		if ( ( king == nullptr ) || king->HasMoved() ) {
+			continue;
+		}
+
+		const Piece* kingSideRook = m_state.GetPiece( BoardSize - 1, king->Y() );
+		const Piece* queenSideRook = m_state.GetPiece( 0, king->Y() );
+		const int32_t castleKey = ZobristCastleOffset + ( ( teamCode == teamCode_t::WHITE ) ? 0 : 2 );
+
+		if ( ( kingSideRook != nullptr ) && ( kingSideRook->type == pieceType_t::ROOK ) && ( kingSideRook->team == teamCode ) && !kingSideRook->HasMoved() ) {
+			key ^= Zobrist.keys[ castleKey ];
+		}
+		if ( ( queenSideRook != nullptr ) && ( queenSideRook->type == pieceType_t::ROOK ) && ( queenSideRook->team == teamCode ) && !queenSideRook->HasMoved() ) {
+			key ^= Zobrist.keys[ castleKey + 1 ];
+		}
+	}
+
+	// En passant only counts when a pawn of the side to move can take it
+	const Piece* enpassantPawn = m_state.GetPiece( m_state.m_enpassantPawn );
+	if ( ( enpassantPawn != nullptr ) && ( enpassantPawn->team != m_currentTurn ) )
+	{
+		for ( int32_t side = -1; side <= 1; side += 2 )
+		{
+			const Piece* neighbor = m_state.GetPiece( enpassantPawn->X() + side, enpassantPawn->Y() );
+			if ( ( neighbor != nullptr ) && ( neighbor->type == pieceType_t::PAWN ) && ( neighbor->team == m_currentTurn ) )
+			{
+				key ^= Zobrist.keys[ ZobristEnpassantOffset + enpassantPawn->X() ];
+				break;
+			}
+		}
+	}
+
+	if ( m_currentTurn == teamCode_t::WHITE ) {
+		key ^= Zobrist.keys[ ZobristTurnOffset ];
+	}
+	return key;
+}
+
+
 bool ChessEngine::IsValidHandle( const pieceHandle_t handle ) const
 {
 	if ( handle == NoPiece ) {
@@ -0,0 +1,183 @@
+#include "chess.h"
+
+#include <algorithm>
+
+// Built with CHESS_SIMD=AVX2, the scalar reference alone otherwise
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#define BATCH_USE_AVX2 1
+#endif
+
+// Batch scoring for data pipelines: material plus tapered piece-square tables, no move generation.
+//
+// Positions are transposed in blocks of BatchLanes into square-major (SoA) order, so a single
+// gather fetches one square's table entry for every position in the block. Middlegame and
+// endgame values share one int32 lane (mg << 16) + eg, the same trick the accumulation relies
+// on to stay in a single gather per square; both halves comfortably fit in int16.
+
+static const int32_t BatchLanes = 8;
+static const int32_t SquareCount = BoardSize * BoardSize;
+static const int32_t PhaseWeight[ (int32_t)pieceType_t::COUNT ] = { 0, 2, 1, 1, 0, 4 };
+
+#if defined( BATCH_USE_AVX2 )
+struct batchTables_t
+{
+	batchTables_t()
+	{
+		for ( int32_t code = 0; code < PackedCodeCount; ++code )
+		{
+			phase[ code ] = 0;
+			for ( int32_t sq = 0; sq < SquareCount; ++sq ) {
+				score[ code ][ sq ] = 0;
+			}
+
+			const int32_t team = code >> 3;
+			const int32_t type = ( code & 7 ) - 1;
+			if ( ( team >= TeamCount ) || ( type < 0 ) || ( type >= (int32_t)pieceType_t::COUNT ) ) {
+				continue;
+			}
+
+			phase[ code ] = PhaseWeight[ type ];
+
+			const int32_t sign = ( team == (int32_t)teamCode_t::WHITE ) ? 1 : -1;
+			for ( int32_t y = 0; y < BoardSize; ++y )
+			{
+				const int32_t row = ( team == (int32_t)teamCode_t::WHITE ) ? y : ( BoardSize - 1 - y );
+				for ( int32_t x = 0; x < BoardSize; ++x )
+				{
+					const int32_t middlegame = sign * ( PieceValue[ type ] + PST[ type ][ row ][ x ] );
+					const int32_t endgame = sign * ( PieceValue[ type ] + PSTEndgame[ type ][ row ][ x ] );
+					score[ code ][ y * BoardSize + x ] = static_cast<int32_t>( static_cast<uint32_t>( middlegame ) << 16 ) + endgame;
+				}
+			}
+		}
+	}
+
+	int32_t		score[ PackedCodeCount ][ SquareCount ];	// White relative, packed middlegame/endgame
+	int32_t		phase[ PackedCodeCount ];
+};
+
+
+static const batchTables_t& BatchTables()
+{
+	static const batchTables_t tables;
+	return tables;
+}
+#endif
+
+
+static inline int32_t Taper( const int32_t middlegame, const int32_t endgame, const int32_t phase )
+{
+	const int32_t clamped = std::min( phase, MaxGamePhase );
+	return ( middlegame * clamped + endgame * ( MaxGamePhase - clamped ) ) / MaxGamePhase;
+}
+
+
+void EvaluateBatchReference( const packedPosition_t* positions, const size_t count, int32_t* scores )
+{
+	for ( size_t i = 0; i < count; ++i )
+	{
+		const packedPosition_t& position = positions[ i ];
+
+		int32_t middlegame = 0;
+		int32_t endgame = 0;
+		int32_t phase = 0;
+
+		for ( int32_t y = 0; y < BoardSize; ++y )
+		{
+			for ( int32_t x = 0; x < BoardSize; ++x )
+			{
+				const uint8_t code = position.squares[ y ][ x ];
+				if ( code == PackedEmpty ) {
+					continue;
+				}
+
+				const teamCode_t team = static_cast<teamCode_t>( code >> 3 );
+				const int32_t type = ( code & 7 ) - 1;
+				const int32_t row = ( team == teamCode_t::WHITE ) ? y : ( BoardSize - 1 - y );
+				const int32_t sign = ( team == teamCode_t::WHITE ) ? 1 : -1;
+
+				middlegame += sign * ( PieceValue[ type ] + PST[ type ][ row ][ x ] );
+				endgame += sign * ( PieceValue[ type ] + PSTEndgame[ type ][ row ][ x ] );
+				phase += PhaseWeight[ type ];
+			}
+		}
+
+		const int32_t score = Taper( middlegame, endgame, phase );
+		scores[ i ] = ( position.sideToMove == teamCode_t::WHITE ) ? score : -score;
+	}
+}
+
+
+#if defined( BATCH_USE_AVX2 )
+static void EvaluateBlock( const batchTables_t& tables, const packedPosition_t* positions, int32_t* scores )
+{
+	// Transpose to square-major so each square is one 8-byte load across the block
+	alignas( 32 ) uint8_t soa[ SquareCount ][ BatchLanes ];
+	for ( int32_t lane = 0; lane < BatchLanes; ++lane )
+	{
+		const uint8_t* squares = &positions[ lane ].squares[ 0 ][ 0 ];
+		for ( int32_t sq = 0; sq < SquareCount; ++sq ) {
+			soa[ sq ][ lane ] = squares[ sq ];
+		}
+	}
+
+	const int32_t* scoreTable = &tables.score[ 0 ][ 0 ];
+	__m256i packed = _mm256_setzero_si256();
+	__m256i phase = _mm256_setzero_si256();
+
+	for ( int32_t sq = 0; sq < SquareCount; ++sq )
+	{
+		const __m256i codes = _mm256_cvtepu8_epi32( _mm_loadl_epi64( reinterpret_cast<const __m128i*>( soa[ sq ] ) ) );
+		const __m256i index = _mm256_add_epi32( _mm256_slli_epi32( codes, 6 ), _mm256_set1_epi32( sq ) );
+
+		packed = _mm256_add_epi32( packed, _mm256_i32gather_epi32( scoreTable, index, 4 ) );
+		phase = _mm256_add_epi32( phase, _mm256_i32gather_epi32( tables.phase, codes, 4 ) );
+	}
+
+	// Unpack: eg is the sign-extended low half, mg the high half corrected for its borrow
+	const __m256i endgame = _mm256_srai_epi32( _mm256_slli_epi32( packed, 16 ), 16 );
+	const __m256i middlegame = _mm256_srai_epi32( _mm256_add_epi32( packed, _mm256_set1_epi32( 0x8000 ) ), 16 );
+
+	const __m256i maxPhase = _mm256_set1_epi32( MaxGamePhase );
+	phase = _mm256_min_epi32( phase, maxPhase );
+
+	const __m256i blended = _mm256_add_epi32(	_mm256_mullo_epi32( middlegame, phase ),
+												_mm256_mullo_epi32( endgame, _mm256_sub_epi32( maxPhase, phase ) ) );
+
+	// Exact for |blended| < 2^24, truncates toward zero like the scalar divide
+	const __m256 quotient = _mm256_div_ps( _mm256_cvtepi32_ps( blended ), _mm256_set1_ps( static_cast<float>( MaxGamePhase ) ) );
+	__m256i score = _mm256_cvttps_epi32( quotient );
+
+	alignas( 32 ) int32_t sign[ BatchLanes ];
+	for ( int32_t lane = 0; lane < BatchLanes; ++lane ) {
+		sign[ lane ] = ( positions[ lane ].sideToMove == teamCode_t::WHITE ) ? 1 : -1;
+	}
+	score = _mm256_sign_epi32( score, _mm256_load_si256( reinterpret_cast<const __m256i*>( sign ) ) );
+
+	_mm256_storeu_si256( reinterpret_cast<__m256i*>( scores ), score );
+}
+#endif
+
+
+void EvaluateBatch( const packedPosition_t* positions, const size_t count, int32_t* scores )
+{
+	size_t i = 0;
+
+#if defined( BATCH_USE_AVX2 )
+	const batchTables_t& tables = BatchTables();
+	for ( ; i + BatchLanes <= count; i += BatchLanes ) {
+		EvaluateBlock( tables, positions + i, scores + i );
+	}
+#endif
+
+	// Tail, or the whole batch without AVX2
+	EvaluateBatchReference( positions + i, count - i, scores + i );
+}
+
+
+void ChessEngine::GetPackedPosition( packedPosition_t& position ) const
+{
+	memcpy( position.squares, m_state.m_snapshot.squares, sizeof( position.squares ) );
+	position.sideToMove = m_currentTurn;
+}
@@ -44,6 +44,7 @@
 #include <sstream>
 #include <cstring>
 #include <set>
+#include <functional>
 
 
 // ============================================================
@@ -89,6 +90,7 @@ public:
 };
 
 class ChessEngine;
+class ChessState;
 
 
 // ============================================================
@@ -115,9 +117,14 @@ enum resultCode_t
 	RESULT_GAME_COMPLETE_STALEMATE		= ( 1 << 9 ),
 	RESULT_GAME_COMPLETE_WHITE_RESIGNS	= ( 1 << 10 ),
 	RESULT_GAME_COMPLETE_BLACK_RESIGNS	= ( 1 << 11 ),
+	RESULT_GAME_COMPLETE_REPETITION		= ( 1 << 12 ),
+	RESULT_GAME_COMPLETE_FIFTY_MOVES	= ( 1 << 13 ),
+	RESULT_GAME_COMPLETE_NO_MATERIAL	= ( 1 << 14 ),
+	RESULT_GAME_COMPLETE_DRAW			= ( RESULT_GAME_COMPLETE_STALEMATE | RESULT_GAME_COMPLETE_REPETITION | \
+											RESULT_GAME_COMPLETE_FIFTY_MOVES | RESULT_GAME_COMPLETE_NO_MATERIAL ),
 	RESULT_GAME_COMPLETE				= ( RESULT_GAME_COMPLETE_WHITE_WINS | RESULT_GAME_COMPLETE_BLACK_WINS | \
 											RESULT_GAME_COMPLETE_WHITE_RESIGNS | RESULT_GAME_COMPLETE_BLACK_RESIGNS | \
-											RESULT_GAME_COMPLETE_STALEMATE ),
+											RESULT_GAME_COMPLETE_DRAW ),
 };
 
 
@@ -128,7 +135,7 @@ struct resultMessage_t
 };
 
 
-constexpr static uint32_t ResultMessageCount = 12;
+constexpr static uint32_t ResultMessageCount = 15;
 static resultMessage_t ResultMsgs[ ResultMessageCount ] =
 {
 	{ RESULT_INPUT_INVALID_COMMAND,			"Invalid command"			},
@@ -143,6 +150,9 @@ static resultMessage_t ResultMsgs[ ResultMessageCount ] =
 	{ RESULT_GAME_COMPLETE_WHITE_RESIGNS,	"White Resigns",			},
 	{ RESULT_GAME_COMPLETE_BLACK_RESIGNS,	"Black Resigns",			},
 	{ RESULT_GAME_COMPLETE_STALEMATE,		"Stalemate",				},
+	{ RESULT_GAME_COMPLETE_REPETITION,		"Draw by repetition",		},
+	{ RESULT_GAME_COMPLETE_FIFTY_MOVES,		"Draw by fifty-move rule",	},
+	{ RESULT_GAME_COMPLETE_NO_MATERIAL,		"Draw, insufficient material",	},
 };
 
 
@@ -290,6 +300,7 @@ struct command_t
 	pieceType_t		pieceType;
 	int32_t			instance;
 	teamCode_t		team;
+	pieceType_t		promotion = pieceType_t::NONE;	// Pawn promotion choice, NONE falls back to the promotion callback
 };
 
 
@@ -376,6 +387,19 @@ std::string BoardToString( const ChessEngine& chessEngine, const bool printCaptu
 void LoadConfig( const std::string& fileName, gameConfig_t& config );
 void LoadHistory( const std::string& fileName, std::vector< std::string >& commands );
 
+struct mappedFile_t
+{
+	const uint8_t*	data = nullptr;
+	size_t			size = 0;
+	void*			fileHandle = nullptr;		// Win32 only, POSIX closes the descriptor once mapped
+	void*			mappingHandle = nullptr;
+	bool			writable = false;			// Flushed before unmapping
+};
+
+bool MapFile( const std::string& fileName, mappedFile_t& file );							// Read-only view of a whole file
+bool MapFileWritable( const std::string& fileName, const size_t size, mappedFile_t& file );	// Creates or truncates the file to size, shared read-write view
+void UnmapFile( mappedFile_t& file );
+
 inline static void AutoPromoteQueen( callbackEvent_t& event )
 {
 	event.promotionType = pieceType_t::QUEEN;
@@ -464,10 +488,398 @@ extern MoveCache QueenMoveSuperset;
 
 
 // ============================================================
-// Piece classes
+// Hashing
 // ============================================================
 
-class ChessState;
+// Zobrist keys, laid out as in the Polyglot book format:
+// 12 piece kinds x 64 squares, then castling rights, en passant files and side to move
+static const int32_t ZobristCastleOffset	= 768;
+static const int32_t ZobristEnpassantOffset	= 772;
+static const int32_t ZobristTurnOffset		= 780;
+static const int32_t ZobristKeyCount		= 781;
+
+struct zobristTable_t
+{
+	uint64_t keys[ ZobristKeyCount ];
+};
+
+extern const zobristTable_t Zobrist;		// The published Polyglot values, see book.cpp
+
+inline uint64_t ZobristPieceKey( const teamCode_t team, const pieceType_t type, const num_t x, const num_t y )
+{
+	// pieceType_t order -> pawn, knight, bishop, rook, queen, king
+	static const int32_t KindIndex[ (int32_t)pieceType_t::COUNT ] = { 0, 3, 1, 2, 5, 4 };
+
+	const int32_t kind = 2 * KindIndex[ (int32_t)type ] + ( ( team == teamCode_t::WHITE ) ? 1 : 0 );
+	const int32_t row = ( BoardSize - 1 ) - y; // Rank 1 first
+	return Zobrist.keys[ 64 * kind + 8 * row + x ];
+}
+
+
+// ============================================================
+// Evaluation
+// ============================================================
+
+typedef uint64_t materialKey_t;
+
+static const int32_t MaterialTableSize		= 1024;		// Power of two, direct mapped
+static const int32_t MaterialKeyBits		= 4;		// Bits per (team, piece type) count in a material key
+static const int32_t ScaleFactorNormal		= 64;
+static const int32_t ScaleFactorDraw		= 0;
+static const int32_t MaxGamePhase			= 24;		// Phase of the starting material, 0 = bare kings
+static const int32_t KnownWinValue			= 10000;
+static const int32_t EvalCacheSize			= 2048;		// Power of two, direct mapped
+
+enum class endgameType_t : int32_t
+{
+	NONE = -1,
+	INSUFFICIENT_MATERIAL = 0,
+	KPK,
+	KBNK,
+	KRK,
+	KQK,
+	COUNT,
+};
+
+struct materialEntry_t
+{
+	materialKey_t	key;
+	int16_t			imbalance;					// White relative, added on top of the piece-square sum
+	uint8_t			phase;						// [0, MaxGamePhase]
+	uint8_t			scale[ TeamCount ];			// Applied when this team is the one ahead
+	endgameType_t	endgame;					// Specialized evaluator for this signature, if any
+	teamCode_t		strongTeam;					// Team the specialized evaluator plays for
+};
+
+struct evalCacheEntry_t
+{
+	uint64_t		key;
+	int32_t			score;
+};
+
+// NNUE (HalfKP): one feature per (own king square, non-king piece, square), seen from each team
+static const int32_t NnueInputDimensions	= 64 * 10 * 64;
+static const int32_t NnueHalfDimensions		= 256;
+static const int32_t NnueHiddenDimensions	= 32;
+
+struct nnueNetwork_t;
+
+struct nnueAccumulator_t
+{
+	int16_t			values[ TeamCount ][ NnueHalfDimensions ];
+	bool			dirty[ TeamCount ];		// King moved or no network at last update, rebuild before use
+};
+
+const nnueNetwork_t*	LoadNetwork( const std::string& fileName );					// nullptr on a missing or malformed file
+void					DestroyNetwork( const nnueNetwork_t*& network );
+int32_t					NnueEvaluate( const nnueNetwork_t* network, const ChessState& state, const teamCode_t sideToMove );
+
+extern const int32_t PieceValue[ (int32_t)pieceType_t::COUNT ];
+extern const int32_t( *PST[ (int32_t)pieceType_t::COUNT ] )[ BoardSize ];			// Middlegame
+extern const int32_t( *PSTEndgame[ (int32_t)pieceType_t::COUNT ] )[ BoardSize ];
+
+// Engine-free board for batch scoring, one byte per square in grid order (rank 8 first)
+static const uint8_t PackedEmpty			= 0;
+static const int32_t PackedCodeCount		= 16;
+
+inline uint8_t PackPiece( const teamCode_t team, const pieceType_t type )
+{
+	return static_cast<uint8_t>( ( static_cast<int32_t>( team ) << 3 ) | ( static_cast<int32_t>( type ) + 1 ) );
+}
+
+struct packedPosition_t
+{
+	uint8_t			squares[ BoardSize ][ BoardSize ];		// [ y ][ x ], PackPiece() codes
+	teamCode_t		sideToMove;
+};
+
+// The engine's own packed board, kept current with every placement and read in place
+struct alignas( 64 ) boardSnapshot_t
+{
+	uint8_t			squares[ BoardSize ][ BoardSize ] = {};		// [ y ][ x ], PackPiece() codes, one cache line
+	uint64_t		occupancy[ TeamCount ][ (int32_t)pieceType_t::COUNT ] = {};	// Bit y * BoardSize + x
+};
+
+// Material and tapered piece-square score only, relative to each position's side to move
+void EvaluateBatch( const packedPosition_t* positions, const size_t count, int32_t* scores );
+void EvaluateBatchReference( const packedPosition_t* positions, const size_t count, int32_t* scores );	// Scalar, for verification
+bool ParseFen( const std::string& fen, packedPosition_t& position );									// Placement and side to move, the remaining fields are ignored
+
+
+// ============================================================
+// Search
+// ============================================================
+
+static const int32_t MaxMoves			= 256;
+static const int32_t MaxSearchDepth		= 64;
+static const int32_t MateValue			= 32000;		// Mate in n plies scores MateValue - n
+static const int32_t MateBound			= MateValue - 1024;	// Scores beyond are mates, with room for tablebase distances past MaxSearchDepth
+static const int32_t InfiniteValue		= 32001;
+static const int32_t DefaultHashMB		= 16;
+static const int32_t HashFileMB			= 64;		// Default size cap of a persistent hash file
+static const int32_t HashFileMinDepth	= 4;		// Shallower entries are cheap to recompute and aren't kept
+
+struct move_t
+{
+	pieceHandle_t	piece;
+	num_t			x;
+	num_t			y;
+	pieceType_t		promotion;			// Promotion choice, NONE for every other move
+};
+
+static const move_t NoMove = { NoPiece, -1, -1, pieceType_t::NONE };
+
+inline bool operator==( const move_t& lhs, const move_t& rhs )
+{
+	return ( lhs.piece == rhs.piece ) && ( lhs.x == rhs.x ) && ( lhs.y == rhs.y ) && ( lhs.promotion == rhs.promotion );
+}
+
+inline bool operator!=( const move_t& lhs, const move_t& rhs )
+{
+	return !( lhs == rhs );
+}
+
+// Pieces a game move placed and squares it emptied, the only sources of a new check
+struct checkSources_t
+{
+	pieceHandle_t	moved = NoPiece;
+	pieceHandle_t	rook = NoPiece;			// Castling rook
+	position_t		vacated[ 2 ] = {};		// From square, and the pawn taken en passant
+	int32_t			vacatedCount = 0;
+};
+
+// What a game move changed, enough to update a board view without reading every square
+struct moveDelta_t
+{
+	position_t		vacated[ 2 ] = {};		// From square, and the castling rook's or the en passant victim's
+	int32_t			vacatedCount = 0;
+	position_t		occupied[ 2 ] = {};		// Target square, and the castling rook's new square
+	int32_t			occupiedCount = 0;
+	pieceInfo_t		moved = {};				// As it stands now, a promoted pawn reads as its new piece
+	pieceType_t		promotion = pieceType_t::NONE;
+	pieceInfo_t		captured = {};			// isPiece false when nothing was taken
+	position_t		capturedAt = { -1, -1 };	// Differs from the target square for en passant
+	bool			enpassant = false;
+	bool			castle = false;
+	position_t		rookFrom = { -1, -1 };
+	position_t		rookTo = { -1, -1 };
+	teamCode_t		checkedTeam = teamCode_t::NONE;
+	resultCode_t	result = RESULT_SUCCESS;	// GetGameResult() after the move
+};
+
+// Everything MakeMove() changes that can't be recomputed on the way back
+struct moveUndo_t
+{
+	num_t			fromX;
+	num_t			fromY;
+	num_t			moveCount;
+	bool			promoted;
+	pieceHandle_t	captured;
+	num_t			capturedX;
+	num_t			capturedY;
+	num_t			capturedIndex;		// Slot in its team's living list
+	pieceHandle_t	rook;				// Castling rook
+	num_t			rookFromX;
+	pieceHandle_t	enpassantPawn;
+	teamCode_t		checkedTeam;
+	teamCode_t		winner;
+	bool			stalemate;
+};
+
+struct searchLimits_t
+{
+	int32_t			depth = MaxSearchDepth;
+	uint64_t		nodes = 0;			// 0 = unlimited
+	int64_t			timeMs = 0;			// 0 = unlimited
+	bool			useBook = true;
+	bool			ponder = false;		// StartSearch() only: no time limit until PonderHit(), which starts the clock
+};
+
+struct searchResult_t
+{
+	move_t			bestMove = NoMove;
+	int32_t			score = 0;			// Relative to the side to move
+	int32_t			depth = 0;			// Last completed iteration
+	uint64_t		nodes = 0;
+	int64_t			timeMs = 0;
+	bool			fromBook = false;
+	std::vector< move_t > pv;
+};
+
+// Progress of a background search, sent after each completed iteration
+struct searchInfo_t
+{
+	int32_t			depth = 0;
+	int32_t			score = 0;
+	uint64_t		nodes = 0;
+	uint64_t		nps = 0;
+	int64_t			timeMs = 0;
+	std::vector< move_t > pv;
+};
+
+typedef std::function< void( const searchInfo_t& ) > searchInfoCallback_t;
+typedef std::function< void( const searchResult_t& ) > searchDoneCallback_t;
+
+struct searchLine_t
+{
+	int32_t			score = 0;			// Relative to the side to move
+	int32_t			depth = 0;
+	std::vector< move_t > pv;			// Starts with the root move this line ranks
+};
+
+struct multiPvResult_t
+{
+	std::vector< searchLine_t > lines;	// Best first
+	uint64_t		nodes = 0;
+	int64_t			timeMs = 0;
+};
+
+enum class ttBound_t : uint8_t
+{
+	NONE,
+	UPPER,
+	LOWER,
+	EXACT,
+};
+
+struct ttEntry_t
+{
+	uint64_t		key;
+	move_t			move;				// NoMove until a move loaded from a hash file is resolved, on its first probe
+	int16_t			score;
+	int8_t			depth;
+	ttBound_t		bound;
+	uint16_t		packedMove;			// The move by squares, as a packedMove_t, 0 for none. What a hash file keeps
+	uint8_t			age;				// 0 once StoreHash() writes it, the file age + 1 for hash file entries no search has stored since
+};
+
+struct searchContext_t;
+struct searchWorker_t;
+
+// Polyglot opening book, entries sorted by key
+struct openingBook_t;
+
+struct bookEntry_t
+{
+	uint16_t		move;				// Polyglot encoding: to file, to row, from file, from row, promotion (3 bits each)
+	uint16_t		weight;
+};
+
+const openingBook_t*	OpenBook( const std::string& fileName );							// nullptr on a missing or malformed file
+void					CloseBook( const openingBook_t*& book );
+int32_t					FindBookEntries( const openingBook_t* book, const uint64_t key, bookEntry_t* entries, const int32_t maxEntries );
+
+// Endgame tablebases, built by the tbgen tool
+static const int32_t TablebaseMaxPieces	= 4;
+
+struct tablebase_t;
+
+struct tbResult_t
+{
+	int32_t			wdl;				// 1 win, 0 draw, -1 loss for the side to move
+	int32_t			pliesToMate;		// 0 for draws
+};
+
+const tablebase_t*		OpenTablebases( const std::string& directory );					// Maps every table found there, nullptr when there are none
+void					CloseTablebases( const tablebase_t*& tablebases );
+
+// Monte Carlo tree search, PUCT selection over an arena of nodes
+enum class mctsPolicy_t : int32_t
+{
+	UNIFORM,						// Uniform priors, uniformly random playouts
+	HEURISTIC,						// Captures and promotions weighted up in priors and playouts
+};
+
+struct mctsLimits_t
+{
+	uint64_t		playouts = 0;		// 0 = unlimited
+	int64_t			timeMs = 0;			// 0 = unlimited, set at least one of the two
+	int32_t			threads = 1;
+	size_t			maxNodes = 1 << 20;	// Arena capacity, leaves past it are played out without expanding
+	int32_t			maxPlayoutPlies = 200;	// Longer playouts count as draws
+	float			exploration = 1.5f;	// PUCT constant
+	mctsPolicy_t	policy = mctsPolicy_t::HEURISTIC;
+	uint64_t		seed = 1;
+};
+
+struct mctsMoveStats_t
+{
+	move_t			move;
+	uint32_t		visits;
+	float			value;				// Mean reward for the side to move, 1 win, 0.5 draw, 0 loss
+	float			prior;
+};
+
+struct mctsResult_t
+{
+	move_t			bestMove = NoMove;	// Most visited
+	std::vector< mctsMoveStats_t > moves;	// Root moves, most visited first
+	uint64_t		playouts = 0;
+	size_t			nodes = 0;
+	int64_t			timeMs = 0;
+};
+
+struct mctsTree_t;
+
+// Mate solver, depth-first proof-number search over checks and evasions
+static const int32_t MateHashMB			= 16;
+
+enum class mateStatus_t : int32_t
+{
+	MATE,							// Shortest forced mate found
+	NO_CHECKING_MATE,				// No mate within the move limit where every attacker move checks, quiet moves are never tried
+	UNKNOWN,						// Node limit reached first
+};
+
+struct mateResult_t
+{
+	mateStatus_t	status = mateStatus_t::UNKNOWN;
+	int32_t			mateIn = 0;			// Moves of the side to move
+	std::vector< move_t > line;		// Both sides, ending in mate
+	uint64_t		nodes = 0;
+	int64_t			timeMs = 0;
+};
+
+struct mateContext_t;
+
+// Time-sliced search, one scheduler thread per core interleaves many games in node quanta
+static const uint64_t SliceQuantumNodes	= 2048;		// Nodes a search runs before its thread moves on
+static const int32_t SliceMoveArena		= 2048;		// Move slots per search, nodes that don't fit are evaluated statically
+static const int32_t SliceHashEntries	= 2048;		// Power of two, hash table of a sliced search that has none
+
+struct sliceSearch_t;
+struct searchScheduler_t;
+
+searchScheduler_t*		CreateScheduler( const int32_t threads );
+void					DestroyScheduler( searchScheduler_t*& scheduler );				// Drops queued searches without running their callbacks
+void					ScheduleSearch( searchScheduler_t* scheduler, const ChessEngine& position, const searchLimits_t& limits, searchDoneCallback_t onDone );	// Searches a copy, limits.timeMs is the deadline, onDone runs on a scheduler thread
+void					WaitForSearches( searchScheduler_t* scheduler );				// Returns once every scheduled search has finished
+size_t					PendingSearches( searchScheduler_t* scheduler );
+
+// Game replay from compact moves, one call per game
+typedef uint16_t packedMove_t;		// from x | from y << 3 | to x << 6 | to y << 9 | ( promotion + 1 ) << 12, engine coordinates
+
+inline packedMove_t PackMove( const num_t fromX, const num_t fromY, const num_t toX, const num_t toY, const pieceType_t promotion )
+{
+	return static_cast<packedMove_t>( fromX | ( fromY << 3 ) | ( toX << 6 ) | ( toY << 9 ) | ( ( (int32_t)promotion + 1 ) << 12 ) );
+}
+
+struct replayOptions_t
+{
+	bool			validate = true;	// False trusts the moves, e.g. archives checked before. An illegal move is then undefined behaviour
+};
+
+struct replayResult_t
+{
+	size_t			failedIndex = 0;	// First move not played, the move count when all were
+	resultCode_t	failure = RESULT_SUCCESS;	// Invalid piece or move, or the result of a game already over
+	resultCode_t	outcome = RESULT_SUCCESS;	// GetGameResult() after the last move played
+};
+
+
+// ============================================================
+// Piece classes
+// ============================================================
 
 class Piece
 {
@@ -508,7 +920,7 @@ public:
 	int32_t			ComputeAllMoveActions( position_t* moves ) const;												// Generate all moves for a piece
 	int32_t			ComputeActionPath( const int32_t actionNum, position_t* path ) const;							// Generate path for an action
 	bool			InActionPath( const int32_t actionNum, const num_t targetX, const num_t targetY ) const;		// This action can reach this location
-	void			Move( const moveType_t moveType, const num_t targetX, const num_t targetY );					// Performs a game move, rules run
+	void			Move( const moveType_t moveType, const num_t targetX, const num_t targetY, const pieceType_t promotionType = pieceType_t::NONE );	// Performs a game move, rules run. Promotion asks the callback unless a type is given
 	void			PlaceAt( const num_t targetX, const num_t targetY );											// Places a piece at a location, rules not runn. Temp moves, castling, etc
 
 	bool			IsPawnMoveValid( const int32_t actionNum, const num_t targetX, const num_t targetY ) const;		// Specialized checks for pawns (double-move, capture, enpassants)
@@ -518,7 +930,8 @@ public:
 	void			ReturnPlacement();																				// Return the piece offboard, outside rules engine. Assists other rule checks
 
 	bool			CanPromote() const;																				// Pawn promotion
-	void			Promote();																						// Pawn promotion
+	void			Promote();																						// Pawn promotion, legacy callback for moves without a choice
+	void			Promote( const pieceType_t promotionType );														// Pawn promotion, no callback
 
 	inline num_t	X() const {	return m_x; }
 	inline num_t	Y() const {	return m_y; }
@@ -555,6 +968,9 @@ public:
 
 private:
 
+	void			SetLocation( const num_t targetX, const num_t targetY );										// Grid and coordinates only, temp placements skip the NNUE accumulator
+	void			SetType( const pieceType_t newType );															// Swaps actions, keeps counts, hash and accumulator in sync
+
 	inline void SetInstanceNumber( const num_t instance )
 	{
 		m_instance = instance;
@@ -604,7 +1020,7 @@ public:
 	~ChessState() {}
 
 	moveType_t			IsLegalMove( const Piece* piece, const num_t targetX, const num_t targetY ) const;				// Core function, runs all rule evaluation
-	inline bool			OnBoard( const num_t x, const num_t y ) const;													// Bounds check for path checking
+	inline bool			OnBoard( const num_t x, const num_t y ) const { return ( x >= 0 ) && ( x < BoardSize ) && ( y >= 0 ) && ( y < BoardSize ); }	// Bounds check for path checking
 	inline const Piece* GetPiece( const pieceHandle_t handle ) const;
 	inline Piece*		GetPiece( const pieceHandle_t handle );
 	const Piece*		GetPiece( const num_t x, const num_t y ) const;
@@ -616,17 +1032,28 @@ public:
 	bool				IsBlocked( const teamCode_t team, const num_t x, const num_t y ) const;
 	bool				IsKingCaptured( const teamCode_t checkedTeamCode ) const;
 	bool				IsChecked( const teamCode_t checkedTeamCode ) const;
-	bool				IsCheckMate( const Piece* attacker, const moveType_t& moveType, const teamCode_t checkedTeamCode ) const;
+	bool				IsCheckedAfter( const Piece* king, const checkSources_t& sources ) const;			// IsChecked() looking only at direct and discovered checks from the last move
+	bool				IsCheckMate( const teamCode_t checkedTeamCode ) const;
 	bool				IsStalemate( const teamCode_t teamCode ) const;
+	bool				HasAnyLegalMove( const teamCode_t teamCode ) const;									// Stops at the first one: king moves, then check evasions, then cheapest pieces
 	bool				IsOpenToAttack( const Piece* targetPiece ) const;
 	bool				IsOpenToAttackAt( const Piece* targetPiece, const num_t targetX, const num_t targetY ) const;
 	Piece*				GetEnpassant( const num_t targetX, const num_t targetY );
+	const team_t&		GetTeam( const teamCode_t teamCode ) const { return m_teams[ static_cast<int32_t>( teamCode ) ]; }
+	materialKey_t		GetMaterialKey() const;																// Packed typeCounts of both teams, kings excluded
+	inline uint64_t		GetHash() const { return m_hash; }															// Zobrist hash of piece placement only
+
+	void				NnueMovePiece( const Piece* piece, const num_t fromX, const num_t fromY, const num_t toX, const num_t toY );
+	void				NnueRetypePiece( const Piece* piece, const pieceType_t prevType );
+	void				NnueRefresh( const teamCode_t perspective ) const;
+	inline const nnueAccumulator_t& GetAccumulator() const { return m_accumulator; }
 	inline void			SetEnpassant( const pieceHandle_t handle ) { m_enpassantPawn = handle; }						// Saves enpassant pawn for next turn checks
 
 	void				PromotionCallback( const teamCode_t teamCode, callbackEvent_t& event );
 
 	// Unwind speculative search actions
-	void				ReverseCapturePiece( const teamCode_t attacker, Piece* targetPiece );
+	void				ReverseCapturePiece( const teamCode_t attacker, Piece* targetPiece, const num_t listIndex, const num_t x, const num_t y );	// listIndex: the piece's slot in its team's living list before the capture
+	bool				IsKingSafeAfter( const Piece* piece, const num_t targetX, const num_t targetY ) const;	// King safety test of IsLegalMove() alone, for moves already known to be reachable
 
 	// Deep copy for validation
 	void				CopyFrom( const ChessState& src );
@@ -636,9 +1063,13 @@ private:
 	pieceHandle_t		m_enpassantPawn;
 	team_t				m_teams[ TeamCount ];
 	pieceHandle_t		m_grid[ BoardSize ][ BoardSize ]; // (0,0) is top left, mutable for quick tests (const-functions should always reverse)
+	uint64_t			m_hash;							// Updated with every m_grid write
+	boardSnapshot_t		m_snapshot;						// Updated with every m_grid write
+	mutable nnueAccumulator_t m_accumulator;			// Updated with every PlaceAt while a network is set, rebuilt lazily when dirty
 	ChessEngine*		m_game;
 
 	friend class ChessEngine;
+	friend class Piece;
 };
 
 
@@ -653,8 +1084,16 @@ public:
 
 	ChessEngine() {}
 
+	ChessEngine( const ChessEngine& src ) { CopyFrom( src ); }		// Deep copy, e.g. one per search thread
+	ChessEngine& operator=( const ChessEngine& ) = delete;
+
 	~ChessEngine()
 	{
+		ReleaseSearchWorker();
+		if ( m_hashFileName.empty() == false ) {
+			SaveHashFile();
+		}
+
 		m_pieceNum = 0;
 		for ( int32_t i = 0; i < PieceCount; ++i )
 		{
@@ -666,14 +1105,27 @@ public:
 	{
 		m_pieceNum = 0;
 		m_winner = teamCode_t::NONE;
+		m_checkedTeam = teamCode_t::NONE;
+		m_stalemate = false;
+		m_draw = RESULT_SUCCESS;
+		m_gameStatePending = false;
+		m_checkSources = checkSources_t();
+		m_halfMoveClock = 0;
+		m_keyHistory.clear();
 		
+		for ( int32_t i = 0; i < PieceCount; ++i ) {
+			delete m_pieces[ i ];
+		}
 		memset( m_pieces, 0, sizeof( Piece* ) * PieceCount );
+		ClearMaterialTable();
+		ClearEvalCache();
+		ClearHash();
 		m_config = cfg;
-		SetBoard( m_config );
 		m_state.m_game = this;
+		SetBoard( m_config );
 
-		SetPromotionCallback( teamCode_t::WHITE, &AutoPromoteQueen );
-		SetPromotionCallback( teamCode_t::BLACK, &AutoPromoteQueen );
+		SetPromotionCallback( teamCode_t::WHITE, nullptr );	// Commands carry their promotion, an unset choice is a queen
+		SetPromotionCallback( teamCode_t::BLACK, nullptr );
 
 		const bool whiteChecked = m_state.IsChecked( teamCode_t::WHITE );
 		const bool blackChecked = m_state.IsChecked( teamCode_t::BLACK );
@@ -694,7 +1146,7 @@ public:
 
 	static inline teamCode_t GetOpposingTeam( const teamCode_t team ) { return ( team == teamCode_t::WHITE ) ? teamCode_t::BLACK : teamCode_t::WHITE; }
 
-	resultCode_t Execute( const command_t& cmd )
+	resultCode_t Execute( const command_t& cmd, moveDelta_t* delta = nullptr )		// Fills the delta when given, which runs a lazy game state's analysis
 	{
 		const pieceHandle_t piece = FindPiece( cmd.team, cmd.pieceType, cmd.instance );
 		if ( piece == NoPiece )
@@ -702,25 +1154,30 @@ public:
 			return resultCode_t::RESULT_GAME_INVALID_PIECE;
 		}
 
-		if ( GetWinner() != teamCode_t::NONE )
+		if ( IsKnownGameOver() )
 		{
 			return GetGameResult();
 		}
 
-		if ( PerformMoveAction( piece, cmd.x, cmd.y ) == false )
+		if ( PerformMoveAction( piece, cmd.x, cmd.y, cmd.promotion, delta ) == false )
 		{
-			return resultCode_t::RESULT_GAME_INVALID_MOVE;
+			return IsGameOver() ? GetGameResult() : resultCode_t::RESULT_GAME_INVALID_MOVE;
 		}
 
-		return ( GetWinner() != teamCode_t::NONE || IsStalemate() ) ? GetGameResult() : resultCode_t::RESULT_SUCCESS;
+		return IsKnownGameOver() ? GetGameResult() : resultCode_t::RESULT_SUCCESS;
 	}
 
 	resultCode_t GetGameResult() const
 	{
+		ResolveGameState();
 		if ( m_stalemate )
 		{
 			return resultCode_t::RESULT_GAME_COMPLETE_STALEMATE;
 		}
+		if ( m_draw != RESULT_SUCCESS )
+		{
+			return m_draw;
+		}
 		if ( m_winner == teamCode_t::WHITE )
 		{
 			return resultCode_t::RESULT_GAME_COMPLETE_WHITE_WINS;
@@ -774,21 +1231,96 @@ public:
 	pieceInfo_t			GetInfo( const pieceHandle_t pieceType ) const;													// Query info about a given piece
 	pieceInfo_t			GetInfo( const num_t x, const num_t y ) const;													// Query info for the selected square (team, piece type, etc)
 	bool				GetLocation( const pieceHandle_t pieceType, num_t& x, num_t& y ) const;							// Query the location given a piece
-	inline bool			IsStalemate() const { return m_stalemate; }														// Is stalemate
+	inline bool			IsStalemate() const { ResolveGameState(); return m_stalemate; }									// Is stalemate
+	inline bool			IsDraw() const { ResolveGameState(); return m_stalemate || ( m_draw != RESULT_SUCCESS ); }		// Stalemate, repetition, fifty-move rule or insufficient material
+	inline bool			IsGameOver() const { return ( GetWinner() != teamCode_t::NONE ) || IsDraw(); }
+	inline int32_t		GetHalfMoveClock() const { return m_halfMoveClock; }											// Plies since the last capture or pawn move
+	int32_t				GetRepetitionCount() const;																		// Times the current position has occurred, this one included
+	bool				IsInsufficientMaterial() const;																	// Bare kings, a lone minor piece, or bishops all on one colour
 	inline teamCode_t	GetCurrentPlayer() { return m_currentTurn; }													// Player for current turn
-	inline teamCode_t	GetWinner() const { return m_winner; }															// Winning team or none
-	inline teamCode_t	GetCheckedTeam() const { return m_checkedTeam; }												// Checked team or none
+	inline teamCode_t	GetWinner() const { ResolveGameState(); return m_winner; }										// Winning team or none
+	inline teamCode_t	GetCheckedTeam() const { ResolveGameState(); return m_checkedTeam; }							// Checked team or none
 	inline num_t		GetPieceCount() const { return m_pieceNum; }													// Piece count given this game config
+	uint64_t			GetPositionKey() const;																			// Zobrist key: placement, castling rights, en passant and side to move
 	bool				IsValidHandle( const pieceHandle_t handle ) const;												// Is this piece handle valid? (Likely, yes)
-
+	int32_t				Evaluate() const;																				// Static evaluation in centipawns, relative to the side to move
+	void				SetNetwork( const nnueNetwork_t* network );														// NNUE evaluation, nullptr falls back to the piece-square evaluation
+	inline const nnueNetwork_t* GetNetwork() const { return m_network; }
+	const materialEntry_t& ProbeMaterial() const;																		// Material table lookup, computes the entry on a miss
+	inline const boardSnapshot_t& GetBoardSnapshot() const { return m_state.m_snapshot; }								// No copy, valid between moves
+	void				GetPackedPosition( packedPosition_t& position ) const;															// Board snapshot for EvaluateBatch()
+	int32_t				GenerateMoves( move_t moves[ MaxMoves ] ) const;												// Legal moves for the side to move, one per promotion choice
+	uint64_t			GetLegalTargets( const pieceHandle_t pieceHdl ) const;											// Squares the piece can move to, bit y * BoardSize + x
+	void				GetLegalTargets( const teamCode_t team, uint64_t targets[ BoardSize * BoardSize ] ) const;		// Per origin square, zero where the team has no piece
+	command_t			GetMoveCommand( const move_t& move ) const;														// Command that Execute() accepts for this move
+	std::string			GetMoveString( const move_t& move ) const;														// Coordinate notation, e.g. "e2e4" or "e7e8q"
+	std::string			GetLineString( const std::vector< move_t >& line ) const;										// Space separated GetMoveString() of a line from this position
+	move_t				ParseMoveString( const std::string& text ) const;												// Legal move in coordinate notation, NoMove otherwise
+	resultCode_t		ExecuteMove( const move_t& move, moveDelta_t* delta = nullptr );								// Execute() for a move from GenerateMoves(), promotion choice included
+	resultCode_t		ExecuteTrusted( const move_t& move, moveDelta_t* delta = nullptr );								// ExecuteMove() without the legality check. Undefined behaviour unless the move is legal here, debug builds assert
+	replayResult_t		ReplayGame( const packedMove_t* moves, const size_t count, const replayOptions_t& options = replayOptions_t() );	// Plays moves until one fails, game state analysed once at the end
+	packedMove_t		GetPackedMove( const move_t& move ) const;														// Compact form for ReplayGame()
+	move_t				UnpackMove( const packedMove_t packed ) const;													// NoMove unless a piece of the side to move is on the from square
+	bool				InitFromFen( const std::string& fen );															// Init() with side to move, castling rights and en passant, keeps the hash table
+	searchResult_t		Search( const searchLimits_t& limits );															// Book move when allowed, else iterative deepening alpha-beta
+	void				StartSearch( const searchLimits_t& limits, searchInfoCallback_t onInfo, searchDoneCallback_t onDone );	// Search() on a background thread, leave the engine alone until onDone runs, not callable from the callbacks
+	void				Stop();																							// Ends a background search, returns once onDone has run; from a callback it only asks the search to end
+	void				PonderHit();																					// The pondered move was played, the time limit starts now
+	bool				IsSearching() const;
+	multiPvResult_t		AnalyzeMultiPV( const int32_t lineCount, const searchLimits_t& limits );						// Per depth, lineCount root searches, each without the root moves of the lines before it
+	uint64_t			Perft( const int32_t depth );																	// Leaf count of the legal move tree, exercises make/unmake
+	void				SetHashSize( const size_t megabytes );
+	void				ClearHash();																					// Reloads the hash file's entries when one is open
+	bool				OpenHashFile( const std::string& fileName, const size_t maxMegabytes = HashFileMB );			// Warms the hash table from the file, the destructor merges it back
+	bool				SaveHashFile();																					// Merges deep entries into the file, entries carried over age
+	void				SetBook( const openingBook_t* book ) { m_book = book; }											// nullptr disables book moves
+	bool				PickBookMove( move_t& move );																	// Weighted pick among the book moves for this position
+	void				SetTablebases( const tablebase_t* tablebases ) { m_tablebases = tablebases; }					// nullptr disables probing
+	bool				ProbeTablebase( tbResult_t& result ) const;													// False without a table for this material, or with castling or en passant possible
+	mctsResult_t		SearchMcts( const mctsLimits_t& limits ) const;												// Visit counts of the root moves, playouts run on per-thread copies
+	mateResult_t		SolveMate( const int32_t maxMoves, const uint64_t maxNodes = 0 );								// Forced mate for the side to move, checking moves only
+	sliceSearch_t*		BeginSlicedSearch( const searchLimits_t& limits );												// Search() that runs in slices, the engine belongs to it until EndSlicedSearch()
+	bool				ResumeSlicedSearch( sliceSearch_t* search, const uint64_t nodes );								// Searches up to this many nodes, true once finished
+	searchResult_t		EndSlicedSearch( sliceSearch_t*& search );														// Result so far, frees the search
+
+	inline void			SetLazyGameState( const bool lazy ) { ResolveGameState(); m_lazyGameState = lazy; }			// Lazy: moves skip check, mate and stalemate analysis until the result is queried
 	inline void			SetPromotionCallback( const teamCode_t team, callback_t callback ) { m_promotionCallback[ (int32_t)team ] = callback; }
 
 private:
 	void				SetBoard( const gameConfig_t& cfg );															// Sets the board up for a given play-state (e.g. default starting set-up)
 	void				EnterPieceInGame( Piece* piece, const num_t x, const num_t y );									// Registers the piece and places it on the board
-	bool				PerformMoveAction( const pieceHandle_t pieceHdl, const num_t targetX, const num_t targetY );	// Performs a game move
-	void				CalculateGameState( const moveType_t& moveType, const pieceHandle_t movedPieceHdl );			// Checkmate, Check, Stalemate
-	int32_t				Search( int32_t depth );																		// A.I. search
+	bool				PerformMoveAction( const pieceHandle_t pieceHdl, const num_t targetX, const num_t targetY, const pieceType_t promotion, moveDelta_t* delta );	// Performs a game move
+	bool				IsGeneratedMove( const move_t& move ) const;													// Legal in this position
+	void				SetCheckSources( const Piece* piece, const num_t targetX, const num_t targetY );				// Call before the piece moves
+	void				BeginMoveDelta( moveDelta_t& delta, const num_t targetX, const num_t targetY ) const;			// After SetCheckSources(), before the piece moves
+	void				EndMoveDelta( moveDelta_t& delta ) const;
+	void				CalculateGameState();																			// Checkmate, Check, Stalemate for the side to move
+	void				UpdateGameState();																				// CalculateGameState() now, or on the first query in lazy mode
+	inline void			ResolveGameState() const { if ( m_gameStatePending ) { const_cast<ChessEngine*>( this )->CalculateGameState(); } }	// Not thread safe while pending
+	inline bool			IsKnownGameOver() const { return m_gameStatePending ? ( m_draw != RESULT_SUCCESS ) : IsGameOver(); }	// Pending mate or stalemate leaves no legal move, Execute() finds it then
+	void				RecordGameMove( const uint64_t keyBefore, const bool irreversible );							// Repetition history and half-move clock, then the draw rules
+	void				MakeMove( const move_t& move, moveUndo_t& undo );												// Search move, no game state rules run
+	void				UnmakeMove( const move_t& move, const moveUndo_t& undo );
+	void				MctsWorker( mctsTree_t& tree, const int32_t threadIndex );
+	void				MateNode( mateContext_t& context, const int32_t plies, const bool attacker, const uint32_t proofLimit, const uint32_t disproofLimit );
+	bool				IsMateProven( mateContext_t& context, const int32_t plies, const bool attacker );
+	void				ExtractMateLine( mateContext_t& context, int32_t plies, std::vector< move_t >& line );
+	teamCode_t			Playout( const mctsLimits_t& limits, uint64_t& random, std::vector< moveUndo_t >& undos, std::vector< move_t >& moves );	// Winner, NONE for a draw
+	void				CopyFrom( const ChessEngine& src );
+	int32_t				SearchNode( int32_t depth, const int32_t ply, int32_t alpha, const int32_t beta, searchContext_t& context );
+	int32_t				Quiescence( const int32_t ply, int32_t alpha, const int32_t beta, searchContext_t& context );
+	void				OrderMoves( move_t* moves, const int32_t moveCount, const move_t& hashMove, const move_t killers[ 2 ] ) const;
+	ttEntry_t*			ProbeHash( const uint64_t key );
+	searchResult_t		RunSearch( const searchLimits_t& limits, searchWorker_t* worker );
+	void				ReleaseSearchWorker();
+	void				ExtendPvFromHash( std::vector< move_t >& pv, const int32_t maxLength );
+	bool				EnterSliceNode( sliceSearch_t& search, int32_t depth, int32_t alpha, const int32_t beta, const int32_t reversible, int32_t& score );
+	void				FinishSlicedSearch( sliceSearch_t& search );
+	void				StoreHash( const uint64_t key, const move_t& move, const int32_t score, const int32_t depth, const ttBound_t bound, const int32_t ply );
+	bool				LoadHashFile();																					// Hash file entries into the table, deeper ones already there stay
+	void				ClearMaterialTable();
+	void				ClearEvalCache();
+	int32_t				EvaluateUncached() const;
 
 	inline void			PromotionCallback( const teamCode_t teamCode, callbackEvent_t& event )							// User needs to make their pick of piece, A.I. can run a heuristic
 	{
@@ -799,7 +1331,7 @@ private:
 
 private:
 	ChessState			m_state;
-	Piece*				m_pieces[ PieceCount ];
+	Piece*				m_pieces[ PieceCount ] = {};
 	callback_t			m_promotionCallback[ TeamCount ];
 	num_t				m_pieceNum;
 	int32_t				m_turnCount;
@@ -807,8 +1339,25 @@ private:
 	teamCode_t			m_winner;
 	teamCode_t			m_checkedTeam;
 	bool				m_stalemate;
+	resultCode_t		m_draw;							// Draw other than stalemate, RESULT_SUCCESS while none
+	bool				m_lazyGameState = false;
+	bool				m_gameStatePending = false;		// Check, winner and stalemate are stale until CalculateGameState()
+	checkSources_t		m_checkSources;					// Last game move, none for a position just set up
+	int32_t				m_halfMoveClock;
+	std::vector< uint64_t >	m_keyHistory;				// Position keys before each game move, oldest first
 	gameConfig_t		m_config;
 
+	mutable materialEntry_t	m_materialTable[ MaterialTableSize ];
+	mutable evalCacheEntry_t	m_evalCache[ EvalCacheSize ];
+	const nnueNetwork_t*	m_network = nullptr;
+	const openingBook_t*	m_book = nullptr;
+	uint64_t			m_bookRandom = 0x9E3779B97F4A7C15ull;
+	const tablebase_t*	m_tablebases = nullptr;
+	std::vector< ttEntry_t >	m_hashTable;
+	searchWorker_t*		m_searchWorker = nullptr;		// Created by the first StartSearch()
+	std::string			m_hashFileName;					// Persistent hash file, empty when unused
+	size_t				m_hashFileMB = HashFileMB;
+
 	friend class ChessState;
 };
 
@@ -816,6 +1365,22 @@ private:
 using Chess = ChessEngine;
 
 
+// Hot path, defined once ChessEngine is complete
+inline const Piece* ChessState::GetPiece( const pieceHandle_t handle ) const
+{
+	return const_cast<ChessState*>( this )->GetPiece( handle );
+}
+
+
+inline Piece* ChessState::GetPiece( const pieceHandle_t handle )
+{
+	if ( m_game->IsValidHandle( handle ) ) {
+		return m_game->m_pieces[ handle ];
+	}
+	return nullptr;
+}
+
+
 // ============================================================
 // Command helpers
 // ============================================================
@@ -919,7 +1484,7 @@ static resultCode_t TranslateActionCommand( const ChessEngine& board, const team
 		return ( team == teamCode_t::WHITE ) ? resultCode_t::RESULT_GAME_COMPLETE_WHITE_RESIGNS : resultCode_t::RESULT_GAME_COMPLETE_BLACK_RESIGNS;
 	}
 
-	if ( commandString.size() != 4 )
+	if ( ( commandString.size() != 4 ) && ( commandString.size() != 5 ) )
 	{
 		return resultCode_t::RESULT_INPUT_INVALID_COMMAND;
 	}
@@ -945,5 +1510,16 @@ static resultCode_t TranslateActionCommand( const ChessEngine& board, const team
 		return resultCode_t::RESULT_INPUT_INVALID_RANK;
 	}
 
+	// Optional promotion choice, e.g. "p0a8n"
+	outCmd.promotion = pieceType_t::NONE;
+	if ( commandString.size() == 5 )
+	{
+		outCmd.promotion = GetPieceType( commandString[ 4 ] );
+		if ( ( outCmd.promotion == pieceType_t::NONE ) || ( outCmd.promotion == pieceType_t::PAWN ) || ( outCmd.promotion == pieceType_t::KING ) )
+		{
+			return resultCode_t::RESULT_INPUT_INVALID_COMMAND;
+		}
+	}
+
 	return resultCode_t::RESULT_SUCCESS;
 }
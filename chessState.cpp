@@ -1,4 +1,44 @@
-#include "Chess.h"
+#include "chess.h"
+
+#include <algorithm>
+
+static const int32_t SquareCount = BoardSize * BoardSize;
+static const int32_t LineCount = 8;
+static const position_t LineSteps[ LineCount ] = { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 }, { 1, 1 }, { -1, 1 }, { 1, -1 }, { -1, -1 } };	// Orthogonal, then diagonal
+
+// Line from one square through another, -1 when they share no rank, file or diagonal
+struct lineTable_t
+{
+	lineTable_t()
+	{
+		for ( int32_t from = 0; from < SquareCount; ++from )
+		{
+			for ( int32_t to = 0; to < SquareCount; ++to ) {
+				line[ from ][ to ] = -1;
+			}
+
+			for ( int32_t l = 0; l < LineCount; ++l )
+			{
+				num_t x = from % BoardSize + LineSteps[ l ].x;
+				num_t y = from / BoardSize + LineSteps[ l ].y;
+				for ( ; ( x >= 0 ) && ( x < BoardSize ) && ( y >= 0 ) && ( y < BoardSize ); x += LineSteps[ l ].x, y += LineSteps[ l ].y ) {
+					line[ from ][ y * BoardSize + x ] = l;
+				}
+			}
+		}
+	}
+
+	int8_t line[ SquareCount ][ SquareCount ];
+};
+
+static const lineTable_t Lines;
+
+
+static inline bool SlidesAlong( const pieceType_t type, const int32_t line )
+{
+	const bool diagonal = ( line >= 4 );
+	return ( type == pieceType_t::QUEEN ) || ( type == ( diagonal ? pieceType_t::BISHOP : pieceType_t::ROOK ) );
+}
 
 // This class must *always* honor const-correctness upon destruction
 class ScopedTempPlacement
@@ -115,6 +155,23 @@ void ChessState::SetHandle( const pieceHandle_t pieceHdl, const num_t x, const n
 	if ( OnBoard( x, y ) == false ) {
 		return;
 	}
+
+	const uint64_t bit = 1ull << ( y * BoardSize + x );
+	const pieceHandle_t prevHdl = m_grid[ y ][ x ];
+	if ( prevHdl != NoPiece )
+	{
+		const Piece* prevPiece = m_game->m_pieces[ prevHdl ];
+		m_hash ^= ZobristPieceKey( prevPiece->team, prevPiece->type, x, y );
+		m_snapshot.occupancy[ (int32_t)prevPiece->team ][ (int32_t)prevPiece->type ] &= ~bit;
+	}
+	m_snapshot.squares[ y ][ x ] = PackedEmpty;
+	if ( pieceHdl != NoPiece )
+	{
+		const Piece* piece = m_game->m_pieces[ pieceHdl ];
+		m_hash ^= ZobristPieceKey( piece->team, piece->type, x, y );
+		m_snapshot.occupancy[ (int32_t)piece->team ][ (int32_t)piece->type ] |= bit;
+		m_snapshot.squares[ y ][ x ] = PackPiece( piece->team, piece->type );
+	}
 	m_grid[ y ][ x ] = pieceHdl;
 }
 
@@ -128,27 +185,6 @@ pieceHandle_t ChessState::GetHandle( const num_t x, const num_t y ) const
 }
 
 
-bool ChessState::OnBoard( const num_t x, const num_t y ) const
-{
-	return ( x >= 0 ) && ( x < BoardSize ) && ( y >= 0 ) && ( y < BoardSize );
-}
-
-
-const Piece* ChessState::GetPiece( const pieceHandle_t handle ) const
-{
-	return const_cast<ChessState*>( this )->GetPiece( handle );
-}
-
-
-Piece* ChessState::GetPiece( const pieceHandle_t handle )
-{
-	if ( m_game->IsValidHandle( handle ) ) {
-		return m_game->m_pieces[ handle ];
-	}
-	return nullptr;
-}
-
-
 const Piece* ChessState::GetPiece( const num_t x, const num_t y ) const
 {
 	return const_cast<ChessState*>( this )->GetPiece( x, y );
@@ -278,10 +314,8 @@ void ChessState::PromotionCallback( const teamCode_t teamCode, callbackEvent_t&
 }
 
 
-void ChessState::ReverseCapturePiece( const teamCode_t attacker, Piece* targetPiece )
+void ChessState::ReverseCapturePiece( const teamCode_t attacker, Piece* targetPiece, const num_t listIndex, const num_t x, const num_t y )
 {
-	assert( 0 ); // NOT FINISHED
-
 	if ( targetPiece == nullptr ) {
 		return;
 	}
@@ -296,39 +330,61 @@ void ChessState::ReverseCapturePiece( const teamCode_t attacker, Piece* targetPi
 		num_t* capturedTypeCount = m_teams[ attackerIndex ].captureTypeCounts;
 		num_t& capturedCount = m_teams[ attackerIndex ].capturedCount;
 
+		assert( ( capturedCount > 0 ) && ( captured[ capturedCount - 1 ] == targetPiece->m_handle ) );
+
 		--capturedCount;
 		captured[ capturedCount ] = NoPiece;
 
 		--capturedTypeCount[ pieceTypeIndex ];	
 	}
 
-	// Update current team stats
+	// Update current team stats, the capture swapped the last living piece into this slot
 	{
 		num_t* teamPieces = m_teams[ index ].pieces;
 		num_t* typeCounts = m_teams[ index ].typeCounts;
 		num_t& livingCount = m_teams[ index ].livingCount;
 
+		assert( ( listIndex >= 0 ) && ( listIndex <= livingCount ) );
+
+		teamPieces[ livingCount ] = teamPieces[ listIndex ];
+		teamPieces[ listIndex ] = targetPiece->m_handle;
 		++livingCount;
+		++typeCounts[ pieceTypeIndex ];
+	}
+
+	targetPiece->BindBoard( this, targetPiece->m_handle );
+	targetPiece->PlaceAt( x, y );
 
-		//for ( int32_t i = 0; i < livingCount; ++i )
-		//{
+	return;
+}
 
 
-		//	if ( teamPieces[ i ] == targetPiece->m_handle )
-		//	{
-		//		teamPieces[ i ] = teamPieces[ livingCount - 1 ];
-		//		teamPieces[ livingCount - 1 ] = NoPiece;
-		//		--livingCount;
-		//		break;
-		//	}
-		//}
+bool ChessState::IsKingSafeAfter( const Piece* piece, const num_t targetX, const num_t targetY ) const
+{
+	const Piece* king = GetPiece( m_game->FindPiece( piece->team, pieceType_t::KING, 0 ) );
+
+	// An en passant capture also clears the captured pawn's square
+	const Piece* enpassantPawn = nullptr;
+	if ( ( piece->type == pieceType_t::PAWN ) && ( targetX != piece->X() ) && ( GetHandle( targetX, targetY ) == NoPiece ) ) {
+		enpassantPawn = const_cast<ChessState*>( this )->GetEnpassant( targetX, targetY );
 	}
 
-	targetPiece->RemoveFromPlay();
+	if ( enpassantPawn != nullptr ) {
+		const_cast<Piece*>( enpassantPawn )->TempPlacement( -1, -1 );
+	}
 
-	return;
-}
+	bool safe = true;
+	{
+		// Temporarily mutates state, but honors function's const-contract
+		ScopedTempPlacement tempMove( this, piece, targetX, targetY );
+		safe = ( IsOpenToAttack( king ) == false );
+	}
 
+	if ( enpassantPawn != nullptr ) {
+		const_cast<Piece*>( enpassantPawn )->ReturnPlacement();
+	}
+	return safe;
+}
 
 
 bool ChessState::IsOpenToAttack( const Piece* targetPiece ) const
@@ -349,6 +405,20 @@ bool ChessState::IsOpenToAttackAt( const Piece* targetPiece, const num_t x, cons
 	{
 		const Piece* piece = GetPiece( m_teams[ index ].pieces[ i ] );
 
+		// Lifted off the board by a tentative capture
+		if ( OnBoard( piece->X(), piece->Y() ) == false ) {
+			continue;
+		}
+
+		// A pawn's capture path only opens onto an occupied square, the empty squares it covers count too
+		if ( piece->type == pieceType_t::PAWN )
+		{
+			if ( ( abs( x - piece->X() ) == 1 ) && ( y == piece->Y() + piece->GetTeamDirection() ) ) {
+				return true;
+			}
+			continue;
+		}
+
 #if USE_MOVE_CACHE_TEST
 		const MoveCache& superset = piece->GetMoveCache();
 
@@ -408,129 +478,176 @@ bool ChessState::IsChecked( const teamCode_t checkedTeamCode ) const
 }
 
 
-bool ChessState::IsCheckMate( const Piece* attacker, const moveType_t& moveType, const teamCode_t checkedTeamCode ) const
+bool ChessState::IsCheckedAfter( const Piece* king, const checkSources_t& sources ) const
 {
-	const pieceHandle_t kingHdl = m_game->FindPiece( checkedTeamCode, pieceType_t::KING, 0 );
-	const Piece* king = GetPiece( kingHdl );
+	const teamCode_t attacker = ChessEngine::GetOpposingTeam( king->team );
+	const int32_t kingSquare = king->Y() * BoardSize + king->X();
+	bool checked = false;
 
-	// King was captured after last move
-	if ( king == nullptr ) {
-		return true;
+	// Direct: a moved piece now attacks the king
+	const pieceHandle_t movers[] = { sources.moved, sources.rook };
+	for ( const pieceHandle_t handle : movers )
+	{
+		const Piece* piece = GetPiece( handle );
+		if ( ( checked == true ) || ( piece == nullptr ) || ( OnBoard( piece->X(), piece->Y() ) == false ) ) {
+			continue;
+		}
+
+		const num_t dx = king->X() - piece->X();
+		const num_t dy = king->Y() - piece->Y();
+		switch ( piece->type )
+		{
+		case pieceType_t::PAWN:		checked = ( dy == piece->GetTeamDirection() ) && ( abs( dx ) == 1 ); break;
+		case pieceType_t::KNIGHT:	checked = ( abs( dx * dy ) == 2 ); break;
+		case pieceType_t::KING:		checked = ( std::max( abs( dx ), abs( dy ) ) == 1 ); break;
+		default:
+		{
+			const int32_t line = Lines.line[ piece->Y() * BoardSize + piece->X() ][ kingSquare ];
+			if ( ( line >= 0 ) && SlidesAlong( piece->type, line ) )
+			{
+				num_t x = piece->X() + LineSteps[ line ].x;
+				num_t y = piece->Y() + LineSteps[ line ].y;
+				while ( ( ( x != king->X() ) || ( y != king->Y() ) ) && ( m_grid[ y ][ x ] == NoPiece ) ) {
+					x += LineSteps[ line ].x;
+					y += LineSteps[ line ].y;
+				}
+				checked = ( x == king->X() ) && ( y == king->Y() );
+			}
+		}
+		}
 	}
 
-	// King is pinned
-	const int32_t actionCount = king->GetActionCount();
-	for ( int32_t action = 0; action < actionCount; ++action )
+	// Discovered: the first piece past an emptied square, looking out from the king, is a slider on that line
+	for ( int32_t i = 0; ( checked == false ) && ( i < sources.vacatedCount ); ++i )
 	{
-		num_t nextX = king->X();
-		num_t nextY = king->Y();
-		king->CalculateStep( action, nextX, nextY );
+		const int32_t line = Lines.line[ kingSquare ][ sources.vacated[ i ].y * BoardSize + sources.vacated[ i ].x ];
+		if ( line < 0 ) {
+			continue;
+		}
 
-		if( IsLegalMove( king, nextX, nextY ) != moveType_t::NONE ) {
-			return false;
+		num_t x = king->X() + LineSteps[ line ].x;
+		num_t y = king->Y() + LineSteps[ line ].y;
+		while ( OnBoard( x, y ) && ( m_grid[ y ][ x ] == NoPiece ) ) {
+			x += LineSteps[ line ].x;
+			y += LineSteps[ line ].y;
 		}
+
+		const Piece* slider = OnBoard( x, y ) ? GetPiece( m_grid[ y ][ x ] ) : nullptr;
+		checked = ( slider != nullptr ) && ( slider->team == attacker ) && SlidesAlong( slider->type, line );
 	}
 
-	// Path of all attacker can be blocked
-	position_t attackSquares[ BoardSize ];
+	assert( checked == IsOpenToAttack( king ) );
+	return checked;
+}
 
-	int32_t attackSquareCount = 0;
 
-	const int32_t attackerActionCount = attacker->GetActionCount();
+bool ChessState::IsCheckMate( const teamCode_t checkedTeamCode ) const
+{
+	return IsChecked( checkedTeamCode ) && ( HasAnyLegalMove( checkedTeamCode ) == false );
+}
 
-	const int32_t actionNum = attacker->GetActionNum( moveType );
-	{
-		num_t nextX = attacker->X();
-		num_t nextY = attacker->Y();
-		const int32_t maxSteps = attacker->GetActions()[ actionNum ].maxSteps;
 
-		// Represents kill action
-		attackSquares[ attackSquareCount ] = position_t{ nextX, nextY };
-		++attackSquareCount;
+bool ChessState::IsStalemate( const teamCode_t teamCode ) const
+{
+	return ( IsChecked( teamCode ) == false ) && ( HasAnyLegalMove( teamCode ) == false );
+}
 
-		for ( int32_t step = 1; step <= maxSteps; ++step )
-		{
-			attacker->CalculateStep( actionNum, nextX, nextY );
 
-			if ( nextX == king->X() && nextY == king->Y() ) {
-				break;
-			}
+bool ChessState::HasAnyLegalMove( const teamCode_t teamCode ) const
+{
+	static const pieceType_t CheapestFirst[] = { pieceType_t::PAWN, pieceType_t::KNIGHT, pieceType_t::BISHOP, pieceType_t::ROOK, pieceType_t::QUEEN };
 
-			attackSquares[ attackSquareCount ] = position_t{ nextX, nextY };
-			++attackSquareCount;
-		}
+	const Piece* king = GetPiece( m_game->FindPiece( teamCode, pieceType_t::KING, 0 ) );
+	if ( king == nullptr ) {
+		return false;
 	}
 
-	const team_t defenderTeam = m_teams[ static_cast<int32_t>( checkedTeamCode ) ];
+	position_t targets[ 4 * BoardSize ];
 
-	for ( int32_t defenderIx = 0; defenderIx < defenderTeam.livingCount; ++defenderIx )
+	int32_t targetCount = king->ComputeAllMoveActions( targets );
+	for ( int32_t t = 0; t < targetCount; ++t )
 	{
-		const Piece* defenderPiece = GetPiece( defenderTeam.pieces[ defenderIx ] );
-		const int32_t actionCount = defenderPiece->GetActionCount();
-
-		if ( defenderPiece->m_handle == kingHdl ) {
-			continue;
+		if ( IsKingSafeAfter( king, targets[ t ].x, targets[ t ].y ) ) {
+			return true;
 		}
+	}
 
-		for ( int32_t squareIndex = 0; squareIndex < attackSquareCount; ++squareIndex )
+	// In check only a capture of the checker or a block can help, and against two checkers neither does
+	uint64_t evasions = ~0ull;
+	const Piece* checker = nullptr;
+	{
+		const team_t& enemies = GetTeam( ChessEngine::GetOpposingTeam( teamCode ) );
+		int32_t checkerCount = 0;
+		for ( int32_t i = 0; i < enemies.livingCount; ++i )
 		{
-			position_t& square = attackSquares[ attackSquareCount ];
-#if USE_MOVE_CACHE_TEST
-			const MoveCache& superset = defenderPiece->GetMoveCache();
-
-			const num_t localX = ( square.x - defenderPiece->X() );
-			const num_t localY = ( square.y - defenderPiece->Y() ) * defenderPiece->GetTeamDirection();
-
-			if ( !superset.Test( localX, localY ) ) {
-				continue;
-			}
-#endif
-			for ( int32_t actionNum = 0; actionNum < actionCount; ++actionNum )
-			{			
-				if ( IsLegalMove( defenderPiece, square.x, square.y ) != moveType_t::NONE )
+			const Piece* enemy = GetPiece( enemies.pieces[ i ] );
+			const int32_t actionCount = enemy->GetActionCount();
+			for ( int32_t action = 0; action < actionCount; ++action )
+			{
+				if ( enemy->InActionPath( action, king->X(), king->Y() ) )
 				{
-					return false;
+					checker = enemy;
+					++checkerCount;
+					break;
 				}
 			}
 		}
-	}
-	return true;
-}
 
+		if ( checkerCount > 1 ) {
+			return false;
+		}
 
-bool ChessState::IsStalemate( const teamCode_t teamCode ) const
-{
-	const team_t team = m_teams[ (int32_t)teamCode ];
+		if ( checker != nullptr )
+		{
+			evasions = 1ull << ( checker->Y() * BoardSize + checker->X() );
 
-	const pieceHandle_t kingHdl = m_game->FindPiece( teamCode, pieceType_t::KING, 0 );
-	const Piece* king = GetPiece( kingHdl );
+			const bool slider = ( checker->type == pieceType_t::ROOK ) || ( checker->type == pieceType_t::BISHOP ) || ( checker->type == pieceType_t::QUEEN );
+			if ( slider )
+			{
+				const num_t stepX = ( king->X() > checker->X() ) - ( king->X() < checker->X() );
+				const num_t stepY = ( king->Y() > checker->Y() ) - ( king->Y() < checker->Y() );
+				for ( num_t x = checker->X() + stepX, y = checker->Y() + stepY; ( x != king->X() ) || ( y != king->Y() ); x += stepX, y += stepY ) {
+					evasions |= 1ull << ( y * BoardSize + x );
+				}
+			}
+		}
+	}
 
-	for ( int32_t pieceIx = 0; pieceIx < team.livingCount; ++pieceIx )
+	const team_t& team = GetTeam( teamCode );
+	for ( const pieceType_t type : CheapestFirst )
 	{
-		const Piece* piece = GetPiece( team.pieces[ pieceIx ] );
-		const int32_t actionCount = piece->GetActionCount();
+		if ( team.typeCounts[ (int32_t)type ] == 0 ) {
+			continue;
+		}
 
-		for ( int32_t actionNum = 0; actionNum < actionCount; ++actionNum )
+		for ( int32_t i = 0; i < team.livingCount; ++i )
 		{
-			num_t nextX = piece->X();
-			num_t nextY = piece->Y();
-			const int32_t maxSteps = piece->GetActions()[ actionNum ].maxSteps;
+			const Piece* piece = GetPiece( team.pieces[ i ] );
+			if ( piece->type != type ) {
+				continue;
+			}
 
-			for ( int32_t step = 1; step <= maxSteps; ++step )
+			targetCount = piece->ComputeAllMoveActions( targets );
+			for ( int32_t t = 0; t < targetCount; ++t )
 			{
-				piece->CalculateStep( actionNum, nextX, nextY );
+				const num_t x = targets[ t ].x;
+				const num_t y = targets[ t ].y;
 
-				if ( IsLegalMove( piece, nextX, nextY ) != moveType_t::NONE )
-				{
-					if( IsOpenToAttackAt( king, nextX, nextY ) ) {
-						continue;
-					}
-					return false;
+				// En passant takes a checking pawn off a square it doesn't land on
+				const bool enpassant = ( checker != nullptr ) && ( checker->m_handle == m_enpassantPawn ) && ( type == pieceType_t::PAWN ) &&
+									   ( x == checker->X() ) && ( x != piece->X() ) && ( GetHandle( x, y ) == NoPiece );
+
+				if ( ( ( evasions & ( 1ull << ( y * BoardSize + x ) ) ) == 0 ) && ( enpassant == false ) ) {
+					continue;
+				}
+
+				if ( IsKingSafeAfter( piece, x, y ) ) {
+					return true;
 				}
 			}
 		}
 	}
-	return true;
+	return false;
 }
 
 
@@ -563,6 +680,10 @@ void ChessState::CopyFrom( const ChessState& src )
 	// Copy en passant handle
 	m_enpassantPawn = src.m_enpassantPawn;
 
+	m_hash = src.m_hash;
+	m_snapshot = src.m_snapshot;
+	m_accumulator = src.m_accumulator;
+
 	// Keep the game pointer — caller is responsible for setting this
 	m_game = src.m_game;
 }
@@ -582,6 +703,11 @@ bool ChessState::Compare( const ChessState& other ) const
 		return false;
 	}
 
+	if ( memcmp( &m_snapshot, &other.m_snapshot, sizeof( m_snapshot ) ) != 0 )
+	{
+		return false;
+	}
+
 	// Compare teams
 	for ( int32_t t = 0; t < TeamCount; ++t )
 	{
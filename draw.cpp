@@ -0,0 +1,69 @@
+#include "chess.h"
+
+// Draw rules of the game record. The key history only grows with game moves, search keeps its
+// own path and reads this history past the root.
+
+static const int32_t FiftyMovePlies	= 100;
+static const int32_t RepetitionDraw	= 3;
+
+
+int32_t ChessEngine::GetRepetitionCount() const
+{
+	const uint64_t key = GetPositionKey();
+	const int32_t historySize = static_cast<int32_t>( m_keyHistory.size() );
+
+	// Only positions since the last irreversible move can recur, and only with the same side to move
+	int32_t count = 1;
+	for ( int32_t back = 2; ( back <= m_halfMoveClock ) && ( back <= historySize ); back += 2 )
+	{
+		if ( m_keyHistory[ historySize - back ] == key ) {
+			++count;
+		}
+	}
+	return count;
+}
+
+
+bool ChessEngine::IsInsufficientMaterial() const
+{
+	int32_t minors = 0;
+	int32_t knights = 0;
+	int32_t bishopColours = 0;		// Bit per square colour a bishop stands on
+
+	for ( int32_t t = 0; t < TeamCount; ++t )
+	{
+		const team_t& team = m_state.GetTeam( static_cast<teamCode_t>( t ) );
+		if ( ( team.typeCounts[ (int32_t)pieceType_t::PAWN ] > 0 ) || ( team.typeCounts[ (int32_t)pieceType_t::ROOK ] > 0 ) || ( team.typeCounts[ (int32_t)pieceType_t::QUEEN ] > 0 ) ) {
+			return false;
+		}
+
+		knights += team.typeCounts[ (int32_t)pieceType_t::KNIGHT ];
+		minors += team.typeCounts[ (int32_t)pieceType_t::KNIGHT ] + team.typeCounts[ (int32_t)pieceType_t::BISHOP ];
+
+		for ( int32_t i = 0; ( i < team.livingCount ) && ( team.typeCounts[ (int32_t)pieceType_t::BISHOP ] > 0 ); ++i )
+		{
+			const Piece* piece = m_state.GetPiece( team.pieces[ i ] );
+			if ( piece->type == pieceType_t::BISHOP ) {
+				bishopColours |= 1 << ( ( piece->X() + piece->Y() ) & 1 );
+			}
+		}
+	}
+
+	return ( minors <= 1 ) || ( ( knights == 0 ) && ( bishopColours != 3 ) );
+}
+
+
+void ChessEngine::RecordGameMove( const uint64_t keyBefore, const bool irreversible )
+{
+	m_keyHistory.push_back( keyBefore );
+	m_halfMoveClock = irreversible ? 0 : ( m_halfMoveClock + 1 );
+
+	// Mate and stalemate on the same move take precedence, CalculateGameState() clears the draw
+	if ( m_halfMoveClock >= FiftyMovePlies ) {
+		m_draw = RESULT_GAME_COMPLETE_FIFTY_MOVES;
+	} else if ( GetRepetitionCount() >= RepetitionDraw ) {
+		m_draw = RESULT_GAME_COMPLETE_REPETITION;
+	} else if ( IsInsufficientMaterial() ) {
+		m_draw = RESULT_GAME_COMPLETE_NO_MATERIAL;
+	}
+}
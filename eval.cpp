@@ -0,0 +1,486 @@
+#include "chess.h"
+
+#include <algorithm>
+
+// Material signatures are the typeCounts of both teams packed into nibbles.
+// A signature maps to a cached entry holding everything that only depends on
+// material: imbalance, game phase, draw scale factors and, for the endgames we
+// know better than the piece-square sum, a specialized evaluator.
+
+// Mobility is scored relative to a typical square count for each piece type
+static const int32_t MobilityBase[ (int32_t)pieceType_t::COUNT ]		= { 0, 7, 4, 7, 0, 14 };
+static const int32_t MobilityMiddlegame[ (int32_t)pieceType_t::COUNT ]	= { 0, 2, 4, 5, 0, 1 };
+static const int32_t MobilityEndgame[ (int32_t)pieceType_t::COUNT ]		= { 0, 4, 4, 5, 0, 2 };
+static const int32_t KingAttackWeight[ (int32_t)pieceType_t::COUNT ]	= { 1, 3, 2, 2, 0, 5 };
+static const int32_t MaxKingSafety = 500;
+
+typedef int32_t ( *endgameFn_t )( const ChessState& state, const teamCode_t strongTeam, const teamCode_t sideToMove );
+
+static inline int32_t MaterialShift( const int32_t teamIndex, const int32_t typeIndex )
+{
+	return ( teamIndex * (int32_t)pieceType_t::COUNT + typeIndex ) * MaterialKeyBits;
+}
+
+
+static inline int32_t MaterialCount( const materialKey_t key, const teamCode_t team, const pieceType_t type )
+{
+	const int32_t shift = MaterialShift( static_cast<int32_t>( team ), static_cast<int32_t>( type ) );
+	return static_cast<int32_t>( ( key >> shift ) & ( ( 1ull << MaterialKeyBits ) - 1 ) );
+}
+
+
+static inline int32_t Distance( const num_t x0, const num_t y0, const num_t x1, const num_t y1 )
+{
+	return std::max( abs( x0 - x1 ), abs( y0 - y1 ) );
+}
+
+
+// Bonus for driving a lone king towards the edge
+static inline int32_t PushToEdge( const num_t x, const num_t y )
+{
+	const int32_t centerX = std::max( 3 - x, x - 4 );
+	const int32_t centerY = std::max( 3 - y, y - 4 );
+	return 20 * ( centerX + centerY );
+}
+
+
+// Bonus for bringing the attacking king closer
+static inline int32_t PushClose( const int32_t distance )
+{
+	return 140 - 20 * distance;
+}
+
+
+static const Piece* FindTeamPiece( const ChessState& state, const teamCode_t teamCode, const pieceType_t type )
+{
+	const team_t& team = state.GetTeam( teamCode );
+	for ( int32_t i = 0; i < team.livingCount; ++i )
+	{
+		const Piece* piece = state.GetPiece( team.pieces[ i ] );
+		if ( ( piece != nullptr ) && ( piece->type == type ) ) {
+			return piece;
+		}
+	}
+	return nullptr;
+}
+
+
+static int32_t EvaluateInsufficientMaterial( const ChessState& /*state*/, const teamCode_t /*strongTeam*/, const teamCode_t /*sideToMove*/ )
+{
+	return 0;
+}
+
+
+static int32_t EvaluateKPK( const ChessState& state, const teamCode_t strongTeam, const teamCode_t sideToMove )
+{
+	const teamCode_t weakTeam = ChessEngine::GetOpposingTeam( strongTeam );
+
+	const Piece* strongKing = FindTeamPiece( state, strongTeam, pieceType_t::KING );
+	const Piece* weakKing = FindTeamPiece( state, weakTeam, pieceType_t::KING );
+	const Piece* pawn = FindTeamPiece( state, strongTeam, pieceType_t::PAWN );
+
+	// Normalize so the pawn always promotes on y == 0
+	const bool flip = ( strongTeam == teamCode_t::BLACK );
+	const num_t px = pawn->X();
+	const num_t py = flip ? ( BoardSize - 1 - pawn->Y() ) : pawn->Y();
+	const num_t sx = strongKing->X();
+	const num_t sy = flip ? ( BoardSize - 1 - strongKing->Y() ) : strongKing->Y();
+	const num_t wx = weakKing->X();
+	const num_t wy = flip ? ( BoardSize - 1 - weakKing->Y() ) : weakKing->Y();
+
+	const bool strongToMove = ( sideToMove == strongTeam );
+	const int32_t winScore = KnownWinValue + PieceValue[ (int32_t)pieceType_t::QUEEN ] - 10 * py;
+	const int32_t drawScore = PieceValue[ (int32_t)pieceType_t::PAWN ] / 4 + 2 * ( BoardSize - 1 - py );
+
+	// Undefended pawn about to be taken
+	const bool pawnAttacked = ( Distance( wx, wy, px, py ) == 1 ) && ( Distance( sx, sy, px, py ) > 1 );
+	if ( pawnAttacked && ( strongToMove == false ) ) {
+		return 0;
+	}
+
+	// Rule of the square
+	{
+		const int32_t promotionDistance = ( py == BoardSize - 2 ) ? ( py - 1 ) : py;
+		const int32_t kingDistance = Distance( wx, wy, px, 0 ) - ( strongToMove ? 0 : 1 );
+		const bool kingInPath = ( sx == px ) && ( sy < py );
+
+		if ( ( kingDistance > promotionDistance ) && ( kingInPath == false ) ) {
+			return winScore;
+		}
+	}
+
+	// Rook pawns are drawn once the defending king reaches the corner
+	if ( ( px == 0 ) || ( px == BoardSize - 1 ) )
+	{
+		if ( ( abs( wx - px ) <= 1 ) && ( wy < py ) ) {
+			return drawScore;
+		}
+		if ( ( abs( sx - px ) <= 1 ) && ( sy <= 1 ) && ( abs( wx - px ) > 2 ) ) {
+			return winScore;
+		}
+		return drawScore;
+	}
+
+	// Key squares: holding one wins regardless of the defence
+	{
+		const num_t keyRankNear = ( py >= 4 ) ? ( py - 2 ) : std::max( py - 1, 0 );
+		const num_t keyRankFar = std::max( py - 2, 0 );
+		const bool onKeyFile = ( abs( sx - px ) <= 1 );
+		const bool onKeyRank = ( sy == keyRankNear ) || ( sy == keyRankFar );
+
+		if ( onKeyFile && onKeyRank && ( pawnAttacked == false ) ) {
+			return winScore;
+		}
+	}
+
+	return drawScore;
+}
+
+
+static int32_t EvaluateKBNK( const ChessState& state, const teamCode_t strongTeam, const teamCode_t /*sideToMove*/ )
+{
+	const teamCode_t weakTeam = ChessEngine::GetOpposingTeam( strongTeam );
+
+	const Piece* strongKing = FindTeamPiece( state, strongTeam, pieceType_t::KING );
+	const Piece* weakKing = FindTeamPiece( state, weakTeam, pieceType_t::KING );
+	const Piece* bishop = FindTeamPiece( state, strongTeam, pieceType_t::BISHOP );
+
+	// Mate is only possible in a corner the bishop controls
+	const num_t wx = weakKing->X();
+	const num_t wy = weakKing->Y();
+	const bool lightCorners = ( ( ( bishop->X() + bishop->Y() ) & 1 ) != 0 );
+	const int32_t cornerDistance = lightCorners ?	std::min( Distance( wx, wy, BoardSize - 1, 0 ), Distance( wx, wy, 0, BoardSize - 1 ) ) :
+													std::min( Distance( wx, wy, 0, 0 ), Distance( wx, wy, BoardSize - 1, BoardSize - 1 ) );
+
+	const int32_t kingDistance = Distance( strongKing->X(), strongKing->Y(), wx, wy );
+
+	return KnownWinValue + PieceValue[ (int32_t)pieceType_t::BISHOP ] + PieceValue[ (int32_t)pieceType_t::KNIGHT ] +
+		PushClose( kingDistance ) + 40 * ( BoardSize - 1 - cornerDistance );
+}
+
+
+static int32_t EvaluateMajorPieceVsKing( const ChessState& state, const teamCode_t strongTeam, const pieceType_t majorType )
+{
+	const teamCode_t weakTeam = ChessEngine::GetOpposingTeam( strongTeam );
+
+	const Piece* strongKing = FindTeamPiece( state, strongTeam, pieceType_t::KING );
+	const Piece* weakKing = FindTeamPiece( state, weakTeam, pieceType_t::KING );
+
+	const int32_t kingDistance = Distance( strongKing->X(), strongKing->Y(), weakKing->X(), weakKing->Y() );
+
+	return KnownWinValue + PieceValue[ (int32_t)majorType ] + PushToEdge( weakKing->X(), weakKing->Y() ) + PushClose( kingDistance );
+}
+
+
+static int32_t EvaluateKRK( const ChessState& state, const teamCode_t strongTeam, const teamCode_t /*sideToMove*/ )
+{
+	return EvaluateMajorPieceVsKing( state, strongTeam, pieceType_t::ROOK );
+}
+
+
+static int32_t EvaluateKQK( const ChessState& state, const teamCode_t strongTeam, const teamCode_t /*sideToMove*/ )
+{
+	return EvaluateMajorPieceVsKing( state, strongTeam, pieceType_t::QUEEN );
+}
+
+
+static const endgameFn_t EndgameFunctions[ (int32_t)endgameType_t::COUNT ] =
+{
+	EvaluateInsufficientMaterial,	// INSUFFICIENT_MATERIAL
+	EvaluateKPK,					// KPK
+	EvaluateKBNK,					// KBNK
+	EvaluateKRK,					// KRK
+	EvaluateKQK,					// KQK
+};
+
+
+static void ComputeMaterialEntry( const materialKey_t key, materialEntry_t& entry )
+{
+	entry.key = key;
+	entry.imbalance = 0;
+	entry.endgame = endgameType_t::NONE;
+	entry.strongTeam = teamCode_t::NONE;
+
+	int32_t counts[ TeamCount ][ (int32_t)pieceType_t::COUNT ] = {};
+	int32_t nonPawnMaterial[ TeamCount ] = {};
+	int32_t pieceCount[ TeamCount ] = {};
+	int32_t phase = 0;
+
+	for ( int32_t t = 0; t < TeamCount; ++t )
+	{
+		for ( int32_t type = 0; type < (int32_t)pieceType_t::COUNT; ++type )
+		{
+			if ( type == (int32_t)pieceType_t::KING ) {
+				continue;
+			}
+			counts[ t ][ type ] = MaterialCount( key, teamCode_t( t ), pieceType_t( type ) );
+			pieceCount[ t ] += counts[ t ][ type ];
+
+			if ( type != (int32_t)pieceType_t::PAWN ) {
+				nonPawnMaterial[ t ] += counts[ t ][ type ] * PieceValue[ type ];
+			}
+		}
+
+		phase += counts[ t ][ (int32_t)pieceType_t::KNIGHT ] + counts[ t ][ (int32_t)pieceType_t::BISHOP ];
+		phase += 2 * counts[ t ][ (int32_t)pieceType_t::ROOK ];
+		phase += 4 * counts[ t ][ (int32_t)pieceType_t::QUEEN ];
+	}
+	entry.phase = static_cast<uint8_t>( std::min( phase, MaxGamePhase ) );
+
+	// Imbalance: bishop pair, and minor/rook values shifting with the pawn count
+	{
+		int32_t imbalance[ TeamCount ] = {};
+		for ( int32_t t = 0; t < TeamCount; ++t )
+		{
+			const int32_t pawnsAboveFive = counts[ t ][ (int32_t)pieceType_t::PAWN ] - 5;
+
+			imbalance[ t ] += ( counts[ t ][ (int32_t)pieceType_t::BISHOP ] >= 2 ) ? 30 : 0;
+			imbalance[ t ] += counts[ t ][ (int32_t)pieceType_t::KNIGHT ] * pawnsAboveFive * 6;
+			imbalance[ t ] -= counts[ t ][ (int32_t)pieceType_t::ROOK ] * pawnsAboveFive * 12;
+		}
+		entry.imbalance = static_cast<int16_t>( imbalance[ 0 ] - imbalance[ 1 ] );
+	}
+
+	// Scale factors: without pawns a small material edge rarely converts
+	for ( int32_t t = 0; t < TeamCount; ++t )
+	{
+		const int32_t o = ( t + 1 ) % TeamCount;
+
+		entry.scale[ t ] = ScaleFactorNormal;
+
+		const bool noPawns = ( counts[ t ][ (int32_t)pieceType_t::PAWN ] == 0 );
+		if ( noPawns && ( nonPawnMaterial[ t ] - nonPawnMaterial[ o ] <= PieceValue[ (int32_t)pieceType_t::BISHOP ] ) )
+		{
+			if ( nonPawnMaterial[ t ] < PieceValue[ (int32_t)pieceType_t::ROOK ] ) {
+				entry.scale[ t ] = ScaleFactorDraw;
+			} else {
+				entry.scale[ t ] = ( nonPawnMaterial[ o ] <= PieceValue[ (int32_t)pieceType_t::BISHOP ] ) ? 4 : 14;
+			}
+		}
+	}
+
+	// Specialized endgames
+	{
+		const int32_t pawns = counts[ 0 ][ (int32_t)pieceType_t::PAWN ] + counts[ 1 ][ (int32_t)pieceType_t::PAWN ];
+		const int32_t majors =	counts[ 0 ][ (int32_t)pieceType_t::ROOK ] + counts[ 1 ][ (int32_t)pieceType_t::ROOK ] +
+								counts[ 0 ][ (int32_t)pieceType_t::QUEEN ] + counts[ 1 ][ (int32_t)pieceType_t::QUEEN ];
+
+		if ( ( pawns == 0 ) && ( majors == 0 ) )
+		{
+			const int32_t minors = pieceCount[ 0 ] + pieceCount[ 1 ];
+			const bool twoKnights = ( pieceCount[ 0 ] == 0 && counts[ 1 ][ (int32_t)pieceType_t::KNIGHT ] == 2 && pieceCount[ 1 ] == 2 ) ||
+									( pieceCount[ 1 ] == 0 && counts[ 0 ][ (int32_t)pieceType_t::KNIGHT ] == 2 && pieceCount[ 0 ] == 2 );
+
+			if ( ( minors <= 1 ) || twoKnights )
+			{
+				entry.endgame = endgameType_t::INSUFFICIENT_MATERIAL;
+				entry.strongTeam = teamCode_t::WHITE;
+				return;
+			}
+		}
+
+		for ( int32_t t = 0; t < TeamCount; ++t )
+		{
+			const int32_t o = ( t + 1 ) % TeamCount;
+			if ( pieceCount[ o ] != 0 ) {
+				continue;
+			}
+
+			const int32_t* strong = counts[ t ];
+
+			if ( ( pieceCount[ t ] == 1 ) && ( strong[ (int32_t)pieceType_t::PAWN ] == 1 ) ) {
+				entry.endgame = endgameType_t::KPK;
+			} else if ( ( pieceCount[ t ] == 1 ) && ( strong[ (int32_t)pieceType_t::ROOK ] == 1 ) ) {
+				entry.endgame = endgameType_t::KRK;
+			} else if ( ( pieceCount[ t ] == 1 ) && ( strong[ (int32_t)pieceType_t::QUEEN ] == 1 ) ) {
+				entry.endgame = endgameType_t::KQK;
+			} else if ( ( pieceCount[ t ] == 2 ) && ( strong[ (int32_t)pieceType_t::BISHOP ] == 1 ) && ( strong[ (int32_t)pieceType_t::KNIGHT ] == 1 ) ) {
+				entry.endgame = endgameType_t::KBNK;
+			}
+
+			if ( entry.endgame != endgameType_t::NONE )
+			{
+				entry.strongTeam = teamCode_t( t );
+				return;
+			}
+		}
+	}
+}
+
+
+materialKey_t ChessState::GetMaterialKey() const
+{
+	materialKey_t key = 0;
+	for ( int32_t t = 0; t < TeamCount; ++t )
+	{
+		for ( int32_t type = 0; type < (int32_t)pieceType_t::COUNT; ++type )
+		{
+			assert( m_teams[ t ].typeCounts[ type ] < ( 1 << MaterialKeyBits ) );
+			key |= static_cast<materialKey_t>( m_teams[ t ].typeCounts[ type ] ) << MaterialShift( t, type );
+		}
+	}
+	// Kings are always present, leave them out so bare-king signatures are stable
+	key &= ~( ( ( 1ull << MaterialKeyBits ) - 1 ) << MaterialShift( 0, (int32_t)pieceType_t::KING ) );
+	key &= ~( ( ( 1ull << MaterialKeyBits ) - 1 ) << MaterialShift( 1, (int32_t)pieceType_t::KING ) );
+	return key;
+}
+
+
+void ChessEngine::ClearMaterialTable()
+{
+	for ( int32_t i = 0; i < MaterialTableSize; ++i ) {
+		m_materialTable[ i ].key = ~0ull; // Unreachable signature
+	}
+}
+
+
+const materialEntry_t& ChessEngine::ProbeMaterial() const
+{
+	const materialKey_t key = m_state.GetMaterialKey();
+	const uint64_t index = ( key ^ ( key >> 13 ) ^ ( key >> 29 ) ) & ( MaterialTableSize - 1 );
+
+	materialEntry_t& entry = m_materialTable[ index ];
+	if ( entry.key != key ) {
+		ComputeMaterialEntry( key, entry );
+	}
+	return entry;
+}
+
+
+void ChessEngine::ClearEvalCache()
+{
+	for ( int32_t i = 0; i < EvalCacheSize; ++i ) {
+		m_evalCache[ i ].key = 0;
+		m_evalCache[ i ].score = 0;
+	}
+}
+
+
+int32_t ChessEngine::Evaluate() const
+{
+	const uint64_t key = GetPositionKey();
+
+	evalCacheEntry_t& entry = m_evalCache[ key & ( EvalCacheSize - 1 ) ];
+	if ( entry.key == key ) {
+		return entry.score;
+	}
+
+	entry.key = key;
+	entry.score = EvaluateUncached();
+	return entry.score;
+}
+
+
+int32_t ChessEngine::EvaluateUncached() const
+{
+	const materialEntry_t& material = ProbeMaterial();
+
+	if ( material.endgame == endgameType_t::INSUFFICIENT_MATERIAL ) {
+		return 0;
+	}
+
+	if ( m_network != nullptr )
+	{
+		for ( int32_t p = 0; p < TeamCount; ++p )
+		{
+			if ( m_state.m_accumulator.dirty[ p ] ) {
+				m_state.NnueRefresh( static_cast<teamCode_t>( p ) );
+			}
+		}
+		return NnueEvaluate( m_network, m_state, m_currentTurn );
+	}
+
+	if ( material.endgame != endgameType_t::NONE )
+	{
+		const int32_t score = EndgameFunctions[ (int32_t)material.endgame ]( m_state, material.strongTeam, m_currentTurn );
+		return ( material.strongTeam == m_currentTurn ) ? score : -score;
+	}
+
+	const Piece* kings[ TeamCount ] =
+	{
+		FindTeamPiece( m_state, teamCode_t::WHITE, pieceType_t::KING ),
+		FindTeamPiece( m_state, teamCode_t::BLACK, pieceType_t::KING ),
+	};
+
+	int32_t middlegame[ TeamCount ] = {};
+	int32_t endgame[ TeamCount ] = {};
+	int32_t kingAttackers[ TeamCount ] = {};
+	int32_t kingAttackUnits[ TeamCount ] = {};
+
+	position_t reachable[ 4 * BoardSize ];
+
+	for ( int32_t t = 0; t < TeamCount; ++t )
+	{
+		const team_t& team = m_state.m_teams[ t ];
+		const Piece* enemyKing = kings[ ( t + 1 ) % TeamCount ];
+
+		for ( int32_t i = 0; i < team.livingCount; ++i )
+		{
+			const Piece* piece = m_state.GetPiece( team.pieces[ i ] );
+			const int32_t type = static_cast<int32_t>( piece->type );
+
+			// Tables are laid out from white's point of view, rank 8 first
+			const num_t row = ( t == (int32_t)teamCode_t::WHITE ) ? piece->Y() : ( BoardSize - 1 - piece->Y() );
+
+			middlegame[ t ] += PieceValue[ type ] + PST[ type ][ row ][ piece->X() ];
+			endgame[ t ] += PieceValue[ type ] + PSTEndgame[ type ][ row ][ piece->X() ];
+
+			if ( enemyKing == nullptr ) {
+				continue;
+			}
+
+			if ( piece->type == pieceType_t::PAWN )
+			{
+				// Pawn attacks aren't in the reachable set unless something stands there
+				const num_t attackY = piece->Y() + piece->GetTeamDirection();
+				const bool shieldHit =	( abs( attackY - enemyKing->Y() ) <= 1 ) &&
+										( ( abs( piece->X() - 1 - enemyKing->X() ) <= 1 ) || ( abs( piece->X() + 1 - enemyKing->X() ) <= 1 ) );
+				kingAttackUnits[ t ] += shieldHit ? KingAttackWeight[ type ] : 0;
+				continue;
+			}
+
+			if ( piece->type == pieceType_t::KING ) {
+				continue;
+			}
+
+			// One walk per piece feeds both mobility and king-zone attacks
+			const int32_t moveCount = piece->ComputeAllMoveActions( reachable );
+
+			int32_t zoneHits = 0;
+			for ( int32_t m = 0; m < moveCount; ++m )
+			{
+				const bool inZone = ( abs( reachable[ m ].x - enemyKing->X() ) <= 1 ) && ( abs( reachable[ m ].y - enemyKing->Y() ) <= 1 );
+				zoneHits += inZone ? 1 : 0;
+			}
+
+			middlegame[ t ] += MobilityMiddlegame[ type ] * ( moveCount - MobilityBase[ type ] );
+			endgame[ t ] += MobilityEndgame[ type ] * ( moveCount - MobilityBase[ type ] );
+
+			if ( zoneHits > 0 )
+			{
+				++kingAttackers[ t ];
+				kingAttackUnits[ t ] += KingAttackWeight[ type ] * zoneHits;
+			}
+		}
+	}
+
+	// A lone attacker is rarely dangerous, king safety is a middlegame term
+	for ( int32_t t = 0; t < TeamCount; ++t )
+	{
+		if ( kingAttackers[ t ] >= 2 ) {
+			middlegame[ t ] += std::min( kingAttackUnits[ t ] * kingAttackUnits[ t ] * 2, MaxKingSafety );
+		}
+	}
+
+	const int32_t phase = material.phase;
+	const int32_t middlegameScore = middlegame[ 0 ] - middlegame[ 1 ];
+	const int32_t endgameScore = endgame[ 0 ] - endgame[ 1 ];
+
+	int32_t score = ( middlegameScore * phase + endgameScore * ( MaxGamePhase - phase ) ) / MaxGamePhase;
+	score += material.imbalance;
+
+	const teamCode_t leadingTeam = ( score > 0 ) ? teamCode_t::WHITE : teamCode_t::BLACK;
+	score = ( score * material.scale[ (int32_t)leadingTeam ] ) / ScaleFactorNormal;
+
+	return ( m_currentTurn == teamCode_t::WHITE ) ? score : -score;
+}
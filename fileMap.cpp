@@ -0,0 +1,158 @@
+#include "chess.h"
+
+#if defined( _WIN32 )
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MapFile( const std::string& fileName, mappedFile_t& file )
+{
+	file = mappedFile_t();
+
+#if defined( _WIN32 )
+	HANDLE fileHandle = CreateFileA( fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+	if ( fileHandle == INVALID_HANDLE_VALUE ) {
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if ( ( GetFileSizeEx( fileHandle, &size ) == FALSE ) || ( size.QuadPart == 0 ) )
+	{
+		CloseHandle( fileHandle );
+		return false;
+	}
+
+	HANDLE mappingHandle = CreateFileMappingA( fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr );
+	if ( mappingHandle == nullptr )
+	{
+		CloseHandle( fileHandle );
+		return false;
+	}
+
+	const void* view = MapViewOfFile( mappingHandle, FILE_MAP_READ, 0, 0, 0 );
+	if ( view == nullptr )
+	{
+		CloseHandle( mappingHandle );
+		CloseHandle( fileHandle );
+		return false;
+	}
+
+	file.data = static_cast<const uint8_t*>( view );
+	file.size = static_cast<size_t>( size.QuadPart );
+	file.fileHandle = fileHandle;
+	file.mappingHandle = mappingHandle;
+#else
+	const int descriptor = open( fileName.c_str(), O_RDONLY );
+	if ( descriptor < 0 ) {
+		return false;
+	}
+
+	struct stat info;
+	if ( ( fstat( descriptor, &info ) != 0 ) || ( info.st_size == 0 ) )
+	{
+		close( descriptor );
+		return false;
+	}
+
+	void* view = mmap( nullptr, static_cast<size_t>( info.st_size ), PROT_READ, MAP_SHARED, descriptor, 0 );
+	close( descriptor );
+
+	if ( view == MAP_FAILED ) {
+		return false;
+	}
+
+	file.data = static_cast<const uint8_t*>( view );
+	file.size = static_cast<size_t>( info.st_size );
+#endif
+	return true;
+}
+
+
+bool MapFileWritable( const std::string& fileName, const size_t size, mappedFile_t& file )
+{
+	file = mappedFile_t();
+	if ( size == 0 ) {
+		return false;
+	}
+
+#if defined( _WIN32 )
+	HANDLE fileHandle = CreateFileA( fileName.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr );
+	if ( fileHandle == INVALID_HANDLE_VALUE ) {
+		return false;
+	}
+
+	const uint64_t fileSize = static_cast<uint64_t>( size );
+	HANDLE mappingHandle = CreateFileMappingA( fileHandle, nullptr, PAGE_READWRITE, static_cast<DWORD>( fileSize >> 32 ), static_cast<DWORD>( fileSize ), nullptr );
+	if ( mappingHandle == nullptr )
+	{
+		CloseHandle( fileHandle );
+		return false;
+	}
+
+	void* view = MapViewOfFile( mappingHandle, FILE_MAP_WRITE, 0, 0, 0 );
+	if ( view == nullptr )
+	{
+		CloseHandle( mappingHandle );
+		CloseHandle( fileHandle );
+		return false;
+	}
+
+	file.data = static_cast<const uint8_t*>( view );
+	file.size = size;
+	file.fileHandle = fileHandle;
+	file.mappingHandle = mappingHandle;
+#else
+	const int descriptor = open( fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+	if ( descriptor < 0 ) {
+		return false;
+	}
+
+	if ( ftruncate( descriptor, static_cast<off_t>( size ) ) != 0 )
+	{
+		close( descriptor );
+		return false;
+	}
+
+	void* view = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0 );
+	close( descriptor );
+
+	if ( view == MAP_FAILED ) {
+		return false;
+	}
+
+	file.data = static_cast<const uint8_t*>( view );
+	file.size = size;
+#endif
+	file.writable = true;
+	return true;
+}
+
+
+void UnmapFile( mappedFile_t& file )
+{
+	if ( file.data == nullptr ) {
+		return;
+	}
+
+#if defined( _WIN32 )
+	if ( file.writable ) {
+		FlushViewOfFile( file.data, 0 );
+	}
+	UnmapViewOfFile( file.data );
+	CloseHandle( static_cast<HANDLE>( file.mappingHandle ) );
+	CloseHandle( static_cast<HANDLE>( file.fileHandle ) );
+#else
+	if ( file.writable ) {
+		msync( const_cast<uint8_t*>( file.data ), file.size, MS_SYNC );
+	}
+	munmap( const_cast<uint8_t*>( file.data ), file.size );
+#endif
+
+	file = mappedFile_t();
+}
@@ -0,0 +1,193 @@
+#include "chess.h"
+
+#include <algorithm>
+
+// Persistent transposition entries. The file is a direct-mapped table of deep entries keyed
+// like the search's own table, so merging is a slot-by-slot choice between the old and the new
+// entry. Entries from earlier saves age by one each time, which lets stale openings make room.
+
+static const uint32_t HashFileMagic		= 0x31544843;	// "CHT1"
+static const uint32_t HashFileVersion	= 2;
+static const uint8_t HashFileMaxAge		= 8;			// Saves an entry survives without being searched again
+
+struct hashFileHeader_t
+{
+	uint32_t		magic;
+	uint32_t		version;
+	uint64_t		entryCount;
+	uint64_t		checksum;			// FNV-1a over the entries
+	uint32_t		entrySize;
+	uint32_t		reserved;
+};
+
+struct hashFileEntry_t
+{
+	uint64_t		key;
+	int16_t			score;				// Relative to the node, as in the hash table
+	packedMove_t	move;				// By squares, piece handles belong to one game. 0 for none
+	int8_t			depth;
+	ttBound_t		bound;				// NONE marks an empty slot
+	uint8_t			age;
+	uint8_t			reserved;
+};
+
+static_assert( sizeof( hashFileHeader_t ) == 32, "Hash file header layout is part of the format" );
+static_assert( sizeof( hashFileEntry_t ) == 16, "Hash file entry layout is part of the format" );
+
+
+static uint64_t Checksum( const uint8_t* data, const size_t size )
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+	for ( size_t i = 0; i < size; ++i )
+	{
+		hash ^= data[ i ];
+		hash *= 0x100000001B3ull;
+	}
+	return hash;
+}
+
+
+// Entries of a valid file, empty for a missing, foreign or damaged one
+static void ReadHashFile( const std::string& fileName, std::vector< hashFileEntry_t >& entries )
+{
+	entries.clear();
+
+	mappedFile_t file;
+	if ( MapFile( fileName, file ) == false ) {
+		return;
+	}
+
+	const hashFileHeader_t* header = reinterpret_cast<const hashFileHeader_t*>( file.data );
+	const uint8_t* body = file.data + sizeof( hashFileHeader_t );
+
+	const bool valid =	( file.size >= sizeof( hashFileHeader_t ) ) &&
+						( header->magic == HashFileMagic ) && ( header->version == HashFileVersion ) &&
+						( header->entrySize == sizeof( hashFileEntry_t ) ) &&
+						( file.size == sizeof( hashFileHeader_t ) + header->entryCount * sizeof( hashFileEntry_t ) ) &&
+						( header->checksum == Checksum( body, file.size - sizeof( hashFileHeader_t ) ) );
+	if ( valid )
+	{
+		const hashFileEntry_t* first = reinterpret_cast<const hashFileEntry_t*>( body );
+		entries.assign( first, first + header->entryCount );
+	}
+	UnmapFile( file );
+}
+
+
+bool ChessEngine::OpenHashFile( const std::string& fileName, const size_t maxMegabytes )
+{
+	m_hashFileName = fileName;
+	m_hashFileMB = std::max< size_t >( maxMegabytes, 1 );
+
+	if ( m_hashTable.empty() ) {
+		SetHashSize( DefaultHashMB );
+	}
+	return LoadHashFile();
+}
+
+
+bool ChessEngine::LoadHashFile()
+{
+	if ( m_hashFileName.empty() || m_hashTable.empty() ) {
+		return false;
+	}
+
+	std::vector< hashFileEntry_t > entries;
+	ReadHashFile( m_hashFileName, entries );
+
+	for ( const hashFileEntry_t& stored : entries )
+	{
+		if ( stored.bound == ttBound_t::NONE ) {
+			continue;
+		}
+
+		ttEntry_t& entry = m_hashTable[ stored.key & ( m_hashTable.size() - 1 ) ];
+		if ( ( entry.bound != ttBound_t::NONE ) && ( entry.depth > stored.depth ) ) {
+			continue;
+		}
+
+		entry.key = stored.key;
+		entry.move = NoMove;			// Resolved by ProbeHash()
+		entry.packedMove = stored.move;
+		entry.score = stored.score;
+		entry.depth = stored.depth;
+		entry.bound = stored.bound;
+		entry.age = stored.age + 1;
+	}
+	return !entries.empty();
+}
+
+
+bool ChessEngine::SaveHashFile()
+{
+	if ( m_hashFileName.empty() ) {
+		return false;
+	}
+
+	// Power of two slot count under the size cap
+	size_t entryCount = 1;
+	while ( ( sizeof( hashFileHeader_t ) + entryCount * 2 * sizeof( hashFileEntry_t ) ) <= ( m_hashFileMB << 20 ) ) {
+		entryCount *= 2;
+	}
+
+	std::vector< hashFileEntry_t > merged( entryCount, hashFileEntry_t{} );
+
+	// Deeper first, one age step costs as much as one ply
+	auto Priority = []( const hashFileEntry_t& entry ) { return static_cast<int32_t>( entry.depth ) - entry.age; };
+	auto Merge = [ & ]( const hashFileEntry_t& entry )
+	{
+		hashFileEntry_t& slot = merged[ entry.key & ( entryCount - 1 ) ];
+		if ( ( slot.bound == ttBound_t::NONE ) || ( Priority( entry ) >= Priority( slot ) ) ) {
+			slot = entry;
+		}
+	};
+
+	std::vector< hashFileEntry_t > previous;
+	ReadHashFile( m_hashFileName, previous );
+	for ( hashFileEntry_t entry : previous )
+	{
+		if ( ( entry.bound == ttBound_t::NONE ) || ( entry.age >= HashFileMaxAge ) ) {
+			continue;
+		}
+		++entry.age;
+		Merge( entry );
+	}
+
+	// This run's entries go last so they win ties with their own older copies. Loaded ones no search
+	// stored again are left to the previous file, which ages them
+	for ( const ttEntry_t& entry : m_hashTable )
+	{
+		if ( ( entry.bound == ttBound_t::NONE ) || ( entry.depth < HashFileMinDepth ) || ( entry.age > 0 ) ) {
+			continue;
+		}
+
+		hashFileEntry_t stored = {};
+		stored.key = entry.key;
+		stored.score = entry.score;
+		stored.move = entry.packedMove;
+		stored.depth = entry.depth;
+		stored.bound = entry.bound;
+		stored.age = 0;
+		Merge( stored );
+	}
+
+	const size_t bodySize = entryCount * sizeof( hashFileEntry_t );
+	mappedFile_t file;
+	if ( MapFileWritable( m_hashFileName, sizeof( hashFileHeader_t ) + bodySize, file ) == false ) {
+		return false;
+	}
+
+	uint8_t* data = const_cast<uint8_t*>( file.data );
+	memcpy( data + sizeof( hashFileHeader_t ), merged.data(), bodySize );
+
+	hashFileHeader_t header = {};
+	header.magic = HashFileMagic;
+	header.version = HashFileVersion;
+	header.entryCount = entryCount;
+	header.checksum = Checksum( reinterpret_cast<const uint8_t*>( merged.data() ), bodySize );
+	header.entrySize = sizeof( hashFileEntry_t );
+	memcpy( data, &header, sizeof( header ) );
+
+	UnmapFile( file );
+	return true;
+}
@@ -1,6 +1,8 @@
 ﻿#include <iostream>
 #include <string>
 #include <algorithm>
+#include <memory>
+#include <mutex>
 #include "chess.h"
 
 #include <windows.h>
@@ -24,7 +26,7 @@ void ClearScreen()
 }
 
 
-void PrintBoard( const Chess& board, std::vector< moveAction_t >* actions, const bool printCaptures )
+void PrintBoard( const Chess& board, const uint64_t highlights, const bool printCaptures )
 {
 	std::cout << "   ";
 	for ( int32_t i = 0; i < BoardSize; ++i ) {
@@ -53,17 +55,13 @@ void PrintBoard( const Chess& board, std::vector< moveAction_t >* actions, const
 			SetTextColor( colorCode );
 
 			std::string square = SquareToString( board, i, j );
-			if ( actions != nullptr ) {
-				for ( size_t action = 0; action < actions->size(); ++action ) {
-					if ( ( (*actions)[ action ].x == i ) && ( ( *actions )[ action ].y == j ) ) {
-						if ( isBlack ) {
-							SetTextColor( 242 );
-						} else {
-							SetTextColor( 2 );
-						}
-						square = "****";
-					}
+			if ( ( highlights & ( 1ull << ( j * BoardSize + i ) ) ) != 0 ) {
+				if ( isBlack ) {
+					SetTextColor( 242 );
+				} else {
+					SetTextColor( 2 );
 				}
+				square = "****";
 			}
 			std::cout << square;
 			SetTextColor( 15 );
@@ -101,36 +99,119 @@ void RunTestCommands( Chess& board, std::vector< std::string >& commands )
 		std::cout << turnNum  << ": " << *it << "-> Completed" << std::endl;
 		turnTeam = ( turnTeam == teamCode_t::WHITE ) ? teamCode_t::BLACK : teamCode_t::WHITE;
 		++turnNum;
-		PrintBoard( board, nullptr, true );
+		PrintBoard( board, 0, true );
 	}
 //	ClearScreen();
 //	PrintBoard( board, true );
 }
 
 
-void ProcessEvent( callbackEvent_t& event )
+pieceType_t PromptPromotion()
 {
 	std::cout << "Enter Pawn Promotion\n";
 	std::cout << "(Q)ueen, K(N)ight, (B)ishop, (R)ook: ";
 
 	std::string choice;
 	std::cin >> choice;
-	event.promotionType = GetPieceType( choice[ 0 ] );
+	return GetPieceType( choice[ 0 ] );
+}
+
+
+static const int64_t EngineMoveTimeMs = 3000;
+
+// Latest iteration of the analysis that runs while the player thinks
+struct hint_t
+{
+	std::mutex		lock;
+	std::string		command;	// Prompt notation, e.g. "n1f3"
+	std::string		move;		// Coordinate notation, e.g. "g1f3"
+	int32_t			score;
+	int32_t			depth;
+};
+
+
+std::string MoveToCommand( const Chess& engine, const move_t& move )
+{
+	if ( move == NoMove ) {
+		return "";
+	}
+	const std::string text = engine.GetMoveString( move );
+	const pieceInfo_t info = engine.GetInfo( GetFileNum( text[ 0 ] ), GetRankNum( text[ 1 ] ) );
+
+	std::string command;
+	command += GetPieceCode( info.pieceType );
+	command += char( '0' + info.instance );
+	command += text.substr( 2, 2 );
+	if ( move.promotion != pieceType_t::NONE ) {
+		command += GetPieceCode( move.promotion );
+	}
+	return command;
+}
+
+
+// Coordinate notation of a prompt command, taken before it is executed
+std::string CommandToMove( const Chess& board, const command_t& cmd )
+{
+	for ( int32_t y = 0; y < BoardSize; ++y ) {
+		for ( int32_t x = 0; x < BoardSize; ++x ) {
+			const pieceInfo_t info = board.GetInfo( x, y );
+			if ( ( info.team == cmd.team ) && ( info.pieceType == cmd.pieceType ) && ( info.instance == cmd.instance ) ) {
+				std::string text;
+				text += GetFile( x );
+				text += GetRank( y );
+				text += GetFile( cmd.x );
+				text += GetRank( cmd.y );
+				return text;
+			}
+		}
+	}
+	return "";
+}
+
+
+// The engine searches the player's position until the player moves. Its main line is the hint,
+// and every reply the player can choose already has its subtree in the engine's hash table.
+void StartPondering( Chess& engine, hint_t& hint )
+{
+	{
+		std::lock_guard< std::mutex > guard( hint.lock );
+		hint.command.clear();
+		hint.move.clear();
+	}
+
+	searchLimits_t limits;
+	limits.ponder = true;
+	limits.useBook = false;
+	engine.StartSearch( limits,
+		[ &engine, &hint ]( const searchInfo_t& info ) {
+			if ( info.pv.empty() ) {
+				return;
+			}
+			std::lock_guard< std::mutex > guard( hint.lock );
+			hint.command = MoveToCommand( engine, info.pv[ 0 ] );
+			hint.move = engine.GetMoveString( info.pv[ 0 ] );
+			hint.score = info.score;
+			hint.depth = info.depth;
+		},
+		[]( const searchResult_t& ) {} );
 }
 
 
 void RunCmdLineGameLoop( gameConfig_t& cfg )
 {
+	teamCode_t engineTeam = teamCode_t::NONE;
+	hint_t hint;
+
 reset_game:
 	int32_t turnNum = 0;
 	teamCode_t turnTeam = teamCode_t::WHITE;
 	teamCode_t winner = teamCode_t::NONE;
 
 	Chess board( cfg );
-	board.SetPromotionCallback( teamCode_t::WHITE, &ProcessEvent );
-	board.SetPromotionCallback( teamCode_t::BLACK, &ProcessEvent );
+	std::unique_ptr< Chess > engine( new Chess( board ) );	// Mirrors the game, searches on its own thread
 
-	std::vector< moveAction_t > actions;
+	uint64_t highlights = 0;	// Legal targets of the selected piece
+	std::string engineMove;
 
 	while ( true ) {
 		teamCode_t nextTeam;
@@ -139,13 +220,48 @@ clear_screen:
 		{
 			ClearScreen();
 			//std::wcout << L"♔";
-			PrintBoard( board, &actions, true );
+			PrintBoard( board, highlights, true );
+			if ( engineMove.empty() == false ) {
+				std::cout << "Engine played " << engineMove << std::endl;
+			}
 		}
 
 		if ( winner != teamCode_t::NONE ) {
 			goto exit_program;
 		}
 
+		if ( ( engineTeam != teamCode_t::NONE ) && ( turnTeam == engineTeam ) ) {
+			engine->Stop();
+			std::cout << "Thinking..." << std::endl;
+
+			searchLimits_t limits;
+			limits.timeMs = EngineMoveTimeMs;
+			const searchResult_t searchResult = engine->Search( limits );
+			const std::string text = engine->GetMoveString( searchResult.bestMove );
+			engineMove = MoveToCommand( *engine, searchResult.bestMove );
+			engine->ExecuteTrusted( searchResult.bestMove );
+
+			const resultCode_t result = board.ExecuteMove( board.ParseMoveString( text ) );
+			if ( ( result & RESULT_GAME_COMPLETE ) != 0 ) {
+				winner = board.GetWinner();
+				if ( winner == teamCode_t::NONE ) {
+					std::cout << GetErrorMsg( result ) << std::endl;
+					goto exit_program;
+				}
+			} else if ( result != RESULT_SUCCESS ) {
+				std::cout << "Engine has no move" << std::endl;
+				engineTeam = teamCode_t::NONE;
+				goto read_input;
+			}
+			highlights = 0;
+			turnTeam = ( turnTeam == teamCode_t::WHITE ) ? teamCode_t::BLACK : teamCode_t::WHITE;
+			continue;
+		}
+
+		if ( ( engineTeam != teamCode_t::NONE ) && ( engine->IsSearching() == false ) ) {
+			StartPondering( *engine, hint );
+		}
+
 read_input:
 		// Input
 		std::string commandString;
@@ -173,8 +289,32 @@ read_input:
 			if ( commandString == "reset" ) {
 				goto reset_game;
 			}
+			if ( commandString == "hint" ) {
+				std::lock_guard< std::mutex > guard( hint.lock );
+				if ( ( engineTeam == teamCode_t::NONE ) || hint.command.empty() ) {
+					std::cout << "No hint yet" << std::endl;
+				} else {
+					std::cout << "Hint: " << hint.command << " (" << hint.move << "), depth " << hint.depth << ", score " << hint.score << std::endl;
+				}
+				goto read_input;
+			}
+			if ( commandString.substr( 0, 6 ) == "engine" ) {
+				const std::string side = ( commandString.size() > 7 ) ? commandString.substr( 7 ) : "";
+				engine->Stop();
+				if ( ( side == "white" ) || ( side == "red" ) ) {
+					engineTeam = teamCode_t::WHITE;
+				} else if ( ( side == "black" ) || ( side == "purple" ) ) {
+					engineTeam = teamCode_t::BLACK;
+				} else if ( side == "off" ) {
+					engineTeam = teamCode_t::NONE;
+				} else {
+					std::cout << GetErrorMsg( RESULT_INPUT_INVALID_COMMAND ) << std::endl;
+					goto read_input;
+				}
+				goto clear_screen;
+			}
 			if ( commandString.substr( 0, 6 ) == "select" ) {
-				actions.clear();
+				highlights = 0;
 				if ( commandString.size() < 6 ) {
 					std::cout << GetErrorMsg( RESULT_INPUT_INVALID_COMMAND ) << std::endl;
 					goto read_input;
@@ -188,7 +328,7 @@ read_input:
 				const int32_t instance = args[ 1 ] - '0';
 				const teamCode_t team = ( ( args.size() == 3 ) && ( args[ 2 ] == '\'' ) ) ? teamCode_t::BLACK : teamCode_t::WHITE;
 				const pieceHandle_t hdl = board.FindPiece( team, pieceType, instance );
-				board.EnumerateActions( hdl, actions );
+				highlights = board.GetLegalTargets( hdl );
 				goto clear_screen;
 			}
 			command_t cmd{};
@@ -198,14 +338,42 @@ read_input:
 				goto read_input;
 			}
 
+			// Ask for the promotion before the move when the command didn't name one
+			const num_t lastRank = ( cmd.team == teamCode_t::WHITE ) ? 0 : ( BoardSize - 1 );
+			if ( ( cmd.pieceType == pieceType_t::PAWN ) && ( cmd.y == lastRank ) && ( cmd.promotion == pieceType_t::NONE ) ) {
+				if ( board.GetLegalTargets( board.FindPiece( cmd.team, cmd.pieceType, cmd.instance ) ) & ( 1ull << ( cmd.y * BoardSize + cmd.x ) ) ) {
+					cmd.promotion = PromptPromotion();
+				}
+			}
+
+			std::string text = CommandToMove( board, cmd );
 			result = board.Execute( cmd );
 
-			if ( result == RESULT_GAME_COMPLETE ) {
+			if ( ( result & RESULT_GAME_COMPLETE ) != 0 ) {
 				winner = board.GetWinner();
+				if ( winner == teamCode_t::NONE ) {
+					std::cout << GetErrorMsg( result ) << std::endl;
+					goto exit_program;
+				}
 			} else if ( result != RESULT_SUCCESS ) {
 				std::cout << GetErrorMsg( RESULT_INPUT_INVALID_MOVE ) << std::endl;
 				goto read_input;
 			}
+
+			// Unset or invalid choices promote to a queen
+			const pieceInfo_t moved = board.GetInfo( cmd.x, cmd.y );
+			if ( ( cmd.pieceType == pieceType_t::PAWN ) && ( moved.pieceType != pieceType_t::PAWN ) ) {
+				text += GetPieceCode( moved.pieceType );
+			}
+
+			engine->Stop();
+			const move_t mirrored = engine->ParseMoveString( text );
+			if ( mirrored != NoMove ) {
+				engine->ExecuteTrusted( mirrored );
+			} else {
+				engine.reset( new Chess( board ) );
+			}
+			engineMove.clear();
 		}
 		turnTeam = nextTeam;
 	}
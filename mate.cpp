@@ -0,0 +1,311 @@
+#include "chess.h"
+
+#include <algorithm>
+#include <memory>
+
+#include "timer.h"
+
+// Depth-first proof-number search (df-pn) for forced mates.
+//
+// The attacker only plays checks, the defender plays every legal move. A node is proven when
+// the defender is mated, disproven when the attacker runs out of checks or plies. Proof and
+// disproof numbers count the leaves still to settle; the search always expands the most
+// proving child and only backs up once a node's numbers cross the thresholds its parent handed
+// down. Entries are keyed by position and remaining plies, so the depth bound keeps the graph
+// acyclic and the shortest mate falls out of proving the bound one move at a time.
+
+static const uint32_t ProofInfinity		= 100000000;
+
+struct mateEntry_t
+{
+	uint64_t		key;
+	uint32_t		proof;
+	uint32_t		disproof;
+};
+
+struct mateContext_t
+{
+	std::vector< mateEntry_t >	table;
+	uint64_t		nodes = 0;
+	uint64_t		maxNodes = 0;
+	bool			stopped = false;
+};
+
+
+static inline uint64_t MateKey( const uint64_t positionKey, const int32_t plies )
+{
+	return positionKey ^ ( static_cast<uint64_t>( plies + 1 ) * 0x9E3779B97F4A7C15ull );
+}
+
+
+static inline uint32_t SaturatingAdd( const uint32_t lhs, const uint32_t rhs )
+{
+	return std::min( lhs + rhs, ProofInfinity );
+}
+
+
+static void Lookup( const mateContext_t& context, const uint64_t key, uint32_t& proof, uint32_t& disproof )
+{
+	const mateEntry_t& entry = context.table[ key & ( context.table.size() - 1 ) ];
+	if ( entry.key == key )
+	{
+		proof = entry.proof;
+		disproof = entry.disproof;
+		return;
+	}
+	proof = 1;
+	disproof = 1;
+}
+
+
+static void Store( mateContext_t& context, const uint64_t key, const uint32_t proof, const uint32_t disproof )
+{
+	mateEntry_t& entry = context.table[ key & ( context.table.size() - 1 ) ];
+	entry.key = key;
+	entry.proof = proof;
+	entry.disproof = disproof;
+}
+
+
+void ChessEngine::MateNode( mateContext_t& context, const int32_t plies, const bool attacker, const uint32_t proofLimit, const uint32_t disproofLimit )
+{
+	++context.nodes;
+	if ( ( context.maxNodes > 0 ) && ( context.nodes >= context.maxNodes ) ) {
+		context.stopped = true;
+	}
+
+	const uint64_t key = MateKey( GetPositionKey(), plies );
+
+	move_t moves[ MaxMoves ];
+	uint64_t childKeys[ MaxMoves ];
+	const int32_t moveCount = GenerateMoves( moves );
+
+	// Attacker: checks only, keyed for the defender's reply
+	int32_t childCount = 0;
+	for ( int32_t i = 0; i < moveCount; ++i )
+	{
+		if ( attacker && ( plies <= 0 ) ) {
+			break;
+		}
+
+		moveUndo_t undo;
+		MakeMove( moves[ i ], undo );
+		const bool keep = !attacker || m_state.IsChecked( m_currentTurn );
+		if ( keep )
+		{
+			moves[ childCount ] = moves[ i ];
+			childKeys[ childCount++ ] = MateKey( GetPositionKey(), plies - 1 );
+		}
+		UnmakeMove( moves[ i ], undo );
+	}
+
+	if ( childCount == 0 )
+	{
+		const bool mated = !attacker && ( moveCount == 0 ) && m_state.IsChecked( m_currentTurn );
+		Store( context, key, mated ? 0 : ProofInfinity, mated ? ProofInfinity : 0 );
+		return;
+	}
+
+	// The defender survived the last ply
+	if ( !attacker && ( plies <= 0 ) )
+	{
+		Store( context, key, ProofInfinity, 0 );
+		return;
+	}
+
+	for ( ;; )
+	{
+		// OR node at the attacker, AND node at the defender
+		uint32_t proof = attacker ? ProofInfinity : 0;
+		uint32_t disproof = attacker ? 0 : ProofInfinity;
+		uint32_t bestNumber = ProofInfinity;
+		uint32_t secondNumber = ProofInfinity;
+		uint32_t bestProof = 0;
+		uint32_t bestDisproof = 0;
+		int32_t best = 0;
+
+		for ( int32_t i = 0; i < childCount; ++i )
+		{
+			uint32_t childProof;
+			uint32_t childDisproof;
+			Lookup( context, childKeys[ i ], childProof, childDisproof );
+
+			if ( attacker )
+			{
+				proof = std::min( proof, childProof );
+				disproof = SaturatingAdd( disproof, childDisproof );
+			}
+			else
+			{
+				proof = SaturatingAdd( proof, childProof );
+				disproof = std::min( disproof, childDisproof );
+			}
+
+			const uint32_t number = attacker ? childProof : childDisproof;
+			if ( number < bestNumber )
+			{
+				secondNumber = bestNumber;
+				bestNumber = number;
+				bestProof = childProof;
+				bestDisproof = childDisproof;
+				best = i;
+			}
+			else if ( number < secondNumber )
+			{
+				secondNumber = number;
+			}
+		}
+
+		if ( ( proof >= proofLimit ) || ( disproof >= disproofLimit ) || context.stopped )
+		{
+			Store( context, key, proof, disproof );
+			return;
+		}
+
+		uint32_t childProofLimit;
+		uint32_t childDisproofLimit;
+		if ( attacker )
+		{
+			childProofLimit = std::min( proofLimit, SaturatingAdd( secondNumber, 1 ) );
+			childDisproofLimit = SaturatingAdd( disproofLimit - disproof, bestDisproof );
+		}
+		else
+		{
+			childProofLimit = SaturatingAdd( proofLimit - proof, bestProof );
+			childDisproofLimit = std::min( disproofLimit, SaturatingAdd( secondNumber, 1 ) );
+		}
+
+		moveUndo_t undo;
+		MakeMove( moves[ best ], undo );
+		MateNode( context, plies - 1, !attacker, childProofLimit, childDisproofLimit );
+		UnmakeMove( moves[ best ], undo );
+	}
+}
+
+
+bool ChessEngine::IsMateProven( mateContext_t& context, const int32_t plies, const bool attacker )
+{
+	MateNode( context, plies, attacker, ProofInfinity, ProofInfinity );
+
+	uint32_t proof;
+	uint32_t disproof;
+	Lookup( context, MateKey( GetPositionKey(), plies ), proof, disproof );
+	return ( proof == 0 );
+}
+
+
+// Attacker to move with a shortest mate of this many plies; the defender takes the longest resistance
+void ChessEngine::ExtractMateLine( mateContext_t& context, int32_t plies, std::vector< move_t >& line )
+{
+	std::vector< moveUndo_t > undos;
+
+	while ( ( plies > 0 ) && !context.stopped )
+	{
+		move_t moves[ MaxMoves ];
+		int32_t moveCount = GenerateMoves( moves );
+
+		move_t attack = NoMove;
+		for ( int32_t i = 0; ( i < moveCount ) && ( attack == NoMove ); ++i )
+		{
+			moveUndo_t undo;
+			MakeMove( moves[ i ], undo );
+			if ( m_state.IsChecked( m_currentTurn ) && IsMateProven( context, plies - 1, false ) ) {
+				attack = moves[ i ];
+			}
+			UnmakeMove( moves[ i ], undo );
+		}
+
+		if ( attack == NoMove ) {
+			break;
+		}
+
+		undos.emplace_back();
+		MakeMove( attack, undos.back() );
+		line.push_back( attack );
+
+		moveCount = GenerateMoves( moves );
+		if ( moveCount == 0 ) {
+			break;
+		}
+
+		move_t defense = NoMove;
+		int32_t defensePlies = -1;
+		for ( int32_t i = 0; i < moveCount; ++i )
+		{
+			moveUndo_t undo;
+			MakeMove( moves[ i ], undo );
+			for ( int32_t remaining = 1; remaining <= plies - 2; remaining += 2 )
+			{
+				if ( IsMateProven( context, remaining, true ) )
+				{
+					if ( remaining > defensePlies )
+					{
+						defensePlies = remaining;
+						defense = moves[ i ];
+					}
+					break;
+				}
+			}
+			UnmakeMove( moves[ i ], undo );
+		}
+
+		if ( defense == NoMove ) {
+			break;
+		}
+
+		undos.emplace_back();
+		MakeMove( defense, undos.back() );
+		line.push_back( defense );
+		plies = defensePlies;
+	}
+
+	for ( size_t i = line.size(); i > 0; --i ) {
+		UnmakeMove( line[ i - 1 ], undos[ i - 1 ] );
+	}
+}
+
+
+mateResult_t ChessEngine::SolveMate( const int32_t maxMoves, const uint64_t maxNodes )
+{
+	mateResult_t result;
+	Timer timer;
+	timer.Start();
+
+	std::unique_ptr< mateContext_t > context( new mateContext_t() );
+	context->table.resize( ( static_cast<size_t>( MateHashMB ) << 20 ) / sizeof( mateEntry_t ) );
+	size_t entryCount = 1;
+	while ( ( entryCount << 1 ) <= context->table.size() ) {
+		entryCount <<= 1;
+	}
+	context->table.resize( entryCount );
+	context->maxNodes = maxNodes;
+
+	// One search at the full bound settles most puzzles without a mate, then the bound grows to the shortest
+	if ( ( maxMoves > 0 ) && IsMateProven( *context, 2 * maxMoves - 1, true ) )
+	{
+		for ( int32_t moves = 1; moves <= maxMoves; ++moves )
+		{
+			if ( IsMateProven( *context, 2 * moves - 1, true ) )
+			{
+				result.status = mateStatus_t::MATE;
+				result.mateIn = moves;
+				ExtractMateLine( *context, 2 * moves - 1, result.line );
+				break;
+			}
+			if ( context->stopped ) {
+				break;
+			}
+		}
+	}
+	else if ( !context->stopped )
+	{
+		result.status = mateStatus_t::NO_CHECKING_MATE;
+	}
+
+	if ( context->stopped ) {
+		result.status = mateStatus_t::UNKNOWN;
+	}
+	result.nodes = context->nodes;
+	result.timeMs = timer.GetCurrentElapsed();
+	return result;
+}
@@ -0,0 +1,370 @@
+#include "chess.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <thread>
+
+#include "timer.h"
+
+// Monte Carlo tree search with PUCT selection.
+//
+// Nodes live in one arena, children of a node are a contiguous block claimed with a single
+// atomic add. Every thread descends the shared tree on its own engine copy, adding a virtual
+// loss to each node on its path so concurrent descents spread out, then plays the leaf out to
+// a terminal state and backs the result up. Node statistics are stored for the side that moved
+// into the node, in half points: 2 win, 1 draw, 0 loss.
+//
+// Playouts draw from the pseudo-legal targets and only test the king safety of the move they
+// pick, which is the cheapest legality check the engine has; a side with no target passing it
+// is mated or stalemated, the outcomes CalculateGameState() would report.
+
+static const int32_t MaxTreeDepth		= 256;
+static const int32_t TimeCheckInterval	= 64;			// Playouts between clock reads
+static const float FirstPlayUrgency		= 0.5f;			// Value assumed for unvisited children
+
+enum nodeState_t : int32_t
+{
+	NODE_FRESH,
+	NODE_EXPANDING,
+	NODE_EXPANDED,
+	NODE_MATED,				// No legal move, in check
+	NODE_STALEMATE,			// No legal move
+	NODE_LEAF,				// Arena full, only played out
+};
+
+struct mctsNode_t
+{
+	move_t					move;				// Move into this node
+	float					prior;
+	int32_t					firstChild;
+	int32_t					childCount;
+	std::atomic< int32_t >	state;
+	std::atomic< int32_t >	visits;
+	std::atomic< int32_t >	virtualLoss;
+	std::atomic< int32_t >	score;				// Half points for the side that moved into the node
+};
+
+struct mctsTree_t
+{
+	mctsLimits_t			limits;
+	std::unique_ptr< mctsNode_t[] >	nodes;
+	std::atomic< size_t >	used;
+	std::atomic< uint64_t >	playouts;
+	std::atomic< bool >		stopped;
+	Timer					timer;
+};
+
+
+static inline uint64_t NextRandom( uint64_t& state )
+{
+	// xorshift64*
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return state * 0x2545F4914F6CDD1Dull;
+}
+
+
+static void InitNode( mctsNode_t& node, const move_t& move, const float prior )
+{
+	node.move = move;
+	node.prior = prior;
+	node.firstChild = -1;
+	node.childCount = 0;
+	node.state.store( NODE_FRESH, std::memory_order_relaxed );
+	node.visits.store( 0, std::memory_order_relaxed );
+	node.virtualLoss.store( 0, std::memory_order_relaxed );
+	node.score.store( 0, std::memory_order_relaxed );
+}
+
+
+// Playout and prior weight, quiet moves 1
+static int32_t MoveWeight( const mctsPolicy_t policy, const Piece* victim, const pieceType_t promotion )
+{
+	if ( policy == mctsPolicy_t::UNIFORM ) {
+		return 1;
+	}
+
+	int32_t weight = 1;
+	if ( victim != nullptr ) {
+		weight += 2 * PieceValue[ (int32_t)victim->type ] / 100;
+	}
+	if ( promotion == pieceType_t::QUEEN ) {
+		weight += 8;
+	}
+	return weight;
+}
+
+
+static int32_t SelectChild( const mctsTree_t& tree, const mctsNode_t& node )
+{
+	const int32_t parentVisits = node.visits.load( std::memory_order_relaxed ) + node.virtualLoss.load( std::memory_order_relaxed );
+	const float explore = tree.limits.exploration * sqrtf( static_cast<float>( std::max( parentVisits, 1 ) ) );
+
+	int32_t best = node.firstChild;
+	float bestScore = -1.0f;
+	for ( int32_t i = 0; i < node.childCount; ++i )
+	{
+		const mctsNode_t& child = tree.nodes[ node.firstChild + i ];
+		const int32_t visits = child.visits.load( std::memory_order_relaxed );
+		const int32_t pending = visits + child.virtualLoss.load( std::memory_order_relaxed );
+
+		// Virtual losses count as visits without reward
+		const float value = ( pending > 0 ) ? ( 0.5f * child.score.load( std::memory_order_relaxed ) ) / pending : FirstPlayUrgency;
+		const float score = value + explore * child.prior / ( 1.0f + pending );
+		if ( score > bestScore )
+		{
+			bestScore = score;
+			best = node.firstChild + i;
+		}
+	}
+	return best;
+}
+
+
+teamCode_t ChessEngine::Playout( const mctsLimits_t& limits, uint64_t& random, std::vector< moveUndo_t >& undos, std::vector< move_t >& moves )
+{
+	teamCode_t winner = teamCode_t::NONE;
+	int32_t ply = 0;
+
+	for ( ; ply < limits.maxPlayoutPlies; ++ply )
+	{
+		if ( ProbeMaterial().endgame == endgameType_t::INSUFFICIENT_MATERIAL ) {
+			break;
+		}
+
+		move_t candidates[ MaxMoves ];
+		int32_t weights[ MaxMoves ];
+		int32_t candidateCount = 0;
+		int32_t totalWeight = 0;
+
+		const team_t& team = m_state.GetTeam( m_currentTurn );
+		for ( int32_t i = 0; i < team.livingCount; ++i )
+		{
+			const Piece* piece = m_state.GetPiece( team.pieces[ i ] );
+
+			position_t targets[ 4 * BoardSize ];
+			const int32_t targetCount = piece->ComputeAllMoveActions( targets );
+
+			uint64_t seen = 0;
+			for ( int32_t t = 0; t < targetCount; ++t )
+			{
+				const uint64_t square = 1ull << ( targets[ t ].y * BoardSize + targets[ t ].x );
+				if ( ( seen & square ) != 0 ) {
+					continue;
+				}
+				seen |= square;
+
+				// Playouts always promote to a queen
+				const bool promotion = ( piece->type == pieceType_t::PAWN ) && ( ( targets[ t ].y == 0 ) || ( targets[ t ].y == ( BoardSize - 1 ) ) );
+				const move_t move = { piece->m_handle, targets[ t ].x, targets[ t ].y, promotion ? pieceType_t::QUEEN : pieceType_t::NONE };
+
+				weights[ candidateCount ] = MoveWeight( limits.policy, m_state.GetPiece( move.x, move.y ), move.promotion );
+				totalWeight += weights[ candidateCount ];
+				candidates[ candidateCount++ ] = move;
+			}
+		}
+
+		// Weighted pick, a target that leaves the king in check is dropped and the draw repeated
+		bool moved = false;
+		while ( candidateCount > 0 )
+		{
+			int32_t pick = static_cast<int32_t>( ( NextRandom( random ) >> 32 ) % static_cast<uint32_t>( totalWeight ) );
+			int32_t chosen = 0;
+			while ( pick >= weights[ chosen ] )
+			{
+				pick -= weights[ chosen ];
+				++chosen;
+			}
+
+			const move_t& move = candidates[ chosen ];
+			if ( m_state.IsKingSafeAfter( m_state.GetPiece( move.piece ), move.x, move.y ) )
+			{
+				moves[ ply ] = move;
+				MakeMove( move, undos[ ply ] );
+				moved = true;
+				break;
+			}
+
+			totalWeight -= weights[ chosen ];
+			--candidateCount;
+			candidates[ chosen ] = candidates[ candidateCount ];
+			weights[ chosen ] = weights[ candidateCount ];
+		}
+
+		if ( moved == false )
+		{
+			if ( m_state.IsChecked( m_currentTurn ) ) {
+				winner = GetOpposingTeam( m_currentTurn );
+			}
+			break;
+		}
+	}
+
+	while ( ply > 0 )
+	{
+		--ply;
+		UnmakeMove( moves[ ply ], undos[ ply ] );
+	}
+	return winner;
+}
+
+
+void ChessEngine::MctsWorker( mctsTree_t& tree, const int32_t threadIndex )
+{
+	const mctsLimits_t& limits = tree.limits;
+	const teamCode_t rootTeam = m_currentTurn;
+	uint64_t random = ( limits.seed + threadIndex ) * 0x9E3779B97F4A7C15ull + 1;
+
+	std::vector< moveUndo_t > playoutUndos( limits.maxPlayoutPlies );
+	std::vector< move_t > playoutMoves( limits.maxPlayoutPlies );
+
+	int32_t path[ MaxTreeDepth ];
+	moveUndo_t pathUndos[ MaxTreeDepth ];
+
+	while ( tree.stopped.load( std::memory_order_relaxed ) == false )
+	{
+		const uint64_t playout = tree.playouts.fetch_add( 1 );
+		if ( ( limits.playouts > 0 ) && ( playout >= limits.playouts ) ) {
+			break;
+		}
+		if ( ( limits.timeMs > 0 ) && ( ( playout % TimeCheckInterval ) == 0 ) && ( (int64_t)tree.timer.GetCurrentElapsed() >= limits.timeMs ) )
+		{
+			tree.stopped = true;
+			break;
+		}
+
+		// Selection
+		int32_t depth = 0;
+		int32_t nodeIndex = 0;
+		path[ depth++ ] = nodeIndex;
+		tree.nodes[ nodeIndex ].virtualLoss.fetch_add( 1, std::memory_order_relaxed );
+
+		while ( ( depth < MaxTreeDepth ) && ( tree.nodes[ nodeIndex ].state.load( std::memory_order_acquire ) == NODE_EXPANDED ) )
+		{
+			nodeIndex = SelectChild( tree, tree.nodes[ nodeIndex ] );
+			mctsNode_t& child = tree.nodes[ nodeIndex ];
+			child.virtualLoss.fetch_add( 1, std::memory_order_relaxed );
+			MakeMove( child.move, pathUndos[ depth ] );
+			path[ depth++ ] = nodeIndex;
+		}
+
+		mctsNode_t& leaf = tree.nodes[ nodeIndex ];
+
+		// Expansion, by whichever thread gets there first
+		int32_t expected = NODE_FRESH;
+		if ( ( depth < MaxTreeDepth ) && leaf.state.compare_exchange_strong( expected, NODE_EXPANDING, std::memory_order_acquire ) )
+		{
+			move_t moves[ MaxMoves ];
+			const int32_t moveCount = GenerateMoves( moves );
+			const size_t first = ( moveCount > 0 ) ? tree.used.fetch_add( moveCount ) : 0;
+
+			if ( moveCount == 0 )
+			{
+				leaf.state.store( m_state.IsChecked( m_currentTurn ) ? NODE_MATED : NODE_STALEMATE, std::memory_order_release );
+			}
+			else if ( first + moveCount > limits.maxNodes )
+			{
+				leaf.state.store( NODE_LEAF, std::memory_order_release );
+			}
+			else
+			{
+				int32_t weights[ MaxMoves ];
+				int32_t totalWeight = 0;
+				for ( int32_t i = 0; i < moveCount; ++i )
+				{
+					weights[ i ] = MoveWeight( limits.policy, m_state.GetPiece( moves[ i ].x, moves[ i ].y ), moves[ i ].promotion );
+					totalWeight += weights[ i ];
+				}
+				for ( int32_t i = 0; i < moveCount; ++i ) {
+					InitNode( tree.nodes[ first + i ], moves[ i ], static_cast<float>( weights[ i ] ) / totalWeight );
+				}
+
+				leaf.firstChild = static_cast<int32_t>( first );
+				leaf.childCount = moveCount;
+				leaf.state.store( NODE_EXPANDED, std::memory_order_release );
+			}
+		}
+
+		// Simulation
+		teamCode_t winner = teamCode_t::NONE;
+		const int32_t leafState = leaf.state.load( std::memory_order_acquire );
+		if ( leafState == NODE_MATED ) {
+			winner = GetOpposingTeam( m_currentTurn );
+		} else if ( leafState != NODE_STALEMATE ) {
+			winner = Playout( limits, random, playoutUndos, playoutMoves );
+		}
+
+		// Backpropagation, the root's mover is the side not to move there
+		for ( int32_t i = depth - 1; i >= 0; --i )
+		{
+			mctsNode_t& node = tree.nodes[ path[ i ] ];
+			const teamCode_t mover = ( ( i & 1 ) == 0 ) ? GetOpposingTeam( rootTeam ) : rootTeam;
+			const int32_t reward = ( winner == teamCode_t::NONE ) ? 1 : ( ( winner == mover ) ? 2 : 0 );
+
+			node.score.fetch_add( reward, std::memory_order_relaxed );
+			node.visits.fetch_add( 1, std::memory_order_relaxed );
+			node.virtualLoss.fetch_sub( 1, std::memory_order_relaxed );
+
+			if ( i > 0 ) {
+				UnmakeMove( node.move, pathUndos[ i ] );
+			}
+		}
+	}
+}
+
+
+mctsResult_t ChessEngine::SearchMcts( const mctsLimits_t& limits ) const
+{
+	mctsResult_t result;
+	if ( ( limits.playouts == 0 ) && ( limits.timeMs == 0 ) ) {
+		return result;
+	}
+
+	std::unique_ptr< mctsTree_t > tree( new mctsTree_t() );
+	tree->limits = limits;
+	tree->limits.maxNodes = std::max< size_t >( limits.maxNodes, 1 + MaxMoves );
+	tree->limits.threads = std::max( limits.threads, 1 );
+	tree->limits.maxPlayoutPlies = std::max( limits.maxPlayoutPlies, 1 );
+	tree->nodes.reset( new mctsNode_t[ tree->limits.maxNodes ] );
+	tree->used = 1;
+	tree->playouts = 0;
+	tree->stopped = false;
+	InitNode( tree->nodes[ 0 ], NoMove, 1.0f );
+	tree->timer.Start();
+
+	std::vector< std::unique_ptr< ChessEngine > > engines;
+	std::vector< std::thread > threads;
+	for ( int32_t t = 0; t < tree->limits.threads; ++t ) {
+		engines.emplace_back( new ChessEngine( *this ) );
+	}
+	for ( int32_t t = 0; t < tree->limits.threads; ++t ) {
+		threads.emplace_back( [ &, t ]() { engines[ t ]->MctsWorker( *tree, t ); } );
+	}
+	for ( std::thread& thread : threads ) {
+		thread.join();
+	}
+
+	const mctsNode_t& root = tree->nodes[ 0 ];
+	if ( root.state.load() == NODE_EXPANDED )
+	{
+		for ( int32_t i = 0; i < root.childCount; ++i )
+		{
+			const mctsNode_t& child = tree->nodes[ root.firstChild + i ];
+			const int32_t visits = child.visits.load();
+			const float value = ( visits > 0 ) ? ( 0.5f * child.score.load() ) / visits : 0.0f;
+			result.moves.push_back( mctsMoveStats_t{ child.move, static_cast<uint32_t>( visits ), value, child.prior } );
+		}
+		std::stable_sort( result.moves.begin(), result.moves.end(), []( const mctsMoveStats_t& lhs, const mctsMoveStats_t& rhs ) {
+			return lhs.visits > rhs.visits;
+		} );
+		result.bestMove = result.moves.empty() ? NoMove : result.moves[ 0 ].move;
+	}
+
+	result.playouts = static_cast<uint64_t>( root.visits.load() );
+	result.nodes = std::min( tree->used.load(), tree->limits.maxNodes );
+	result.timeMs = (int64_t)tree->timer.GetCurrentElapsed();
+	return result;
+}
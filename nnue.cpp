@@ -0,0 +1,368 @@
+#include "chess.h"
+
+#include <algorithm>
+#include <fstream>
+
+// The CHESS_SIMD build option picks the path, all three give the same scores
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#define NNUE_USE_AVX2 1
+#elif defined( __SSE4_1__ ) || defined( __AVX__ )
+#include <smmintrin.h>
+#define NNUE_USE_SSE41 1
+#endif
+
+// Efficiently updatable network, HalfKP layout
+//
+// Feature transformer: 40960 -> 256 per perspective (int16), the side to move's half first
+// Hidden layers: 512 -> 32 -> 32 (int8 weights, clipped ReLU on [0, 127])
+// Output: 32 -> 1, scaled down to centipawns
+//
+// File format, little endian:
+//		uint32	magic ('CNNU')
+//		uint32	version
+//		uint32	input, half, hidden dimensions (must match the compiled sizes)
+//		int16	ft biases[ half ], ft weights[ input ][ half ]
+//		int32	l1 biases[ hidden ], int8 l1 weights[ hidden ][ 2 * half ]
+//		int32	l2 biases[ hidden ], int8 l2 weights[ hidden ][ hidden ]
+//		int32	out bias, int8 out weights[ hidden ]
+
+static const uint32_t NnueMagic			= 0x554E4E43; // 'CNNU'
+static const uint32_t NnueVersion		= 1;
+static const int32_t NnueWeightShift	= 6;
+static const int32_t NnueOutputScale	= 16;
+
+struct nnueNetwork_t
+{
+	int16_t		featureBiases[ NnueHalfDimensions ];
+	int16_t		featureWeights[ NnueInputDimensions ][ NnueHalfDimensions ];
+
+	int32_t		hidden1Biases[ NnueHiddenDimensions ];
+	int8_t		hidden1Weights[ NnueHiddenDimensions ][ 2 * NnueHalfDimensions ];
+
+	int32_t		hidden2Biases[ NnueHiddenDimensions ];
+	int8_t		hidden2Weights[ NnueHiddenDimensions ][ NnueHiddenDimensions ];
+
+	int32_t		outputBias;
+	int8_t		outputWeights[ NnueHiddenDimensions ];
+};
+
+
+// Piece kinds seen from a perspective: own pawn, enemy pawn, own knight, ... (kings excluded)
+static inline int32_t FeatureIndex( const teamCode_t perspective, const num_t kingX, const num_t kingY, const teamCode_t team, const pieceType_t type, const num_t x, const num_t y )
+{
+	static const int32_t KindIndex[ (int32_t)pieceType_t::COUNT ] = { 0, 3, 1, 2, -1, 4 };
+
+	// Square index with rank 1 first, mirrored vertically for black so both halves share weights
+	const int32_t flip = ( perspective == teamCode_t::WHITE ) ? 0 : 56;
+	const int32_t kingSquare = ( ( ( BoardSize - 1 - kingY ) * BoardSize ) + kingX ) ^ flip;
+	const int32_t square = ( ( ( BoardSize - 1 - y ) * BoardSize ) + x ) ^ flip;
+
+	const int32_t kind = 2 * KindIndex[ (int32_t)type ] + ( ( team == perspective ) ? 0 : 1 );
+
+	return ( kingSquare * 10 + kind ) * 64 + square;
+}
+
+
+static inline void AddWeights( int16_t* acc, const int16_t* weights )
+{
+#if NNUE_USE_AVX2
+	for ( int32_t i = 0; i < NnueHalfDimensions; i += 16 )
+	{
+		__m256i a = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( acc + i ) );
+		a = _mm256_add_epi16( a, _mm256_loadu_si256( reinterpret_cast<const __m256i*>( weights + i ) ) );
+		_mm256_storeu_si256( reinterpret_cast<__m256i*>( acc + i ), a );
+	}
+#elif NNUE_USE_SSE41
+	for ( int32_t i = 0; i < NnueHalfDimensions; i += 8 )
+	{
+		__m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>( acc + i ) );
+		a = _mm_add_epi16( a, _mm_loadu_si128( reinterpret_cast<const __m128i*>( weights + i ) ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( acc + i ), a );
+	}
+#else
+	for ( int32_t i = 0; i < NnueHalfDimensions; ++i ) {
+		acc[ i ] += weights[ i ];
+	}
+#endif
+}
+
+
+static inline void SubWeights( int16_t* acc, const int16_t* weights )
+{
+#if NNUE_USE_AVX2
+	for ( int32_t i = 0; i < NnueHalfDimensions; i += 16 )
+	{
+		__m256i a = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( acc + i ) );
+		a = _mm256_sub_epi16( a, _mm256_loadu_si256( reinterpret_cast<const __m256i*>( weights + i ) ) );
+		_mm256_storeu_si256( reinterpret_cast<__m256i*>( acc + i ), a );
+	}
+#elif NNUE_USE_SSE41
+	for ( int32_t i = 0; i < NnueHalfDimensions; i += 8 )
+	{
+		__m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>( acc + i ) );
+		a = _mm_sub_epi16( a, _mm_loadu_si128( reinterpret_cast<const __m128i*>( weights + i ) ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( acc + i ), a );
+	}
+#else
+	for ( int32_t i = 0; i < NnueHalfDimensions; ++i ) {
+		acc[ i ] -= weights[ i ];
+	}
+#endif
+}
+
+
+// Clamp int16 accumulator values to [0, 127] as uint8
+static inline void ClippedReluFeatures( const int16_t* in, uint8_t* out )
+{
+#if NNUE_USE_AVX2
+	const __m256i zero = _mm256_setzero_si256();
+	for ( int32_t i = 0; i < NnueHalfDimensions; i += 32 )
+	{
+		const __m256i a = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( in + i ) );
+		const __m256i b = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( in + i + 16 ) );
+		// packs works per 128-bit lane, permute restores the element order
+		__m256i packed = _mm256_max_epi8( _mm256_packs_epi16( a, b ), zero );
+		packed = _mm256_permute4x64_epi64( packed, 0xD8 );
+		_mm256_storeu_si256( reinterpret_cast<__m256i*>( out + i ), packed );
+	}
+#elif NNUE_USE_SSE41
+	const __m128i zero = _mm_setzero_si128();
+	for ( int32_t i = 0; i < NnueHalfDimensions; i += 16 )
+	{
+		const __m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>( in + i ) );
+		const __m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i*>( in + i + 8 ) );
+		_mm_storeu_si128( reinterpret_cast<__m128i*>( out + i ), _mm_max_epi8( _mm_packs_epi16( a, b ), zero ) );
+	}
+#else
+	for ( int32_t i = 0; i < NnueHalfDimensions; ++i ) {
+		out[ i ] = static_cast<uint8_t>( std::min<int32_t>( std::max<int32_t>( in[ i ], 0 ), 127 ) );
+	}
+#endif
+}
+
+
+// uint8 activations . int8 weights, count must be a multiple of 32
+static inline int32_t DotProduct( const uint8_t* in, const int8_t* weights, const int32_t count )
+{
+#if NNUE_USE_AVX2
+	const __m256i ones = _mm256_set1_epi16( 1 );
+	__m256i sum = _mm256_setzero_si256();
+	for ( int32_t i = 0; i < count; i += 32 )
+	{
+		const __m256i a = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( in + i ) );
+		const __m256i w = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( weights + i ) );
+		sum = _mm256_add_epi32( sum, _mm256_madd_epi16( _mm256_maddubs_epi16( a, w ), ones ) );
+	}
+	__m128i sum128 = _mm_add_epi32( _mm256_castsi256_si128( sum ), _mm256_extracti128_si256( sum, 1 ) );
+	sum128 = _mm_add_epi32( sum128, _mm_shuffle_epi32( sum128, 0x4E ) );
+	sum128 = _mm_add_epi32( sum128, _mm_shuffle_epi32( sum128, 0xB1 ) );
+	return _mm_cvtsi128_si32( sum128 );
+#elif NNUE_USE_SSE41
+	const __m128i ones = _mm_set1_epi16( 1 );
+	__m128i sum = _mm_setzero_si128();
+	for ( int32_t i = 0; i < count; i += 16 )
+	{
+		const __m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>( in + i ) );
+		const __m128i w = _mm_loadu_si128( reinterpret_cast<const __m128i*>( weights + i ) );
+		sum = _mm_add_epi32( sum, _mm_madd_epi16( _mm_maddubs_epi16( a, w ), ones ) );
+	}
+	sum = _mm_add_epi32( sum, _mm_shuffle_epi32( sum, 0x4E ) );
+	sum = _mm_add_epi32( sum, _mm_shuffle_epi32( sum, 0xB1 ) );
+	return _mm_cvtsi128_si32( sum );
+#else
+	int32_t sum = 0;
+	for ( int32_t i = 0; i < count; ++i ) {
+		sum += static_cast<int32_t>( in[ i ] ) * weights[ i ];
+	}
+	return sum;
+#endif
+}
+
+
+static inline uint8_t ClippedRelu( const int32_t value )
+{
+	return static_cast<uint8_t>( std::min( std::max( value >> NnueWeightShift, 0 ), 127 ) );
+}
+
+
+template< typename T >
+static bool ReadArray( std::ifstream& file, T* data, const size_t count )
+{
+	file.read( reinterpret_cast<char*>( data ), sizeof( T ) * count );
+	return file.good();
+}
+
+
+const nnueNetwork_t* LoadNetwork( const std::string& fileName )
+{
+	std::ifstream file( fileName, std::ios::binary );
+	if ( file.is_open() == false ) {
+		return nullptr;
+	}
+
+	uint32_t header[ 5 ] = {};
+	if ( ReadArray( file, header, 5 ) == false ) {
+		return nullptr;
+	}
+
+	const bool validHeader =	( header[ 0 ] == NnueMagic ) && ( header[ 1 ] == NnueVersion ) &&
+								( header[ 2 ] == NnueInputDimensions ) && ( header[ 3 ] == NnueHalfDimensions ) && ( header[ 4 ] == NnueHiddenDimensions );
+	if ( validHeader == false ) {
+		return nullptr;
+	}
+
+	nnueNetwork_t* network = new nnueNetwork_t();
+
+	bool ok = true;
+	ok = ok && ReadArray( file, network->featureBiases, NnueHalfDimensions );
+	ok = ok && ReadArray( file, &network->featureWeights[ 0 ][ 0 ], size_t( NnueInputDimensions ) * NnueHalfDimensions );
+	ok = ok && ReadArray( file, network->hidden1Biases, NnueHiddenDimensions );
+	ok = ok && ReadArray( file, &network->hidden1Weights[ 0 ][ 0 ], size_t( NnueHiddenDimensions ) * 2 * NnueHalfDimensions );
+	ok = ok && ReadArray( file, network->hidden2Biases, NnueHiddenDimensions );
+	ok = ok && ReadArray( file, &network->hidden2Weights[ 0 ][ 0 ], size_t( NnueHiddenDimensions ) * NnueHiddenDimensions );
+	ok = ok && ReadArray( file, &network->outputBias, 1 );
+	ok = ok && ReadArray( file, network->outputWeights, NnueHiddenDimensions );
+
+	if ( ok == false )
+	{
+		delete network;
+		return nullptr;
+	}
+	return network;
+}
+
+
+void DestroyNetwork( const nnueNetwork_t*& network )
+{
+	delete network;
+	network = nullptr;
+}
+
+
+void ChessState::NnueMovePiece( const Piece* piece, const num_t fromX, const num_t fromY, const num_t toX, const num_t toY )
+{
+	const nnueNetwork_t* network = m_game->GetNetwork();
+	if ( network == nullptr ) {
+		return;
+	}
+
+	// Every feature of the king's own half depends on where the king stands
+	if ( piece->type == pieceType_t::KING )
+	{
+		m_accumulator.dirty[ static_cast<int32_t>( piece->team ) ] = true;
+		return;
+	}
+
+	for ( int32_t p = 0; p < TeamCount; ++p )
+	{
+		if ( m_accumulator.dirty[ p ] ) {
+			continue;
+		}
+
+		const teamCode_t perspective = static_cast<teamCode_t>( p );
+		const Piece* king = GetPiece( m_game->FindPiece( perspective, pieceType_t::KING, 0 ) );
+		if ( king == nullptr )
+		{
+			m_accumulator.dirty[ p ] = true;
+			continue;
+		}
+
+		if ( OnBoard( fromX, fromY ) ) {
+			SubWeights( m_accumulator.values[ p ], network->featureWeights[ FeatureIndex( perspective, king->X(), king->Y(), piece->team, piece->type, fromX, fromY ) ] );
+		}
+		if ( OnBoard( toX, toY ) ) {
+			AddWeights( m_accumulator.values[ p ], network->featureWeights[ FeatureIndex( perspective, king->X(), king->Y(), piece->team, piece->type, toX, toY ) ] );
+		}
+	}
+}
+
+
+void ChessState::NnueRetypePiece( const Piece* piece, const pieceType_t prevType )
+{
+	const nnueNetwork_t* network = m_game->GetNetwork();
+	if ( network == nullptr ) {
+		return;
+	}
+
+	for ( int32_t p = 0; p < TeamCount; ++p )
+	{
+		if ( m_accumulator.dirty[ p ] ) {
+			continue;
+		}
+
+		const teamCode_t perspective = static_cast<teamCode_t>( p );
+		const Piece* king = GetPiece( m_game->FindPiece( perspective, pieceType_t::KING, 0 ) );
+		if ( king == nullptr )
+		{
+			m_accumulator.dirty[ p ] = true;
+			continue;
+		}
+
+		SubWeights( m_accumulator.values[ p ], network->featureWeights[ FeatureIndex( perspective, king->X(), king->Y(), piece->team, prevType, piece->X(), piece->Y() ) ] );
+		AddWeights( m_accumulator.values[ p ], network->featureWeights[ FeatureIndex( perspective, king->X(), king->Y(), piece->team, piece->type, piece->X(), piece->Y() ) ] );
+	}
+}
+
+
+void ChessState::NnueRefresh( const teamCode_t perspective ) const
+{
+	const nnueNetwork_t* network = m_game->GetNetwork();
+	const int32_t p = static_cast<int32_t>( perspective );
+	const Piece* king = GetPiece( m_game->FindPiece( perspective, pieceType_t::KING, 0 ) );
+
+	if ( ( network == nullptr ) || ( king == nullptr ) ) {
+		return;
+	}
+
+	memcpy( m_accumulator.values[ p ], network->featureBiases, sizeof( network->featureBiases ) );
+
+	for ( int32_t t = 0; t < TeamCount; ++t )
+	{
+		const team_t& team = m_teams[ t ];
+		for ( int32_t i = 0; i < team.livingCount; ++i )
+		{
+			const Piece* piece = GetPiece( team.pieces[ i ] );
+			if ( piece->type == pieceType_t::KING ) {
+				continue;
+			}
+			AddWeights( m_accumulator.values[ p ], network->featureWeights[ FeatureIndex( perspective, king->X(), king->Y(), piece->team, piece->type, piece->X(), piece->Y() ) ] );
+		}
+	}
+	m_accumulator.dirty[ p ] = false;
+}
+
+
+int32_t NnueEvaluate( const nnueNetwork_t* network, const ChessState& state, const teamCode_t sideToMove )
+{
+	const nnueAccumulator_t& accumulator = state.GetAccumulator();
+	assert( ( accumulator.dirty[ 0 ] == false ) && ( accumulator.dirty[ 1 ] == false ) );
+
+	uint8_t features[ 2 * NnueHalfDimensions ];
+	uint8_t hidden1[ NnueHiddenDimensions ];
+	uint8_t hidden2[ NnueHiddenDimensions ];
+
+	const int32_t us = static_cast<int32_t>( sideToMove );
+	ClippedReluFeatures( accumulator.values[ us ], features );
+	ClippedReluFeatures( accumulator.values[ us ^ 1 ], features + NnueHalfDimensions );
+
+	for ( int32_t i = 0; i < NnueHiddenDimensions; ++i ) {
+		hidden1[ i ] = ClippedRelu( network->hidden1Biases[ i ] + DotProduct( features, network->hidden1Weights[ i ], 2 * NnueHalfDimensions ) );
+	}
+
+	for ( int32_t i = 0; i < NnueHiddenDimensions; ++i ) {
+		hidden2[ i ] = ClippedRelu( network->hidden2Biases[ i ] + DotProduct( hidden1, network->hidden2Weights[ i ], NnueHiddenDimensions ) );
+	}
+
+	const int32_t output = network->outputBias + DotProduct( hidden2, network->outputWeights, NnueHiddenDimensions );
+	return output / NnueOutputScale;
+}
+
+
+void ChessEngine::SetNetwork( const nnueNetwork_t* network )
+{
+	m_network = network;
+	m_state.m_accumulator.dirty[ 0 ] = true;
+	m_state.m_accumulator.dirty[ 1 ] = true;
+	ClearEvalCache();
+}
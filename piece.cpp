@@ -1,4 +1,4 @@
-#include "Chess.h"
+#include "chess.h"
 
 MoveCache PawnMoveSuperset;
 MoveCache RookMoveSuperset;
@@ -8,7 +8,10 @@ MoveCache KingMoveSuperset;
 MoveCache QueenMoveSuperset;
 
 
-static const int32_t PieceValue[ (int32_t)pieceType_t::COUNT ] =
+#if defined( CHESS_TUNED_TABLES )
+#include "tunedTables.h"	// Written by tune.cpp
+#else
+const int32_t PieceValue[ (int32_t)pieceType_t::COUNT ] =
 {
 	100,	// PAWN
 	500,	// ROOK
@@ -103,7 +106,7 @@ static const int32_t KingPST[ BoardSize ][ BoardSize ] =
 };
 
 
-static const int32_t( *PST[ (int32_t)pieceType_t::COUNT ] )[ BoardSize ] =
+const int32_t( *PST[ (int32_t)pieceType_t::COUNT ] )[ BoardSize ] =
 {
 	PawnPST,	// PAWN   = 0
 	RookPST,	// ROOK   = 1
@@ -114,13 +117,53 @@ static const int32_t( *PST[ (int32_t)pieceType_t::COUNT ] )[ BoardSize ] =
 };
 
 
+// Pawn PST (endgame)  passed pawns race for promotion
+static const int32_t PawnEndgamePST[ BoardSize ][ BoardSize ] =
+{
+	{  0,  0,  0,  0,  0,  0,  0,  0 },
+	{ 80, 80, 80, 80, 80, 80, 80, 80 },
+	{ 50, 50, 50, 50, 50, 50, 50, 50 },
+	{ 30, 30, 30, 30, 30, 30, 30, 30 },
+	{ 15, 15, 15, 15, 15, 15, 15, 15 },
+	{  5,  5,  5,  5,  5,  5,  5,  5 },
+	{  0,  0,  0,  0,  0,  0,  0,  0 },
+	{  0,  0,  0,  0,  0,  0,  0,  0 },
+};
+
+
+// King PST (endgame)  centralize once the heavy pieces are gone
+static const int32_t KingEndgamePST[ BoardSize ][ BoardSize ] =
+{
+	{ -50,-40,-30,-20,-20,-30,-40,-50 },
+	{ -30,-20,-10,  0,  0,-10,-20,-30 },
+	{ -30,-10, 20, 30, 30, 20,-10,-30 },
+	{ -30,-10, 30, 40, 40, 30,-10,-30 },
+	{ -30,-10, 30, 40, 40, 30,-10,-30 },
+	{ -30,-10, 20, 30, 30, 20,-10,-30 },
+	{ -30,-30,  0,  0,  0,  0,-30,-30 },
+	{ -50,-30,-30,-30,-30,-30,-30,-50 },
+};
+
+
+const int32_t( *PSTEndgame[ (int32_t)pieceType_t::COUNT ] )[ BoardSize ] =
+{
+	PawnEndgamePST,	// PAWN   = 0
+	RookPST,		// ROOK   = 1
+	KnightPST,		// KNIGHT = 2
+	BishopPST,		// BISHOP = 3
+	KingEndgamePST,	// KING   = 4
+	QueenPST,		// QUEEN  = 5
+};
+#endif // CHESS_TUNED_TABLES
+
+
 bool Piece::IsValidAction( const int32_t actionNum ) const
 {
 	return ( actionNum >= 0 ) && ( actionNum < GetActionCount() );
 }
 
 
-void Piece::Move( const moveType_t moveType, const num_t targetX, const num_t targetY )
+void Piece::Move( const moveType_t moveType, const num_t targetX, const num_t targetY, const pieceType_t promotionType )
 {
 	const bool isCastleAction = ( moveType == moveType_t::KING_CASTLE_L ) || ( moveType == moveType_t::KING_CASTLE_R );
 	const bool isPawnAction = ( type == pieceType_t::PAWN );
@@ -145,6 +188,9 @@ void Piece::Move( const moveType_t moveType, const num_t targetX, const num_t ta
 			rook->PlaceAt( targetX - 1, m_y );
 		}
 		PlaceAt( targetX, targetY );
+		++m_moveCount;
+
+		m_state->SetEnpassant( NoPiece );
 	}
 	else if( isPawnAction )
 	{
@@ -165,7 +211,7 @@ void Piece::Move( const moveType_t moveType, const num_t targetX, const num_t ta
 		m_state->SetEnpassant( doubleMove ? m_handle : NoPiece );
 
 		if ( CanPromote() ) {
-			Promote();
+			( promotionType == pieceType_t::NONE ) ? Promote() : Promote( promotionType );
 		}
 	}
 	else
@@ -186,6 +232,13 @@ void Piece::Move( const moveType_t moveType, const num_t targetX, const num_t ta
 
 
 void Piece::PlaceAt( const num_t targetX, const num_t targetY )
+{
+	m_state->NnueMovePiece( this, m_x, m_y, targetX, targetY );
+	SetLocation( targetX, targetY );
+}
+
+
+void Piece::SetLocation( const num_t targetX, const num_t targetY )
 {
 	if ( m_state->OnBoard( m_x, m_y ) ) {
 		m_state->SetHandle( NoPiece, m_x, m_y );
@@ -207,13 +260,13 @@ void Piece::TempPlacement( const num_t targetX, const num_t targetY )
 	m_prevX = m_x;
 	m_prevY = m_y;
 
-	PlaceAt( targetX, targetY );
+	SetLocation( targetX, targetY );
 }
 
 
 void Piece::ReturnPlacement()
 {
-	PlaceAt( m_prevX, m_prevY );
+	SetLocation( m_prevX, m_prevY );
 
 	m_prevX = -1;
 	m_prevY = -1;
@@ -247,20 +300,60 @@ void Piece::Promote()
 
 	m_state->PromotionCallback( team, event );
 
-	bool invalidChoice = true;
-	invalidChoice = invalidChoice && ( event.promotionType != pieceType_t::QUEEN );
-	invalidChoice = invalidChoice && ( event.promotionType != pieceType_t::KNIGHT );
-	invalidChoice = invalidChoice && ( event.promotionType != pieceType_t::BISHOP );
-	invalidChoice = invalidChoice && ( event.promotionType != pieceType_t::ROOK );
+	Promote( event.promotionType );
+}
+
 
-	if ( invalidChoice ) {
-		event.promotionType = pieceType_t::QUEEN;
+void Piece::Promote( const pieceType_t promotionType )
+{
+	if ( type != pieceType_t::PAWN ) {
+		return;
 	}
 
-	type = event.promotionType;
+	bool invalidChoice = true;
+	invalidChoice = invalidChoice && ( promotionType != pieceType_t::QUEEN );
+	invalidChoice = invalidChoice && ( promotionType != pieceType_t::KNIGHT );
+	invalidChoice = invalidChoice && ( promotionType != pieceType_t::BISHOP );
+	invalidChoice = invalidChoice && ( promotionType != pieceType_t::ROOK );
+
+	SetType( invalidChoice ? pieceType_t::QUEEN : promotionType );
+
+	m_promoted = true;
+}
+
+
+void Piece::SetType( const pieceType_t newType )
+{
+	// Keep the material signature and position hash in sync with the piece's new identity
+	team_t& teamState = m_state->m_teams[ static_cast<int32_t>( team ) ];
+	--teamState.typeCounts[ static_cast<int32_t>( type ) ];
+	++teamState.typeCounts[ static_cast<int32_t>( newType ) ];
+
+	const pieceType_t prevType = type;
+
+	m_state->m_hash ^= ZobristPieceKey( team, type, m_x, m_y );
+	type = newType;
+	m_state->m_hash ^= ZobristPieceKey( team, type, m_x, m_y );
+
+	if ( m_state->OnBoard( m_x, m_y ) )
+	{
+		boardSnapshot_t& snapshot = m_state->m_snapshot;
+		const uint64_t bit = 1ull << ( m_y * BoardSize + m_x );
+		snapshot.occupancy[ (int32_t)team ][ (int32_t)prevType ] &= ~bit;
+		snapshot.occupancy[ (int32_t)team ][ (int32_t)type ] |= bit;
+		snapshot.squares[ m_y ][ m_x ] = PackPiece( team, type );
+	}
+	m_state->NnueRetypePiece( this, prevType );
 
 	switch ( type )
 	{
+	case pieceType_t::PAWN:
+	{
+		m_actions = PawnActions;
+		m_moveSuperset = &PawnMoveSuperset;
+		m_numActions = static_cast<int32_t>( moveType_t::PAWN_ACTIONS );
+	} break;
+
 	case pieceType_t::ROOK:
 	{
 		m_actions = RookActions;
@@ -289,8 +382,6 @@ void Piece::Promote()
 		m_numActions = static_cast<int32_t>( moveType_t::QUEEN_ACTIONS );
 	} break;
 	}
-
-	m_promoted = true;
 }
 
 
@@ -585,7 +676,7 @@ void Piece::FillMoveCache()
 		for ( int32_t step = 1; step <= maxSteps; ++step )
 		{
 			CalculateStep( action, nextX, nextY );
-			superset.Set( nextX, nextY );
+			superset.Set( nextX, nextY * GetTeamDirection() );	// Shared by both teams, stored in the frame IsLegalMove() tests in
 		}
 	}
 }
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "chess.h"
+
+// Archive replay. Moves are checked with the same rule evaluation Execute() uses, without
+// command lookup or strings, and check, mate and stalemate are worked out once after the last move.
+
+
+packedMove_t ChessEngine::GetPackedMove( const move_t& move ) const
+{
+	const Piece* piece = m_state.GetPiece( move.piece );
+	return PackMove( piece->X(), piece->Y(), move.x, move.y, move.promotion );
+}
+
+
+move_t ChessEngine::UnpackMove( const packedMove_t packed ) const
+{
+	const Piece* piece = m_state.GetPiece( packed & 7, ( packed >> 3 ) & 7 );
+	if ( ( piece == nullptr ) || ( piece->team != m_currentTurn ) ) {
+		return NoMove;
+	}
+	return move_t{ piece->m_handle, static_cast<num_t>( ( packed >> 6 ) & 7 ), static_cast<num_t>( ( packed >> 9 ) & 7 ), static_cast<pieceType_t>( ( ( packed >> 12 ) & 7 ) - 1 ) };
+}
+
+
+replayResult_t ChessEngine::ReplayGame( const packedMove_t* moves, const size_t count, const replayOptions_t& options )
+{
+	const bool lazy = m_lazyGameState;
+	m_lazyGameState = true;
+
+	replayResult_t result;
+	for ( ; result.failedIndex < count; ++result.failedIndex )
+	{
+		if ( IsKnownGameOver() )
+		{
+			result.failure = GetGameResult();
+			break;
+		}
+
+		const packedMove_t packed = moves[ result.failedIndex ];
+		const num_t toX = ( packed >> 6 ) & 7;
+		const num_t toY = ( packed >> 9 ) & 7;
+		const pieceType_t promotion = static_cast<pieceType_t>( ( ( packed >> 12 ) & 7 ) - 1 );
+
+		const Piece* piece = m_state.GetPiece( packed & 7, ( packed >> 3 ) & 7 );
+		if ( ( piece == nullptr ) || ( piece->team != m_currentTurn ) )
+		{
+			result.failure = RESULT_GAME_INVALID_PIECE;
+			break;
+		}
+
+		if ( options.validate )
+		{
+			// A pawn reaching the last rank names its piece, no other move does
+			const bool promotes = ( piece->type == pieceType_t::PAWN ) && ( ( toY == 0 ) || ( toY == ( BoardSize - 1 ) ) );
+			const bool choiceValid = promotes ? ( ( promotion == pieceType_t::ROOK ) || ( promotion == pieceType_t::KNIGHT ) ||
+												  ( promotion == pieceType_t::BISHOP ) || ( promotion == pieceType_t::QUEEN ) )
+											  : ( promotion == pieceType_t::NONE );
+
+			if ( ( choiceValid == false ) || ( m_state.IsLegalMove( piece, toX, toY ) == moveType_t::NONE ) )
+			{
+				// Mate or stalemate leaves nothing legal, report it like Execute() does
+				result.failure = IsGameOver() ? GetGameResult() : RESULT_GAME_INVALID_MOVE;
+				break;
+			}
+		}
+
+		ExecuteTrusted( move_t{ piece->m_handle, toX, toY, promotion } );
+	}
+
+	m_lazyGameState = lazy;
+	result.outcome = GetGameResult();
+	return result;
+}
@@ -0,0 +1,992 @@
+#include "chess.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "timer.h"
+
+static const int32_t NodeCheckInterval	= 1024;		// Nodes between time and node limit checks
+
+struct searchWorker_t
+{
+	std::thread				thread;
+	std::atomic< bool >		running{ false };
+	std::atomic< bool >		stop{ false };
+	std::atomic< bool >		pondering{ false };
+	std::mutex				mutex;
+	std::condition_variable	wake;				// Stop() or PonderHit() while a finished ponder search waits
+	searchInfoCallback_t	onInfo;
+};
+
+static thread_local const searchWorker_t* CurrentWorker = nullptr;		// Set on a worker's own thread, its callbacks run there
+
+struct searchContext_t
+{
+	searchLimits_t	limits;
+	Timer			timer;
+	uint64_t		nodes = 0;
+	bool			stopped = false;
+	bool			pondering = false;
+	searchWorker_t*	worker = nullptr;			// Background search only
+
+	move_t			pv[ MaxSearchDepth + 1 ][ MaxSearchDepth + 1 ];
+	int32_t			pvLength[ MaxSearchDepth + 1 ] = {};
+	move_t			killers[ MaxSearchDepth + 1 ][ 2 ];
+	uint64_t		keys[ MaxSearchDepth + 1 ];		// Position keys along the current line
+	int32_t			reversible[ MaxSearchDepth + 1 ] = {};	// Plies since the last capture or pawn move, the game's before the root
+
+	move_t			rootExcluded[ MaxMoves ];	// Root moves already ranked by earlier multi-PV lines
+	int32_t			rootExcludedCount = 0;
+};
+
+
+static bool LimitReached( searchContext_t& context )
+{
+	// Polled every node, a relaxed load keeps Stop() well under a millisecond
+	if ( ( context.worker != nullptr ) && context.worker->stop.load( std::memory_order_relaxed ) ) {
+		context.stopped = true;
+	}
+
+	if ( ( context.nodes % NodeCheckInterval ) != 0 ) {
+		return context.stopped;
+	}
+
+	if ( context.pondering && ( context.worker->pondering.load() == false ) )
+	{
+		context.pondering = false;
+		context.timer.Start();
+	}
+
+	const bool outOfNodes = ( context.limits.nodes > 0 ) && ( context.nodes >= context.limits.nodes );
+	const bool outOfTime = !context.pondering && ( context.limits.timeMs > 0 ) && ( (int64_t)context.timer.GetCurrentElapsed() >= context.limits.timeMs );
+
+	context.stopped = context.stopped || outOfNodes || outOfTime;
+	return context.stopped;
+}
+
+
+static bool IsRootExcluded( const searchContext_t& context, const move_t& move )
+{
+	for ( int32_t i = 0; i < context.rootExcludedCount; ++i )
+	{
+		if ( context.rootExcluded[ i ] == move ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+// Any earlier occurrence along the line or in the game since the last irreversible move
+static bool IsRepetition( const searchContext_t& context, const int32_t ply, const std::vector< uint64_t >& history )
+{
+	const int32_t historySize = static_cast<int32_t>( history.size() );
+	for ( int32_t back = 2; back <= context.reversible[ ply ]; back += 2 )
+	{
+		const int32_t index = ply - back;
+		if ( ( historySize + index ) < 0 ) {
+			break;
+		}
+
+		const uint64_t earlier = ( index >= 0 ) ? context.keys[ index ] : history[ historySize + index ];
+		if ( earlier == context.keys[ ply ] ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+// Tablebase distances are exact, so they score like mates found by the search
+static int32_t TablebaseScore( const tbResult_t& result, const int32_t ply )
+{
+	const int32_t mate = MateValue - ( ply + result.pliesToMate );
+	return ( result.wdl > 0 ) ? mate : ( ( result.wdl < 0 ) ? -mate : 0 );
+}
+
+
+int32_t ChessEngine::GenerateMoves( move_t moves[ MaxMoves ] ) const
+{
+	static const pieceType_t PromotionTypes[] = { pieceType_t::QUEEN, pieceType_t::KNIGHT, pieceType_t::ROOK, pieceType_t::BISHOP };
+
+	int32_t moveCount = 0;
+	const team_t& team = m_state.GetTeam( m_currentTurn );
+
+	for ( int32_t i = 0; i < team.livingCount; ++i )
+	{
+		const Piece* piece = m_state.GetPiece( team.pieces[ i ] );
+
+		position_t targets[ 4 * BoardSize ];
+		const int32_t targetCount = piece->ComputeAllMoveActions( targets );
+
+		// Pawn single and double steps share their first square
+		uint64_t seen = 0;
+
+		for ( int32_t t = 0; t < targetCount; ++t )
+		{
+			const num_t x = targets[ t ].x;
+			const num_t y = targets[ t ].y;
+			const uint64_t square = 1ull << ( y * BoardSize + x );
+
+			if ( ( seen & square ) != 0 ) {
+				continue;
+			}
+			seen |= square;
+
+			if ( m_state.IsKingSafeAfter( piece, x, y ) == false ) {
+				continue;
+			}
+
+			const bool promotion = ( piece->type == pieceType_t::PAWN ) && ( ( y == 0 ) || ( y == ( BoardSize - 1 ) ) );
+			if ( promotion )
+			{
+				for ( const pieceType_t promotionType : PromotionTypes ) {
+					moves[ moveCount++ ] = move_t{ piece->m_handle, x, y, promotionType };
+				}
+			}
+			else
+			{
+				moves[ moveCount++ ] = move_t{ piece->m_handle, x, y, pieceType_t::NONE };
+			}
+		}
+	}
+	return moveCount;
+}
+
+
+uint64_t ChessEngine::GetLegalTargets( const pieceHandle_t pieceHdl ) const
+{
+	const Piece* piece = m_state.GetPiece( pieceHdl );
+	if ( ( piece == nullptr ) || ( m_state.OnBoard( piece->X(), piece->Y() ) == false ) ) {
+		return 0;
+	}
+
+	position_t targets[ 4 * BoardSize ];
+	const int32_t targetCount = piece->ComputeAllMoveActions( targets );
+
+	uint64_t legal = 0;
+	uint64_t seen = 0;
+	for ( int32_t t = 0; t < targetCount; ++t )
+	{
+		const uint64_t square = 1ull << ( targets[ t ].y * BoardSize + targets[ t ].x );
+		if ( ( seen & square ) != 0 ) {
+			continue;
+		}
+		seen |= square;
+
+		if ( m_state.IsKingSafeAfter( piece, targets[ t ].x, targets[ t ].y ) ) {
+			legal |= square;
+		}
+	}
+	return legal;
+}
+
+
+void ChessEngine::GetLegalTargets( const teamCode_t team, uint64_t targets[ BoardSize * BoardSize ] ) const
+{
+	memset( targets, 0, sizeof( targets[ 0 ] ) * BoardSize * BoardSize );
+
+	const team_t& pieces = m_state.GetTeam( team );
+	for ( int32_t i = 0; i < pieces.livingCount; ++i )
+	{
+		const Piece* piece = m_state.GetPiece( pieces.pieces[ i ] );
+		targets[ piece->Y() * BoardSize + piece->X() ] = GetLegalTargets( piece->m_handle );
+	}
+}
+
+
+command_t ChessEngine::GetMoveCommand( const move_t& move ) const
+{
+	const pieceInfo_t info = GetInfo( move.piece );
+
+	command_t cmd;
+	cmd.team = info.team;
+	cmd.pieceType = info.pieceType;
+	cmd.instance = info.instance;
+	cmd.x = move.x;
+	cmd.y = move.y;
+	cmd.promotion = move.promotion;
+	return cmd;
+}
+
+
+std::string ChessEngine::GetMoveString( const move_t& move ) const
+{
+	const Piece* piece = m_state.GetPiece( move.piece );
+	if ( ( move == NoMove ) || ( piece == nullptr ) ) {
+		return "0000";
+	}
+
+	std::string text;
+	text += GetFile( piece->X() );
+	text += GetRank( piece->Y() );
+	text += GetFile( move.x );
+	text += GetRank( move.y );
+	if ( move.promotion != pieceType_t::NONE ) {
+		text += GetPieceCode( move.promotion );
+	}
+	return text;
+}
+
+
+std::string ChessEngine::GetLineString( const std::vector< move_t >& line ) const
+{
+	// Squares are followed per piece, the line itself is never played on the board
+	num_t squareX[ PieceCount ];
+	num_t squareY[ PieceCount ];
+	for ( pieceHandle_t i = 0; i < PieceCount; ++i )
+	{
+		const Piece* piece = m_state.GetPiece( i );
+		squareX[ i ] = ( piece != nullptr ) ? piece->X() : -1;
+		squareY[ i ] = ( piece != nullptr ) ? piece->Y() : -1;
+	}
+
+	std::string text;
+	for ( const move_t& move : line )
+	{
+		const Piece* piece = m_state.GetPiece( move.piece );
+		if ( ( move == NoMove ) || ( piece == nullptr ) || ( squareX[ move.piece ] < 0 ) ) {
+			break;
+		}
+
+		const num_t fromX = squareX[ move.piece ];
+		const num_t fromY = squareY[ move.piece ];
+		if ( text.empty() == false ) {
+			text += ' ';
+		}
+		text += GetFile( fromX );
+		text += GetRank( fromY );
+		text += GetFile( move.x );
+		text += GetRank( move.y );
+		if ( move.promotion != pieceType_t::NONE ) {
+			text += GetPieceCode( move.promotion );
+		}
+
+		for ( pieceHandle_t i = 0; i < PieceCount; ++i )
+		{
+			if ( ( squareX[ i ] == move.x ) && ( squareY[ i ] == move.y ) ) {
+				squareX[ i ] = -1;
+			}
+		}
+
+		// Castling carries the rook along
+		if ( ( piece->type == pieceType_t::KING ) && ( abs( move.x - fromX ) == 2 ) )
+		{
+			const num_t rookX = ( move.x > fromX ) ? ( BoardSize - 1 ) : 0;
+			for ( pieceHandle_t i = 0; i < PieceCount; ++i )
+			{
+				if ( ( squareX[ i ] == rookX ) && ( squareY[ i ] == fromY ) ) {
+					squareX[ i ] = ( move.x + fromX ) / 2;
+				}
+			}
+		}
+
+		squareX[ move.piece ] = move.x;
+		squareY[ move.piece ] = move.y;
+	}
+	return text;
+}
+
+
+move_t ChessEngine::ParseMoveString( const std::string& text ) const
+{
+	if ( ( text.size() != 4 ) && ( text.size() != 5 ) ) {
+		return NoMove;
+	}
+
+	const int32_t fromX = GetFileNum( text[ 0 ] );
+	const int32_t fromY = GetRankNum( text[ 1 ] );
+	const int32_t toX = GetFileNum( text[ 2 ] );
+	const int32_t toY = GetRankNum( text[ 3 ] );
+	const pieceType_t promotion = ( text.size() == 5 ) ? GetPieceType( text[ 4 ] ) : pieceType_t::NONE;
+
+	move_t moves[ MaxMoves ];
+	const int32_t moveCount = GenerateMoves( moves );
+	for ( int32_t i = 0; i < moveCount; ++i )
+	{
+		const Piece* piece = m_state.GetPiece( moves[ i ].piece );
+		if ( ( piece->X() == fromX ) && ( piece->Y() == fromY ) && ( moves[ i ].x == toX ) && ( moves[ i ].y == toY ) && ( moves[ i ].promotion == promotion ) ) {
+			return moves[ i ];
+		}
+	}
+	return NoMove;
+}
+
+
+void ChessEngine::MakeMove( const move_t& move, moveUndo_t& undo )
+{
+	Piece* piece = m_state.GetPiece( move.piece );
+
+	undo.fromX = piece->X();
+	undo.fromY = piece->Y();
+	undo.moveCount = piece->m_moveCount;
+	undo.promoted = piece->m_promoted;
+	undo.captured = NoPiece;
+	undo.rook = NoPiece;
+	undo.enpassantPawn = m_state.m_enpassantPawn;
+	undo.checkedTeam = m_checkedTeam;
+	undo.winner = m_winner;
+	undo.stalemate = m_stalemate;
+
+	// Piece::Move only needs the move type to tell castles apart
+	moveType_t moveType = moveType_t::NONE;
+	const Piece* captured = nullptr;
+
+	if ( ( piece->type == pieceType_t::KING ) && ( abs( move.x - piece->X() ) == 2 ) )
+	{
+		const bool kingSide = ( move.x > piece->X() );
+		moveType = kingSide ? moveType_t::KING_CASTLE_R : moveType_t::KING_CASTLE_L;
+		undo.rook = m_state.GetHandle( kingSide ? ( BoardSize - 1 ) : 0, piece->Y() );
+		undo.rookFromX = kingSide ? ( BoardSize - 1 ) : 0;
+	}
+	else
+	{
+		captured = m_state.GetPiece( move.x, move.y );
+		if ( ( captured == nullptr ) && ( piece->type == pieceType_t::PAWN ) && ( move.x != piece->X() ) ) {
+			captured = m_state.GetEnpassant( move.x, move.y );
+		}
+	}
+
+	if ( captured != nullptr )
+	{
+		const team_t& capturedTeam = m_state.GetTeam( captured->team );
+
+		undo.captured = captured->m_handle;
+		undo.capturedX = captured->X();
+		undo.capturedY = captured->Y();
+		undo.capturedIndex = 0;
+		while ( capturedTeam.pieces[ undo.capturedIndex ] != captured->m_handle ) {
+			++undo.capturedIndex;
+		}
+	}
+
+	// Search never asks the promotion callback
+	const pieceType_t promotion = ( move.promotion != pieceType_t::NONE ) ? move.promotion : pieceType_t::QUEEN;
+	piece->Move( moveType, move.x, move.y, promotion );
+
+	m_currentTurn = GetOpposingTeam( m_currentTurn );
+	++m_turnCount;
+}
+
+
+void ChessEngine::UnmakeMove( const move_t& move, const moveUndo_t& undo )
+{
+	Piece* piece = m_state.GetPiece( move.piece );
+
+	m_currentTurn = piece->team;
+	--m_turnCount;
+
+	if ( piece->m_promoted && ( undo.promoted == false ) )
+	{
+		piece->SetType( pieceType_t::PAWN );
+		piece->m_promoted = false;
+	}
+
+	piece->PlaceAt( undo.fromX, undo.fromY );
+	piece->m_moveCount = undo.moveCount;
+
+	if ( undo.rook != NoPiece ) {
+		m_state.GetPiece( undo.rook )->PlaceAt( undo.rookFromX, undo.fromY );
+	}
+
+	if ( undo.captured != NoPiece ) {
+		m_state.ReverseCapturePiece( piece->team, m_pieces[ undo.captured ], undo.capturedIndex, undo.capturedX, undo.capturedY );
+	}
+
+	m_state.m_enpassantPawn = undo.enpassantPawn;
+	m_checkedTeam = undo.checkedTeam;
+	m_winner = undo.winner;
+	m_stalemate = undo.stalemate;
+}
+
+
+uint64_t ChessEngine::Perft( const int32_t depth )
+{
+	if ( depth == 0 ) {
+		return 1;
+	}
+
+	move_t moves[ MaxMoves ];
+	const int32_t moveCount = GenerateMoves( moves );
+
+	if ( depth == 1 ) {
+		return moveCount;
+	}
+
+	uint64_t nodes = 0;
+	for ( int32_t i = 0; i < moveCount; ++i )
+	{
+		moveUndo_t undo;
+		MakeMove( moves[ i ], undo );
+		nodes += Perft( depth - 1 );
+		UnmakeMove( moves[ i ], undo );
+	}
+	return nodes;
+}
+
+
+void ChessEngine::SetHashSize( const size_t megabytes )
+{
+	// Power of two entry count so the key masks straight to a slot
+	size_t entryCount = 1;
+	while ( ( entryCount * 2 * sizeof( ttEntry_t ) ) <= ( std::max< size_t >( megabytes, 1 ) << 20 ) ) {
+		entryCount *= 2;
+	}
+	m_hashTable.assign( entryCount, ttEntry_t{} );
+}
+
+
+void ChessEngine::ClearHash()
+{
+	std::fill( m_hashTable.begin(), m_hashTable.end(), ttEntry_t{} );
+	LoadHashFile();
+}
+
+
+ttEntry_t* ChessEngine::ProbeHash( const uint64_t key )
+{
+	ttEntry_t& entry = m_hashTable[ key & ( m_hashTable.size() - 1 ) ];
+	if ( ( entry.key != key ) || ( entry.bound == ttBound_t::NONE ) ) {
+		return nullptr;
+	}
+
+	// Hash file moves only name squares, the key says this is their position
+	if ( ( entry.move == NoMove ) && ( entry.packedMove != 0 ) )
+	{
+		entry.move = UnpackMove( entry.packedMove );
+		entry.packedMove = ( entry.move != NoMove ) ? entry.packedMove : 0;
+	}
+	return &entry;
+}
+
+
+void ChessEngine::StoreHash( const uint64_t key, const move_t& move, const int32_t score, const int32_t depth, const ttBound_t bound, const int32_t ply )
+{
+	ttEntry_t& entry = m_hashTable[ key & ( m_hashTable.size() - 1 ) ];
+
+	// Depth preferred, but always replace entries from other positions
+	if ( ( entry.key == key ) && ( entry.depth > depth ) && ( bound != ttBound_t::EXACT ) ) {
+		return;
+	}
+
+	// Mate scores are stored relative to this node, not the root
+	int32_t storedScore = score;
+	if ( score > MateBound ) {
+		storedScore += ply;
+	} else if ( score < -MateBound ) {
+		storedScore -= ply;
+	}
+
+	const bool sameKey = ( entry.key == key );
+	entry.move = ( move != NoMove ) ? move : ( sameKey ? entry.move : NoMove );
+	entry.packedMove = ( move != NoMove ) ? GetPackedMove( move ) : ( sameKey ? entry.packedMove : 0 );
+	entry.key = key;
+	entry.score = static_cast<int16_t>( storedScore );
+	entry.depth = static_cast<int8_t>( depth );
+	entry.bound = bound;
+	entry.age = 0;
+}
+
+
+void ChessEngine::OrderMoves( move_t* moves, const int32_t moveCount, const move_t& hashMove, const move_t killers[ 2 ] ) const
+{
+	int32_t scores[ MaxMoves ];
+
+	for ( int32_t i = 0; i < moveCount; ++i )
+	{
+		const move_t& move = moves[ i ];
+		const Piece* piece = m_state.GetPiece( move.piece );
+		const Piece* victim = m_state.GetPiece( move.x, move.y );
+
+		int32_t score = 0;
+		if ( move == hashMove ) {
+			score = 1 << 24;
+		} else if ( victim != nullptr ) {
+			score = ( 1 << 20 ) + PieceValue[ (int32_t)victim->type ] * 16 - static_cast<int32_t>( piece->type );	// MVV-LVA
+		} else if ( move.promotion == pieceType_t::QUEEN ) {
+			score = ( 1 << 20 );
+		} else if ( move == killers[ 0 ] ) {
+			score = ( 1 << 19 );
+		} else if ( move == killers[ 1 ] ) {
+			score = ( 1 << 18 );
+		}
+		scores[ i ] = score;
+	}
+
+	// Insertion sort, move lists are short
+	for ( int32_t i = 1; i < moveCount; ++i )
+	{
+		const move_t move = moves[ i ];
+		const int32_t score = scores[ i ];
+		int32_t j = i - 1;
+		while ( ( j >= 0 ) && ( scores[ j ] < score ) )
+		{
+			moves[ j + 1 ] = moves[ j ];
+			scores[ j + 1 ] = scores[ j ];
+			--j;
+		}
+		moves[ j + 1 ] = move;
+		scores[ j + 1 ] = score;
+	}
+}
+
+
+int32_t ChessEngine::Quiescence( const int32_t ply, int32_t alpha, const int32_t beta, searchContext_t& context )
+{
+	++context.nodes;
+	if ( LimitReached( context ) ) {
+		return 0;
+	}
+
+	tbResult_t tablebase;
+	if ( ( ply > 0 ) && ProbeTablebase( tablebase ) ) {
+		return TablebaseScore( tablebase, ply );
+	}
+
+	move_t moves[ MaxMoves ];
+	const int32_t moveCount = GenerateMoves( moves );
+	const bool inCheck = m_state.IsChecked( m_currentTurn );
+
+	if ( moveCount == 0 ) {
+		return inCheck ? -( MateValue - ply ) : 0;
+	}
+
+	const int32_t standPat = Evaluate();
+	if ( ( ply >= MaxSearchDepth ) || ( standPat >= beta ) ) {
+		return standPat;
+	}
+	alpha = std::max( alpha, standPat );
+
+	// Captures and queen promotions only
+	int32_t noisyCount = 0;
+	for ( int32_t i = 0; i < moveCount; ++i )
+	{
+		const move_t& move = moves[ i ];
+		const bool capture = ( m_state.GetHandle( move.x, move.y ) != NoPiece ) ||
+							 ( ( m_pieces[ move.piece ]->type == pieceType_t::PAWN ) && ( move.x != m_pieces[ move.piece ]->X() ) );
+		if ( capture || ( move.promotion == pieceType_t::QUEEN ) ) {
+			moves[ noisyCount++ ] = move;
+		}
+	}
+	OrderMoves( moves, noisyCount, NoMove, context.killers[ ply ] );
+
+	for ( int32_t i = 0; i < noisyCount; ++i )
+	{
+		moveUndo_t undo;
+		MakeMove( moves[ i ], undo );
+		const int32_t score = -Quiescence( ply + 1, -beta, -alpha, context );
+		UnmakeMove( moves[ i ], undo );
+
+		if ( context.stopped ) {
+			return 0;
+		}
+
+		if ( score >= beta ) {
+			return score;
+		}
+		alpha = std::max( alpha, score );
+	}
+	return alpha;
+}
+
+
+int32_t ChessEngine::SearchNode( int32_t depth, const int32_t ply, int32_t alpha, const int32_t beta, searchContext_t& context )
+{
+	context.pvLength[ ply ] = ply;
+
+	if ( ( depth <= 0 ) || ( ply >= MaxSearchDepth ) ) {
+		return Quiescence( ply, alpha, beta, context );
+	}
+
+	++context.nodes;
+	if ( LimitReached( context ) ) {
+		return 0;
+	}
+
+	// A cycle can be repeated forever, so it scores as the draw it leads to
+	const uint64_t key = GetPositionKey();
+	context.keys[ ply ] = key;
+	if ( ( ply > 0 ) && IsRepetition( context, ply, m_keyHistory ) ) {
+		return 0;
+	}
+
+	// The root still searches, it needs a move
+	tbResult_t tablebase;
+	if ( ( ply > 0 ) && ProbeTablebase( tablebase ) ) {
+		return TablebaseScore( tablebase, ply );
+	}
+
+	const int32_t originalAlpha = alpha;
+	move_t hashMove = NoMove;
+
+	const ttEntry_t* entry = ProbeHash( key );
+	if ( entry != nullptr )
+	{
+		hashMove = entry->move;
+
+		int32_t score = entry->score;
+		if ( score > MateBound ) {
+			score -= ply;
+		} else if ( score < -MateBound ) {
+			score += ply;
+		}
+
+		const bool usable = ( ply > 0 ) && ( entry->depth >= depth );
+		if ( usable && ( ( entry->bound == ttBound_t::EXACT ) ||
+						 ( ( entry->bound == ttBound_t::LOWER ) && ( score >= beta ) ) ||
+						 ( ( entry->bound == ttBound_t::UPPER ) && ( score <= alpha ) ) ) ) {
+			return score;
+		}
+	}
+
+	move_t moves[ MaxMoves ];
+	const int32_t moveCount = GenerateMoves( moves );
+	const bool inCheck = m_state.IsChecked( m_currentTurn );
+
+	if ( moveCount == 0 ) {
+		return inCheck ? -( MateValue - ply ) : 0;
+	}
+
+	if ( inCheck ) {
+		++depth;
+	}
+
+	OrderMoves( moves, moveCount, hashMove, context.killers[ ply ] );
+
+	int32_t bestScore = -InfiniteValue;
+	move_t bestMove = NoMove;
+
+	for ( int32_t i = 0; i < moveCount; ++i )
+	{
+		const move_t& move = moves[ i ];
+		const bool quiet = ( m_state.GetHandle( move.x, move.y ) == NoPiece ) && ( move.promotion == pieceType_t::NONE );
+
+		if ( ( ply == 0 ) && IsRootExcluded( context, move ) ) {
+			continue;
+		}
+
+		context.reversible[ ply + 1 ] = ( quiet && ( m_pieces[ move.piece ]->type != pieceType_t::PAWN ) ) ? ( context.reversible[ ply ] + 1 ) : 0;
+
+		moveUndo_t undo;
+		MakeMove( move, undo );
+		const int32_t score = -SearchNode( depth - 1, ply + 1, -beta, -alpha, context );
+		UnmakeMove( move, undo );
+
+		if ( context.stopped ) {
+			return 0;
+		}
+
+		if ( score <= bestScore ) {
+			continue;
+		}
+		bestScore = score;
+		bestMove = move;
+
+		if ( score <= alpha ) {
+			continue;
+		}
+		alpha = score;
+
+		context.pv[ ply ][ ply ] = move;
+		for ( int32_t next = ply + 1; next < context.pvLength[ ply + 1 ]; ++next ) {
+			context.pv[ ply ][ next ] = context.pv[ ply + 1 ][ next ];
+		}
+		context.pvLength[ ply ] = context.pvLength[ ply + 1 ];
+
+		if ( alpha >= beta )
+		{
+			if ( quiet && ( move != context.killers[ ply ][ 0 ] ) )
+			{
+				context.killers[ ply ][ 1 ] = context.killers[ ply ][ 0 ];
+				context.killers[ ply ][ 0 ] = move;
+			}
+			break;
+		}
+	}
+
+	// A root with moves held out doesn't score the full position
+	if ( ( ply > 0 ) || ( context.rootExcludedCount == 0 ) )
+	{
+		const ttBound_t bound = ( bestScore >= beta ) ? ttBound_t::LOWER : ( ( bestScore > originalAlpha ) ? ttBound_t::EXACT : ttBound_t::UPPER );
+		StoreHash( key, bestMove, bestScore, depth, bound, ply );
+	}
+
+	return bestScore;
+}
+
+
+searchResult_t ChessEngine::Search( const searchLimits_t& limits )
+{
+	return RunSearch( limits, nullptr );
+}
+
+
+searchResult_t ChessEngine::RunSearch( const searchLimits_t& limits, searchWorker_t* worker )
+{
+	searchResult_t result;
+
+	if ( limits.useBook && PickBookMove( result.bestMove ) )
+	{
+		result.fromBook = true;
+		result.pv.push_back( result.bestMove );
+		return result;
+	}
+
+	if ( m_hashTable.empty() ) {
+		SetHashSize( DefaultHashMB );
+	}
+
+	// Too large for the stack with its PV table
+	std::unique_ptr< searchContext_t > context( new searchContext_t() );
+	context->limits = limits;
+	context->timer.Start();
+	context->reversible[ 0 ] = m_halfMoveClock;
+	context->worker = worker;
+	context->pondering = ( worker != nullptr ) && worker->pondering.load();
+	for ( int32_t ply = 0; ply <= MaxSearchDepth; ++ply )
+	{
+		context->killers[ ply ][ 0 ] = NoMove;
+		context->killers[ ply ][ 1 ] = NoMove;
+	}
+
+	const int32_t maxDepth = std::clamp( limits.depth, 1, MaxSearchDepth );
+	for ( int32_t depth = 1; depth <= maxDepth; ++depth )
+	{
+		const int32_t score = SearchNode( depth, 0, -InfiniteValue, InfiniteValue, *context );
+
+		// A partial iteration is only used when nothing better exists
+		if ( context->stopped && ( result.depth > 0 ) ) {
+			break;
+		}
+
+		if ( context->pvLength[ 0 ] > 0 )
+		{
+			result.bestMove = context->pv[ 0 ][ 0 ];
+			result.score = score;
+			result.depth = depth;
+			result.pv.assign( context->pv[ 0 ], context->pv[ 0 ] + context->pvLength[ 0 ] );
+		}
+
+		if ( ( worker != nullptr ) && worker->onInfo && !context->stopped )
+		{
+			searchInfo_t info;
+			info.depth = depth;
+			info.score = score;
+			info.nodes = context->nodes;
+			info.timeMs = context->timer.GetCurrentElapsed();
+			info.nps = ( info.timeMs > 0 ) ? ( info.nodes * 1000 / info.timeMs ) : 0;
+			info.pv = result.pv;
+			worker->onInfo( info );
+		}
+
+		if ( context->stopped || ( abs( score ) > MateBound ) ) {
+			break;
+		}
+	}
+
+	// Out of time before the first iteration finished
+	if ( result.bestMove == NoMove )
+	{
+		move_t moves[ MaxMoves ];
+		if ( GenerateMoves( moves ) > 0 ) {
+			result.bestMove = moves[ 0 ];
+		}
+	}
+
+	result.nodes = context->nodes;
+	result.timeMs = context->timer.GetCurrentElapsed();
+	return result;
+}
+
+
+// Hash cutoffs cut the PV short, the stored best moves carry it on
+void ChessEngine::ExtendPvFromHash( std::vector< move_t >& pv, const int32_t maxLength )
+{
+	std::vector< moveUndo_t > undos( std::max< size_t >( pv.size(), maxLength ) );
+	int32_t played = 0;
+
+	for ( ; played < static_cast<int32_t>( pv.size() ); ++played ) {
+		MakeMove( pv[ played ], undos[ played ] );
+	}
+
+	while ( played < maxLength )
+	{
+		const ttEntry_t* entry = ProbeHash( GetPositionKey() );
+		if ( ( entry == nullptr ) || ( entry->move == NoMove ) ) {
+			break;
+		}
+
+		move_t moves[ MaxMoves ];
+		const int32_t moveCount = GenerateMoves( moves );
+		if ( std::find( moves, moves + moveCount, entry->move ) == ( moves + moveCount ) ) {
+			break;
+		}
+
+		pv.push_back( entry->move );
+		MakeMove( pv[ played ], undos[ played ] );
+		++played;
+	}
+
+	for ( int32_t i = played - 1; i >= 0; --i ) {
+		UnmakeMove( pv[ i ], undos[ i ] );
+	}
+}
+
+
+multiPvResult_t ChessEngine::AnalyzeMultiPV( const int32_t lineCount, const searchLimits_t& limits )
+{
+	multiPvResult_t result;
+
+	move_t moves[ MaxMoves ];
+	const int32_t moveCount = GenerateMoves( moves );
+	const int32_t wantedLines = std::clamp( lineCount, 0, moveCount );
+	if ( wantedLines == 0 ) {
+		return result;
+	}
+
+	if ( m_hashTable.empty() ) {
+		SetHashSize( DefaultHashMB );
+	}
+
+	std::unique_ptr< searchContext_t > context( new searchContext_t() );
+	context->limits = limits;
+	context->timer.Start();
+	context->reversible[ 0 ] = m_halfMoveClock;
+	for ( int32_t ply = 0; ply <= MaxSearchDepth; ++ply )
+	{
+		context->killers[ ply ][ 0 ] = NoMove;
+		context->killers[ ply ][ 1 ] = NoMove;
+	}
+
+	// Each line searches the root without the moves of the lines before it, the hash table carries over
+	const int32_t maxDepth = std::clamp( limits.depth, 1, MaxSearchDepth );
+	for ( int32_t depth = 1; depth <= maxDepth; ++depth )
+	{
+		std::vector< searchLine_t > lines;
+		context->rootExcludedCount = 0;
+
+		for ( int32_t lineIndex = 0; lineIndex < wantedLines; ++lineIndex )
+		{
+			const int32_t score = SearchNode( depth, 0, -InfiniteValue, InfiniteValue, *context );
+			if ( context->stopped || ( context->pvLength[ 0 ] == 0 ) ) {
+				break;
+			}
+
+			searchLine_t line;
+			line.score = score;
+			line.depth = depth;
+			line.pv.assign( context->pv[ 0 ], context->pv[ 0 ] + context->pvLength[ 0 ] );
+			ExtendPvFromHash( line.pv, depth );
+			lines.push_back( line );
+
+			context->rootExcluded[ context->rootExcludedCount++ ] = line.pv[ 0 ];
+		}
+
+		// A partial iteration is only used when nothing better exists
+		if ( context->stopped && !result.lines.empty() ) {
+			break;
+		}
+
+		std::stable_sort( lines.begin(), lines.end(), []( const searchLine_t& lhs, const searchLine_t& rhs ) { return lhs.score > rhs.score; } );
+		result.lines = lines;
+
+		const bool allMates = std::all_of( lines.begin(), lines.end(), []( const searchLine_t& line ) { return abs( line.score ) > MateBound; } );
+		if ( context->stopped || allMates ) {
+			break;
+		}
+	}
+	context->rootExcludedCount = 0;
+
+	result.nodes = context->nodes;
+	result.timeMs = context->timer.GetCurrentElapsed();
+	return result;
+}
+
+
+void ChessEngine::StartSearch( const searchLimits_t& limits, searchInfoCallback_t onInfo, searchDoneCallback_t onDone )
+{
+	// The previous thread is joined here, it can't be from inside its own callbacks
+	assert( ( m_searchWorker == nullptr ) || ( m_searchWorker != CurrentWorker ) );
+	Stop();
+
+	if ( m_searchWorker == nullptr ) {
+		m_searchWorker = new searchWorker_t();
+	}
+	searchWorker_t* worker = m_searchWorker;
+
+	worker->stop = false;
+	worker->pondering = limits.ponder;
+	worker->running = true;
+	worker->onInfo = onInfo;
+
+	worker->thread = std::thread( [ this, worker, limits, onDone ]()
+	{
+		CurrentWorker = worker;
+		const searchResult_t result = RunSearch( limits, worker );
+
+		// A ponder search never reports its move early, it waits for the opponent's reply
+		{
+			std::unique_lock< std::mutex > lock( worker->mutex );
+			worker->wake.wait( lock, [ worker ]() { return worker->stop.load() || ( worker->pondering.load() == false ); } );
+		}
+
+		worker->running = false;
+		if ( onDone ) {
+			onDone( result );
+		}
+	} );
+}
+
+
+void ChessEngine::Stop()
+{
+	searchWorker_t* worker = m_searchWorker;
+	if ( worker == nullptr ) {
+		return;
+	}
+
+	{
+		std::lock_guard< std::mutex > lock( worker->mutex );
+		worker->stop = true;
+	}
+	worker->wake.notify_all();
+
+	// Called from a callback: the thread can't wait on itself, the next StartSearch() or the destructor joins it
+	if ( ( worker != CurrentWorker ) && worker->thread.joinable() ) {
+		worker->thread.join();
+	}
+}
+
+
+void ChessEngine::PonderHit()
+{
+	searchWorker_t* worker = m_searchWorker;
+	if ( worker == nullptr ) {
+		return;
+	}
+
+	{
+		std::lock_guard< std::mutex > lock( worker->mutex );
+		worker->pondering = false;
+	}
+	worker->wake.notify_all();
+}
+
+
+bool ChessEngine::IsSearching() const
+{
+	return ( m_searchWorker != nullptr ) && m_searchWorker->running.load();
+}
+
+
+void ChessEngine::ReleaseSearchWorker()
+{
+	assert( ( m_searchWorker == nullptr ) || ( m_searchWorker != CurrentWorker ) );
+	Stop();
+	delete m_searchWorker;
+	m_searchWorker = nullptr;
+}
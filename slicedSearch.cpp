@@ -0,0 +1,518 @@
+#include "chess.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "timer.h"
+
+// Resumable alpha-beta. SearchNode() and Quiescence() keep their state on the call stack, which
+// can't be set aside between quanta. Here every node is a frame on an explicit stack and the move
+// lists share one fixed arena, so a suspended search is a small block any thread can pick up.
+// The tree is the same: hash cutoffs, check extension, killer ordering, captures in quiescence.
+
+static const int32_t NodeCheckInterval	= 1024;		// Nodes between deadline checks
+
+struct sliceFrame_t
+{
+	uint64_t		key;
+	int32_t			depth;
+	int32_t			alpha;
+	int32_t			beta;
+	int32_t			originalAlpha;
+	int32_t			bestScore;
+	move_t			bestMove;
+	int32_t			firstMove;			// Slot in the move arena
+	int32_t			moveCount;
+	int32_t			next;				// Next move to search, the one before it is on the board
+	int32_t			reversible;			// Plies since the last capture or pawn move
+	bool			quiescence;
+	bool			quiet;				// Move on the board
+	moveUndo_t		undo;				// Move on the board
+};
+
+struct sliceSearch_t
+{
+	searchLimits_t	limits;
+	Timer			timer;
+	uint64_t		nodes = 0;
+	uint64_t		nextCheck = 0;
+	int32_t			depth = 1;			// Iteration in progress
+	int32_t			ply = -1;			// Top frame, -1 between iterations
+	int32_t			arenaUsed = 0;
+	bool			finished = false;
+	searchResult_t	result;				// Last completed iteration
+
+	sliceFrame_t	frames[ MaxSearchDepth + 1 ];
+	move_t			killers[ MaxSearchDepth + 1 ][ 2 ];
+	move_t			moves[ SliceMoveArena ];
+};
+
+
+static bool LimitReached( sliceSearch_t& search )
+{
+	if ( ( search.limits.nodes > 0 ) && ( search.nodes >= search.limits.nodes ) ) {
+		return true;
+	}
+
+	if ( search.nodes < search.nextCheck ) {
+		return false;
+	}
+	search.nextCheck = search.nodes + NodeCheckInterval;
+	return ( search.limits.timeMs > 0 ) && ( (int64_t)search.timer.GetCurrentElapsed() >= search.limits.timeMs );
+}
+
+
+static int32_t TablebaseScore( const tbResult_t& result, const int32_t ply )
+{
+	const int32_t mate = MateValue - ( ply + result.pliesToMate );
+	return ( result.wdl > 0 ) ? mate : ( ( result.wdl < 0 ) ? -mate : 0 );
+}
+
+
+sliceSearch_t* ChessEngine::BeginSlicedSearch( const searchLimits_t& limits )
+{
+	sliceSearch_t* search = new sliceSearch_t();
+	search->limits = limits;
+	search->timer.Start();
+	for ( int32_t ply = 0; ply <= MaxSearchDepth; ++ply )
+	{
+		search->killers[ ply ][ 0 ] = NoMove;
+		search->killers[ ply ][ 1 ] = NoMove;
+	}
+
+	// Small enough for thousands of games, an engine with its own table keeps it
+	if ( m_hashTable.empty() ) {
+		m_hashTable.assign( SliceHashEntries, ttEntry_t{} );
+	}
+
+	if ( limits.useBook && PickBookMove( search->result.bestMove ) )
+	{
+		search->result.fromBook = true;
+		search->result.pv.push_back( search->result.bestMove );
+		search->finished = true;
+	}
+	return search;
+}
+
+
+// Pushes a frame for the node, or scores it on the spot and returns true
+bool ChessEngine::EnterSliceNode( sliceSearch_t& search, int32_t depth, int32_t alpha, const int32_t beta, const int32_t reversible, int32_t& score )
+{
+	const int32_t ply = search.ply + 1;
+	const bool quiescence = ( depth <= 0 ) || ( ply >= MaxSearchDepth );
+	++search.nodes;
+
+	// Repetitions along the line or with the game score as draws
+	const uint64_t key = GetPositionKey();
+	const int32_t historySize = static_cast<int32_t>( m_keyHistory.size() );
+	for ( int32_t back = 2; ( ply > 0 ) && ( back <= reversible ) && ( ( historySize + ply - back ) >= 0 ); back += 2 )
+	{
+		const int32_t index = ply - back;
+		if ( ( ( index >= 0 ) ? search.frames[ index ].key : m_keyHistory[ historySize + index ] ) == key )
+		{
+			score = 0;
+			return true;
+		}
+	}
+
+	tbResult_t tablebase;
+	if ( ( ply > 0 ) && ProbeTablebase( tablebase ) )
+	{
+		score = TablebaseScore( tablebase, ply );
+		return true;
+	}
+
+	move_t hashMove = NoMove;
+
+	const ttEntry_t* entry = quiescence ? nullptr : ProbeHash( key );
+	if ( entry != nullptr )
+	{
+		hashMove = entry->move;
+
+		int32_t hashScore = entry->score;
+		if ( hashScore > MateBound ) {
+			hashScore -= ply;
+		} else if ( hashScore < -MateBound ) {
+			hashScore += ply;
+		}
+
+		const bool usable = ( ply > 0 ) && ( entry->depth >= depth );
+		if ( usable && ( ( entry->bound == ttBound_t::EXACT ) ||
+						 ( ( entry->bound == ttBound_t::LOWER ) && ( hashScore >= beta ) ) ||
+						 ( ( entry->bound == ttBound_t::UPPER ) && ( hashScore <= alpha ) ) ) )
+		{
+			score = hashScore;
+			return true;
+		}
+	}
+
+	move_t moves[ MaxMoves ];
+	int32_t moveCount = GenerateMoves( moves );
+	const bool inCheck = m_state.IsChecked( m_currentTurn );
+
+	if ( moveCount == 0 )
+	{
+		score = inCheck ? -( MateValue - ply ) : 0;
+		return true;
+	}
+
+	const int32_t originalAlpha = alpha;
+	if ( quiescence )
+	{
+		const int32_t standPat = Evaluate();
+		if ( ( ply >= MaxSearchDepth ) || ( standPat >= beta ) )
+		{
+			score = standPat;
+			return true;
+		}
+		alpha = std::max( alpha, standPat );
+
+		int32_t noisyCount = 0;
+		for ( int32_t i = 0; i < moveCount; ++i )
+		{
+			const move_t& move = moves[ i ];
+			const bool capture = ( m_state.GetHandle( move.x, move.y ) != NoPiece ) ||
+								 ( ( m_pieces[ move.piece ]->type == pieceType_t::PAWN ) && ( move.x != m_pieces[ move.piece ]->X() ) );
+			if ( capture || ( move.promotion == pieceType_t::QUEEN ) ) {
+				moves[ noisyCount++ ] = move;
+			}
+		}
+		moveCount = noisyCount;
+		hashMove = NoMove;
+	}
+	else if ( inCheck )
+	{
+		++depth;
+	}
+
+	// Out of arena reads like a quiet quiescence node
+	if ( ( moveCount == 0 ) || ( ( search.arenaUsed + moveCount ) > SliceMoveArena ) )
+	{
+		score = quiescence ? alpha : Evaluate();
+		return true;
+	}
+
+	OrderMoves( moves, moveCount, hashMove, search.killers[ ply ] );
+
+	sliceFrame_t& frame = search.frames[ ply ];
+	frame.key = key;
+	frame.depth = depth;
+	frame.alpha = alpha;
+	frame.beta = beta;
+	frame.originalAlpha = originalAlpha;
+	frame.bestScore = quiescence ? alpha : -InfiniteValue;
+	frame.bestMove = NoMove;
+	frame.firstMove = search.arenaUsed;
+	frame.moveCount = moveCount;
+	frame.next = 0;
+	frame.reversible = reversible;
+	frame.quiescence = quiescence;
+	std::copy( moves, moves + moveCount, search.moves + search.arenaUsed );
+
+	search.arenaUsed += moveCount;
+	search.ply = ply;
+	return false;
+}
+
+
+bool ChessEngine::ResumeSlicedSearch( sliceSearch_t* search, const uint64_t nodes )
+{
+	sliceSearch_t& slice = *search;
+	if ( slice.finished ) {
+		return true;
+	}
+
+	// The deadline may have passed while the search waited for its turn
+	const uint64_t quantumEnd = slice.nodes + nodes;
+	slice.nextCheck = slice.nodes;
+
+	const int32_t maxDepth = std::clamp( slice.limits.depth, 1, MaxSearchDepth );
+	int32_t score = 0;
+	bool returning = false;
+
+	for ( ;; )
+	{
+		if ( slice.ply < 0 )
+		{
+			// Mate or stalemate at the root scores without a frame
+			if ( LimitReached( slice ) || EnterSliceNode( slice, slice.depth, -InfiniteValue, InfiniteValue, m_halfMoveClock, score ) )
+			{
+				FinishSlicedSearch( slice );
+				return true;
+			}
+			continue;
+		}
+
+		sliceFrame_t& frame = slice.frames[ slice.ply ];
+
+		if ( returning )
+		{
+			returning = false;
+			const move_t& move = slice.moves[ frame.firstMove + frame.next - 1 ];
+			UnmakeMove( move, frame.undo );
+
+			if ( frame.quiescence )
+			{
+				if ( score >= frame.beta )
+				{
+					frame.bestScore = score;
+					frame.next = frame.moveCount;
+				}
+				else if ( score > frame.alpha )
+				{
+					frame.alpha = score;
+					frame.bestScore = score;
+				}
+			}
+			else if ( score > frame.bestScore )
+			{
+				frame.bestScore = score;
+				frame.bestMove = move;
+
+				if ( score > frame.alpha )
+				{
+					frame.alpha = score;
+					if ( frame.alpha >= frame.beta )
+					{
+						move_t* killers = slice.killers[ slice.ply ];
+						if ( frame.quiet && ( move != killers[ 0 ] ) )
+						{
+							killers[ 1 ] = killers[ 0 ];
+							killers[ 0 ] = move;
+						}
+						frame.next = frame.moveCount;
+					}
+				}
+			}
+		}
+
+		if ( frame.next < frame.moveCount )
+		{
+			if ( slice.nodes >= quantumEnd ) {
+				return false;
+			}
+			if ( LimitReached( slice ) )
+			{
+				FinishSlicedSearch( slice );
+				return true;
+			}
+
+			const move_t& move = slice.moves[ frame.firstMove + frame.next++ ];
+			frame.quiet = ( m_state.GetHandle( move.x, move.y ) == NoPiece ) && ( move.promotion == pieceType_t::NONE );
+			const int32_t reversible = ( frame.quiet && ( m_pieces[ move.piece ]->type != pieceType_t::PAWN ) ) ? ( frame.reversible + 1 ) : 0;
+			MakeMove( move, frame.undo );
+
+			int32_t childScore;
+			if ( EnterSliceNode( slice, frame.depth - 1, -frame.beta, -frame.alpha, reversible, childScore ) )
+			{
+				score = -childScore;
+				returning = true;
+			}
+			continue;
+		}
+
+		if ( frame.quiescence == false )
+		{
+			const ttBound_t bound = ( frame.bestScore >= frame.beta ) ? ttBound_t::LOWER : ( ( frame.bestScore > frame.originalAlpha ) ? ttBound_t::EXACT : ttBound_t::UPPER );
+			StoreHash( frame.key, frame.bestMove, frame.bestScore, frame.depth, bound, slice.ply );
+		}
+
+		score = frame.bestScore;
+		slice.arenaUsed = frame.firstMove;
+		--slice.ply;
+		if ( slice.ply >= 0 )
+		{
+			score = -score;
+			returning = true;
+			continue;
+		}
+
+		// Iteration complete
+		slice.result.bestMove = frame.bestMove;
+		slice.result.score = score;
+		slice.result.depth = slice.depth;
+		slice.result.pv.assign( 1, frame.bestMove );
+		ExtendPvFromHash( slice.result.pv, slice.depth );
+
+		if ( ( slice.depth >= maxDepth ) || ( abs( score ) > MateBound ) )
+		{
+			FinishSlicedSearch( slice );
+			return true;
+		}
+		++slice.depth;
+	}
+}
+
+
+void ChessEngine::FinishSlicedSearch( sliceSearch_t& search )
+{
+	// Every frame below the top has its move on the board
+	for ( int32_t ply = search.ply - 1; ply >= 0; --ply )
+	{
+		const sliceFrame_t& frame = search.frames[ ply ];
+		UnmakeMove( search.moves[ frame.firstMove + frame.next - 1 ], frame.undo );
+	}
+
+	// A partial iteration is only used when nothing better exists
+	if ( ( search.result.bestMove == NoMove ) && ( search.ply >= 0 ) && ( search.frames[ 0 ].bestMove != NoMove ) )
+	{
+		search.result.bestMove = search.frames[ 0 ].bestMove;
+		search.result.score = search.frames[ 0 ].bestScore;
+		search.result.pv.assign( 1, search.result.bestMove );
+	}
+
+	if ( search.result.bestMove == NoMove )
+	{
+		move_t moves[ MaxMoves ];
+		if ( GenerateMoves( moves ) > 0 ) {
+			search.result.bestMove = moves[ 0 ];
+		}
+	}
+
+	search.ply = -1;
+	search.arenaUsed = 0;
+	search.finished = true;
+	search.result.nodes = search.nodes;
+	search.result.timeMs = search.timer.GetCurrentElapsed();
+}
+
+
+searchResult_t ChessEngine::EndSlicedSearch( sliceSearch_t*& search )
+{
+	if ( search->finished == false ) {
+		FinishSlicedSearch( *search );
+	}
+
+	const searchResult_t result = search->result;
+	delete search;
+	search = nullptr;
+	return result;
+}
+
+
+// Scheduler. Searches queue round robin and each turn runs one quantum, so every game gets the
+// same share of nodes until its deadline or depth ends it.
+
+struct sliceJob_t
+{
+	std::unique_ptr< ChessEngine >	engine;
+	sliceSearch_t*			search = nullptr;
+	searchDoneCallback_t	onDone;
+};
+
+struct searchScheduler_t
+{
+	std::vector< std::thread >	threads;
+	std::mutex				mutex;
+	std::condition_variable	wake;			// A search was queued, or shutdown
+	std::condition_variable	idle;			// The last pending search finished
+	std::deque< sliceJob_t* >	queue;
+	size_t					pending = 0;	// Queued or running
+	bool					shutdown = false;
+};
+
+
+static void SchedulerThread( searchScheduler_t* scheduler )
+{
+	std::unique_lock< std::mutex > lock( scheduler->mutex );
+	for ( ;; )
+	{
+		scheduler->wake.wait( lock, [ scheduler ] { return scheduler->shutdown || !scheduler->queue.empty(); } );
+		if ( scheduler->shutdown ) {
+			return;
+		}
+
+		sliceJob_t* job = scheduler->queue.front();
+		scheduler->queue.pop_front();
+		lock.unlock();
+
+		const bool finished = job->engine->ResumeSlicedSearch( job->search, SliceQuantumNodes );
+		if ( finished )
+		{
+			const searchResult_t result = job->engine->EndSlicedSearch( job->search );
+			if ( job->onDone ) {
+				job->onDone( result );
+			}
+			delete job;
+		}
+
+		lock.lock();
+		if ( finished == false ) {
+			scheduler->queue.push_back( job );
+		} else if ( --scheduler->pending == 0 ) {
+			scheduler->idle.notify_all();
+		}
+	}
+}
+
+
+searchScheduler_t* CreateScheduler( const int32_t threads )
+{
+	searchScheduler_t* scheduler = new searchScheduler_t();
+
+	const int32_t threadCount = ( threads > 0 ) ? threads : std::max( 1, static_cast<int32_t>( std::thread::hardware_concurrency() ) );
+	for ( int32_t i = 0; i < threadCount; ++i ) {
+		scheduler->threads.emplace_back( SchedulerThread, scheduler );
+	}
+	return scheduler;
+}
+
+
+void DestroyScheduler( searchScheduler_t*& scheduler )
+{
+	if ( scheduler == nullptr ) {
+		return;
+	}
+
+	{
+		std::lock_guard< std::mutex > lock( scheduler->mutex );
+		scheduler->shutdown = true;
+	}
+	scheduler->wake.notify_all();
+	for ( std::thread& thread : scheduler->threads ) {
+		thread.join();
+	}
+
+	for ( sliceJob_t* job : scheduler->queue )
+	{
+		job->engine->EndSlicedSearch( job->search );
+		delete job;
+	}
+
+	delete scheduler;
+	scheduler = nullptr;
+}
+
+
+void ScheduleSearch( searchScheduler_t* scheduler, const ChessEngine& position, const searchLimits_t& limits, searchDoneCallback_t onDone )
+{
+	sliceJob_t* job = new sliceJob_t();
+	job->engine.reset( new ChessEngine( position ) );
+	job->search = job->engine->BeginSlicedSearch( limits );
+	job->onDone = onDone;
+
+	{
+		std::lock_guard< std::mutex > lock( scheduler->mutex );
+		scheduler->queue.push_back( job );
+		++scheduler->pending;
+	}
+	scheduler->wake.notify_one();
+}
+
+
+void WaitForSearches( searchScheduler_t* scheduler )
+{
+	std::unique_lock< std::mutex > lock( scheduler->mutex );
+	scheduler->idle.wait( lock, [ scheduler ] { return scheduler->pending == 0; } );
+}
+
+
+size_t PendingSearches( searchScheduler_t* scheduler )
+{
+	std::lock_guard< std::mutex > lock( scheduler->mutex );
+	return scheduler->pending;
+}
@@ -0,0 +1,126 @@
+#include "chess.h"
+#include "tablebase.h"
+
+struct tablebase_t
+{
+	mappedFile_t	files[ TbMaterialKeyCount ];
+	const uint8_t*	entries[ TbMaterialKeyCount ] = {};		// By TbMaterialKey(), nullptr when the table is missing
+};
+
+
+const tablebase_t* OpenTablebases( const std::string& directory )
+{
+	std::vector< tbMaterial_t > materials;
+	TbAllMaterials( materials );
+
+	tablebase_t* tablebases = new tablebase_t();
+	int32_t tableCount = 0;
+
+	for ( const tbMaterial_t& material : materials )
+	{
+		const std::string name = TbMaterialName( material );
+
+		mappedFile_t file;
+		if ( MapFile( directory + "/" + name + ".ctb", file ) == false ) {
+			continue;
+		}
+
+		const uint64_t entryCount = TbEntryCount( material );
+		const tbHeader_t* header = reinterpret_cast<const tbHeader_t*>( file.data );
+		const bool valid =	( file.size == sizeof( tbHeader_t ) + entryCount ) &&
+							( header->magic == TbMagic ) && ( header->version == TbVersion ) &&
+							( header->entryCount == entryCount ) && ( name.compare( 0, sizeof( header->name ), header->name, strnlen( header->name, sizeof( header->name ) ) ) == 0 );
+		if ( valid == false )
+		{
+			UnmapFile( file );
+			continue;
+		}
+
+		const int32_t key = TbMaterialKey( material );
+		tablebases->files[ key ] = file;
+		tablebases->entries[ key ] = file.data + sizeof( tbHeader_t );
+		++tableCount;
+	}
+
+	if ( tableCount == 0 )
+	{
+		delete tablebases;
+		return nullptr;
+	}
+	return tablebases;
+}
+
+
+void CloseTablebases( const tablebase_t*& tablebases )
+{
+	if ( tablebases == nullptr ) {
+		return;
+	}
+
+	tablebase_t* owned = const_cast<tablebase_t*>( tablebases );
+	for ( int32_t key = 0; key < TbMaterialKeyCount; ++key )
+	{
+		if ( owned->entries[ key ] != nullptr ) {
+			UnmapFile( owned->files[ key ] );
+		}
+	}
+	delete owned;
+	tablebases = nullptr;
+}
+
+
+bool ChessEngine::ProbeTablebase( tbResult_t& result ) const
+{
+	if ( m_tablebases == nullptr ) {
+		return false;
+	}
+
+	const team_t& white = m_state.GetTeam( teamCode_t::WHITE );
+	const team_t& black = m_state.GetTeam( teamCode_t::BLACK );
+	const int32_t pieceCount = white.livingCount + black.livingCount;
+	if ( pieceCount > TablebaseMaxPieces ) {
+		return false;
+	}
+
+	// The key differs from the bare placement hash only by castling rights or en passant
+	const uint64_t turnKey = ( m_currentTurn == teamCode_t::WHITE ) ? Zobrist.keys[ ZobristTurnOffset ] : 0;
+	if ( GetPositionKey() != ( m_state.GetHash() ^ turnKey ) ) {
+		return false;
+	}
+
+	tbPiece_t pieces[ TablebaseMaxPieces ];
+	int32_t count = 0;
+	for ( int32_t t = 0; t < TeamCount; ++t )
+	{
+		const team_t& team = m_state.m_teams[ t ];
+		for ( int32_t i = 0; i < team.livingCount; ++i )
+		{
+			const Piece* piece = m_state.GetPiece( team.pieces[ i ] );
+			pieces[ count++ ] = tbPiece_t{ piece->team, piece->type, TbSquare( piece->X(), piece->Y() ) };
+		}
+	}
+
+	tbPosition_t position;
+	if ( TbSetup( pieces, count, m_currentTurn, position ) == false ) {
+		return false;
+	}
+
+	const uint8_t* entries = m_tablebases->entries[ TbMaterialKey( position.material ) ];
+	if ( entries == nullptr ) {
+		return false;
+	}
+
+	const uint8_t value = entries[ TbIndex( position ) ];
+	if ( value == TbInvalid ) {
+		return false;
+	}
+
+	if ( value == TbDraw ) {
+		result = tbResult_t{ 0, 0 };
+	} else if ( value < TbLoss ) {
+		result = tbResult_t{ 1, value };
+	} else {
+		result = tbResult_t{ -1, value - TbLoss };
+	}
+	return true;
+}
@@ -0,0 +1,322 @@
+#pragma once
+
+#include "chess.h"
+
+#include <algorithm>
+
+// Endgame tablebase format, shared by the generator (tbgen.cpp) and the probe (tablebase.cpp)
+//
+// One file per material set with the stronger side as white, e.g. "KRvKP.ctb": a tbHeader_t,
+// then one byte per index, from the side to move's point of view:
+//		0			draw
+//		1..127		win, mate in that many plies
+//		128 + n		loss, mated in n plies
+//		255			not a position: illegal, or a symmetric twin of another index
+//
+// Squares run a1 = 0 .. h8 = 63. Pawnless sets fold the board eightfold by moving the white king
+// into the a1-d1-d4 triangle, sets with pawns only mirror files to put it on files a-d.
+//		index = ( ( sideToMove * kingSquares + whiteKing ) * 64 + blackKing ) * 64^extras + extras...
+// Castling rights and en passant captures aren't part of the index.
+
+static const uint32_t TbMagic			= 0x31425443;	// "CTB1"
+static const uint32_t TbVersion			= 1;
+static const int32_t TbMaxExtras		= TablebaseMaxPieces - 2;
+static const int32_t TbStrengthCount	= 5;
+static const int32_t TbMaterialKeyCount	= 6 * 6 * 6 * 6;
+
+static const uint8_t TbDraw				= 0;
+static const uint8_t TbLoss				= 128;
+static const uint8_t TbInvalid			= 255;
+static const int32_t TbMaxWinPlies		= 127;
+static const int32_t TbMaxLossPlies		= 126;
+
+struct tbHeader_t
+{
+	uint32_t		magic;
+	uint32_t		version;
+	char			name[ 8 ];				// Zero padded, e.g. "KRvKP"
+	uint64_t		entryCount;
+};
+
+struct tbMaterial_t
+{
+	int32_t			count[ TeamCount ];
+	pieceType_t		pieces[ TeamCount ][ TbMaxExtras ];		// Kings excluded, strongest first
+};
+
+// Squares in index order: white king, black king, white extras, black extras
+struct tbPosition_t
+{
+	tbMaterial_t	material;
+	int32_t			squares[ TablebaseMaxPieces ];
+	int32_t			sideToMove;
+};
+
+struct tbPiece_t
+{
+	teamCode_t		team;
+	pieceType_t		type;
+	int32_t			square;
+};
+
+static const pieceType_t TbStrengthOrder[ TbStrengthCount ] = { pieceType_t::QUEEN, pieceType_t::ROOK, pieceType_t::BISHOP, pieceType_t::KNIGHT, pieceType_t::PAWN };
+static const int32_t TbStrength[ (int32_t)pieceType_t::COUNT ] = { 4, 1, 3, 2, -1, 0 };		// pieceType_t order, kings aren't ranked
+
+static const int8_t TbTriangle[ 64 ] =
+{
+	 0,  1,  2,  3, -1, -1, -1, -1,
+	-1,  4,  5,  6, -1, -1, -1, -1,
+	-1, -1,  7,  8, -1, -1, -1, -1,
+	-1, -1, -1,  9, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1,
+	-1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+static const int8_t TbTriangleSquares[ 10 ] = { 0, 1, 2, 3, 9, 10, 11, 18, 19, 27 };
+
+
+inline int32_t TbFile( const int32_t square ) { return square & 7; }
+inline int32_t TbRank( const int32_t square ) { return square >> 3; }
+inline int32_t TbTranspose( const int32_t square ) { return ( TbFile( square ) << 3 ) | TbRank( square ); }
+
+// Engine rows run from the black side
+inline int32_t TbSquare( const num_t x, const num_t y ) { return ( ( BoardSize - 1 - y ) << 3 ) | x; }
+
+
+inline bool TbHasPawns( const tbMaterial_t& material )
+{
+	for ( int32_t t = 0; t < TeamCount; ++t )
+	{
+		for ( int32_t i = 0; i < material.count[ t ]; ++i )
+		{
+			if ( material.pieces[ t ][ i ] == pieceType_t::PAWN ) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+
+inline int32_t TbExtraCount( const tbMaterial_t& material )
+{
+	return material.count[ 0 ] + material.count[ 1 ];
+}
+
+
+inline uint64_t TbEntryCount( const tbMaterial_t& material )
+{
+	uint64_t count = 2 * ( TbHasPawns( material ) ? 32 : 10 ) * 64;
+	for ( int32_t i = 0; i < TbExtraCount( material ); ++i ) {
+		count *= 64;
+	}
+	return count;
+}
+
+
+// Dense key for table lookup, 0 = no piece in a slot
+inline int32_t TbMaterialKey( const tbMaterial_t& material )
+{
+	int32_t key = 0;
+	for ( int32_t t = 0; t < TeamCount; ++t )
+	{
+		for ( int32_t i = 0; i < TbMaxExtras; ++i ) {
+			key = key * 6 + ( ( i < material.count[ t ] ) ? ( TbStrength[ (int32_t)material.pieces[ t ][ i ] ] + 1 ) : 0 );
+		}
+	}
+	return key;
+}
+
+
+inline std::string TbMaterialName( const tbMaterial_t& material )
+{
+	static const char Codes[ TbStrengthCount ] = { 'Q', 'R', 'B', 'N', 'P' };
+
+	std::string name;
+	for ( int32_t t = 0; t < TeamCount; ++t )
+	{
+		name += ( t == 0 ) ? "K" : "vK";
+		for ( int32_t i = 0; i < material.count[ t ]; ++i ) {
+			name += Codes[ TbStrength[ (int32_t)material.pieces[ t ][ i ] ] ];
+		}
+	}
+	return name;
+}
+
+
+// More pieces, then the strongest piece first, decides the side stored as white
+inline bool TbWhiteIsStronger( const tbMaterial_t& material )
+{
+	if ( material.count[ 0 ] != material.count[ 1 ] ) {
+		return ( material.count[ 0 ] > material.count[ 1 ] );
+	}
+
+	for ( int32_t i = 0; i < material.count[ 0 ]; ++i )
+	{
+		const int32_t white = TbStrength[ (int32_t)material.pieces[ 0 ][ i ] ];
+		const int32_t black = TbStrength[ (int32_t)material.pieces[ 1 ][ i ] ];
+		if ( white != black ) {
+			return ( white < black );
+		}
+	}
+	return true;
+}
+
+
+// Every 3 and 4 piece set in canonical form
+inline void TbAllMaterials( std::vector< tbMaterial_t >& materials )
+{
+	for ( int32_t a = 0; a < TbStrengthCount; ++a )
+	{
+		tbMaterial_t material = {};
+		material.count[ 0 ] = 1;
+		material.pieces[ 0 ][ 0 ] = TbStrengthOrder[ a ];
+		materials.push_back( material );
+	}
+
+	for ( int32_t a = 0; a < TbStrengthCount; ++a )
+	{
+		for ( int32_t b = a; b < TbStrengthCount; ++b )
+		{
+			tbMaterial_t together = {};
+			together.count[ 0 ] = 2;
+			together.pieces[ 0 ][ 0 ] = TbStrengthOrder[ a ];
+			together.pieces[ 0 ][ 1 ] = TbStrengthOrder[ b ];
+			materials.push_back( together );
+
+			tbMaterial_t opposed = {};
+			opposed.count[ 0 ] = 1;
+			opposed.count[ 1 ] = 1;
+			opposed.pieces[ 0 ][ 0 ] = TbStrengthOrder[ a ];
+			opposed.pieces[ 1 ][ 0 ] = TbStrengthOrder[ b ];
+			materials.push_back( opposed );
+		}
+	}
+}
+
+
+// Sorts a piece list into index order, swapping colors when black holds the stronger side
+inline bool TbSetup( const tbPiece_t* pieces, const int32_t pieceCount, const teamCode_t sideToMove, tbPosition_t& position )
+{
+	if ( ( pieceCount < 2 ) || ( pieceCount > TablebaseMaxPieces ) ) {
+		return false;
+	}
+
+	int32_t kings[ TeamCount ] = { -1, -1 };
+	int32_t extras[ TeamCount ][ TbMaxExtras ] = {};
+	position.material = tbMaterial_t();
+
+	for ( int32_t i = 0; i < pieceCount; ++i )
+	{
+		const int32_t team = static_cast<int32_t>( pieces[ i ].team );
+		if ( pieces[ i ].type == pieceType_t::KING )
+		{
+			kings[ team ] = pieces[ i ].square;
+			continue;
+		}
+
+		int32_t& count = position.material.count[ team ];
+		if ( count >= TbMaxExtras ) {
+			return false;
+		}
+
+		// Insertion by strength
+		int32_t slot = count++;
+		while ( ( slot > 0 ) && ( TbStrength[ (int32_t)position.material.pieces[ team ][ slot - 1 ] ] > TbStrength[ (int32_t)pieces[ i ].type ] ) )
+		{
+			position.material.pieces[ team ][ slot ] = position.material.pieces[ team ][ slot - 1 ];
+			extras[ team ][ slot ] = extras[ team ][ slot - 1 ];
+			--slot;
+		}
+		position.material.pieces[ team ][ slot ] = pieces[ i ].type;
+		extras[ team ][ slot ] = pieces[ i ].square;
+	}
+
+	if ( ( kings[ 0 ] < 0 ) || ( kings[ 1 ] < 0 ) ) {
+		return false;
+	}
+
+	const bool flip = ( TbWhiteIsStronger( position.material ) == false );
+	const int32_t strong = flip ? 1 : 0;
+	const int32_t mirror = flip ? 56 : 0;
+
+	position.sideToMove = static_cast<int32_t>( sideToMove ) ^ strong;
+	position.squares[ 0 ] = kings[ strong ] ^ mirror;
+	position.squares[ 1 ] = kings[ strong ^ 1 ] ^ mirror;
+
+	tbMaterial_t material;
+	int32_t slot = 2;
+	for ( int32_t t = 0; t < TeamCount; ++t )
+	{
+		const int32_t source = t ^ strong;
+		material.count[ t ] = position.material.count[ source ];
+		for ( int32_t i = 0; i < material.count[ t ]; ++i )
+		{
+			material.pieces[ t ][ i ] = position.material.pieces[ source ][ i ];
+			position.squares[ slot++ ] = extras[ source ][ i ] ^ mirror;
+		}
+	}
+	position.material = material;
+	return true;
+}
+
+
+// Identical pieces are interchangeable, keep them in square order
+inline void TbSortIdentical( const tbMaterial_t& material, int32_t squares[ TablebaseMaxPieces ] )
+{
+	for ( int32_t t = 0, slot = 2; t < TeamCount; slot += material.count[ t ], ++t )
+	{
+		if ( ( material.count[ t ] == 2 ) && ( material.pieces[ t ][ 0 ] == material.pieces[ t ][ 1 ] ) && ( squares[ slot ] > squares[ slot + 1 ] ) ) {
+			std::swap( squares[ slot ], squares[ slot + 1 ] );
+		}
+	}
+}
+
+
+inline uint64_t TbIndex( const tbPosition_t& position )
+{
+	const tbMaterial_t& material = position.material;
+	const int32_t pieceCount = 2 + TbExtraCount( material );
+	const bool pawns = TbHasPawns( material );
+
+	int32_t squares[ TablebaseMaxPieces ] = {};
+	int32_t flip = 0;
+	if ( TbFile( position.squares[ 0 ] ) > 3 ) {
+		flip |= 7;
+	}
+	if ( !pawns && ( TbRank( position.squares[ 0 ] ) > 3 ) ) {
+		flip |= 56;
+	}
+	for ( int32_t i = 0; i < pieceCount; ++i ) {
+		squares[ i ] = position.squares[ i ] ^ flip;
+	}
+	TbSortIdentical( material, squares );
+
+	int32_t kingIndex = TbRank( squares[ 0 ] ) * 4 + TbFile( squares[ 0 ] );
+	if ( !pawns )
+	{
+		int32_t transposed[ TablebaseMaxPieces ] = {};
+		for ( int32_t i = 0; i < pieceCount; ++i ) {
+			transposed[ i ] = TbTranspose( squares[ i ] );
+		}
+		TbSortIdentical( material, transposed );
+
+		// Below the a1-h8 diagonal. A king on it maps to itself, then the smaller twin decides
+		bool transpose = ( TbRank( squares[ 0 ] ) > TbFile( squares[ 0 ] ) );
+		if ( TbRank( squares[ 0 ] ) == TbFile( squares[ 0 ] ) ) {
+			transpose = std::lexicographical_compare( transposed + 1, transposed + pieceCount, squares + 1, squares + pieceCount );
+		}
+		if ( transpose ) {
+			memcpy( squares, transposed, sizeof( squares ) );
+		}
+		kingIndex = TbTriangle[ squares[ 0 ] ];
+	}
+
+	uint64_t index = static_cast<uint64_t>( position.sideToMove ) * ( pawns ? 32 : 10 ) + kingIndex;
+	for ( int32_t i = 1; i < pieceCount; ++i ) {
+		index = index * 64 + squares[ i ];
+	}
+	return index;
+}
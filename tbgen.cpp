@@ -0,0 +1,857 @@
+// Endgame tablebase generator for up to four pieces.
+//
+// Usage:	tbgen <directory> [-t threads] [material ...]
+//
+// Material sets are written like "KQvKR" or "KPvK", all 3 and 4 piece sets when none are given.
+// Tables a set depends on through captures and promotions are generated first, or loaded when
+// their file already exists in the directory. See tablebase.h for the file format.
+//
+// Retrograde analysis, ply by ply: checkmates are losses at 0. Pass n marks the unresolved
+// predecessors of losses at n - 1 as wins at n, and verifies the predecessors of wins at n - 1,
+// which are losses at n once every move runs into a win. Captures and promotions leave the table,
+// their values come from the smaller tables and are folded in as fixed exits. Whatever is left
+// unresolved at the end is a draw. Each pass splits the index range across the threads.
+//
+// Excluded from the Visual Studio project, CMake builds it as the tbgen target linked against
+// the chess library. Everything it calls is inline in the headers, so it also builds on its own:
+//		g++ -std=c++17 -O2 -pthread tbgen.cpp -o tbgen
+//		cl /std:c++17 /O2 /EHsc tbgen.cpp
+
+#include "chess.h"
+#include "tablebase.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <thread>
+
+static const int32_t BlockSize			= 1 << 14;		// Indices per work item
+static const int32_t MaxTargets			= 28;
+static const uint8_t NoExit				= 0;
+static const uint8_t ExitBlocksLoss		= 255;			// An exit that isn't a loss, the position can't be lost
+
+static const int32_t KingSteps[ 8 ][ 2 ]	= { { 1, 0 }, { -1, 0 }, { 0, 1 }, { 0, -1 }, { 1, 1 }, { 1, -1 }, { -1, 1 }, { -1, -1 } };
+static const int32_t KnightSteps[ 8 ][ 2 ]	= { { 1, 2 }, { 2, 1 }, { 2, -1 }, { 1, -2 }, { -1, -2 }, { -2, -1 }, { -2, 1 }, { -1, 2 } };
+
+struct genBoard_t
+{
+	int32_t			squares[ TablebaseMaxPieces ];		// Index order, -1 once captured
+	int8_t			occupant[ 64 ];						// Slot + 1, 0 when empty
+	int32_t			sideToMove;
+};
+
+struct genMove_t
+{
+	int32_t			slot;
+	int32_t			to;
+	int32_t			captured;			// Slot, -1 for none
+	pieceType_t		promotion;
+};
+
+struct genTable_t
+{
+	tbMaterial_t	material;
+	int32_t			pieceCount;
+	int32_t			team[ TablebaseMaxPieces ];
+	pieceType_t		type[ TablebaseMaxPieces ];
+	bool			pawns;
+	uint64_t		entryCount;
+
+	std::unique_ptr< std::atomic< uint8_t >[] >	value;		// Final encoding, 0 while unresolved
+	std::unique_ptr< std::atomic< uint8_t >[] >	pending;	// Loss scheduled for a later pass
+	std::vector< uint8_t >		winExit;					// Shortest win through an exit, 0 for none
+	std::vector< uint8_t >		lossFloor;					// Loss distance the exits force, or NoExit / ExitBlocksLoss
+	std::atomic< int32_t >		lastScheduled;
+	std::atomic< bool >			overflow;
+};
+
+static std::map< int32_t, std::vector< uint8_t > > LoadedTables;	// Finished tables by TbMaterialKey()
+static int32_t ThreadCount = 1;
+
+
+static inline bool IsWin( const uint8_t value ) { return ( value != TbDraw ) && ( value < TbLoss ); }
+static inline bool IsLoss( const uint8_t value ) { return ( value >= TbLoss ) && ( value != TbInvalid ); }
+static inline int32_t PlyOf( const uint8_t value ) { return ( value < TbLoss ) ? value : ( value - TbLoss ); }
+
+
+static void ParallelFor( const uint64_t count, const std::function< void( uint64_t, uint64_t ) >& work )
+{
+	std::atomic< uint64_t > next( 0 );
+	std::vector< std::thread > threads;
+	for ( int32_t t = 0; t < ThreadCount; ++t )
+	{
+		threads.emplace_back( [ & ]()
+		{
+			for ( ;; )
+			{
+				const uint64_t first = next.fetch_add( BlockSize );
+				if ( first >= count ) {
+					break;
+				}
+				work( first, std::min( first + BlockSize, count ) );
+			}
+		} );
+	}
+	for ( std::thread& thread : threads ) {
+		thread.join();
+	}
+}
+
+
+static void SetupTable( const tbMaterial_t& material, genTable_t& table )
+{
+	table.material = material;
+	table.pieceCount = 2 + TbExtraCount( material );
+	table.pawns = TbHasPawns( material );
+	table.entryCount = TbEntryCount( material );
+	table.lastScheduled = 0;
+	table.overflow = false;
+
+	table.team[ 0 ] = 0;
+	table.team[ 1 ] = 1;
+	table.type[ 0 ] = pieceType_t::KING;
+	table.type[ 1 ] = pieceType_t::KING;
+
+	int32_t slot = 2;
+	for ( int32_t t = 0; t < TeamCount; ++t )
+	{
+		for ( int32_t i = 0; i < material.count[ t ]; ++i )
+		{
+			table.team[ slot ] = t;
+			table.type[ slot ] = material.pieces[ t ][ i ];
+			++slot;
+		}
+	}
+}
+
+
+static void Decode( const genTable_t& table, uint64_t index, genBoard_t& board )
+{
+	for ( int32_t slot = table.pieceCount - 1; slot >= 1; --slot )
+	{
+		board.squares[ slot ] = static_cast<int32_t>( index & 63 );
+		index >>= 6;
+	}
+
+	const int32_t kingSquares = table.pawns ? 32 : 10;
+	const int32_t king = static_cast<int32_t>( index % kingSquares );
+	board.squares[ 0 ] = table.pawns ? ( ( king / 4 ) * 8 + ( king % 4 ) ) : TbTriangleSquares[ king ];
+	board.sideToMove = static_cast<int32_t>( index / kingSquares );
+
+	memset( board.occupant, 0, sizeof( board.occupant ) );
+	for ( int32_t slot = 0; slot < table.pieceCount; ++slot ) {
+		board.occupant[ board.squares[ slot ] ] = static_cast<int8_t>( slot + 1 );
+	}
+}
+
+
+static uint64_t IndexOf( const genTable_t& table, const genBoard_t& board )
+{
+	tbPosition_t position;
+	position.material = table.material;
+	position.sideToMove = board.sideToMove;
+	for ( int32_t slot = 0; slot < table.pieceCount; ++slot ) {
+		position.squares[ slot ] = board.squares[ slot ];
+	}
+	return TbIndex( position );
+}
+
+
+static bool Attacks( const genTable_t& table, const genBoard_t& board, const int32_t slot, const int32_t target )
+{
+	const int32_t from = board.squares[ slot ];
+	const int32_t fileStep = TbFile( target ) - TbFile( from );
+	const int32_t rankStep = TbRank( target ) - TbRank( from );
+	const int32_t fileDistance = abs( fileStep );
+	const int32_t rankDistance = abs( rankStep );
+
+	switch ( table.type[ slot ] )
+	{
+	case pieceType_t::KING:
+		return ( std::max( fileDistance, rankDistance ) == 1 );
+	case pieceType_t::KNIGHT:
+		return ( fileDistance * rankDistance == 2 );
+	case pieceType_t::PAWN:
+		return ( fileDistance == 1 ) && ( rankStep == ( ( table.team[ slot ] == 0 ) ? 1 : -1 ) );
+	default:
+		break;
+	}
+
+	const bool straight = ( fileDistance == 0 ) || ( rankDistance == 0 );
+	const bool diagonal = ( fileDistance == rankDistance );
+	const pieceType_t type = table.type[ slot ];
+	if ( ( from == target ) ||
+		 ( straight && ( type != pieceType_t::ROOK ) && ( type != pieceType_t::QUEEN ) ) ||
+		 ( diagonal && ( type != pieceType_t::BISHOP ) && ( type != pieceType_t::QUEEN ) ) ||
+		 ( !straight && !diagonal ) ) {
+		return false;
+	}
+
+	const int32_t step = ( ( rankStep > 0 ) - ( rankStep < 0 ) ) * 8 + ( ( fileStep > 0 ) - ( fileStep < 0 ) );
+	for ( int32_t square = from + step; square != target; square += step )
+	{
+		if ( board.occupant[ square ] != 0 ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+
+static bool IsAttacked( const genTable_t& table, const genBoard_t& board, const int32_t square, const int32_t byTeam )
+{
+	for ( int32_t slot = 0; slot < table.pieceCount; ++slot )
+	{
+		if ( ( table.team[ slot ] == byTeam ) && ( board.squares[ slot ] >= 0 ) && Attacks( table, board, slot, square ) ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+static bool IsLegalPosition( const genTable_t& table, const genBoard_t& board )
+{
+	for ( int32_t slot = 0; slot < table.pieceCount; ++slot )
+	{
+		const int32_t square = board.squares[ slot ];
+		if ( board.occupant[ square ] != slot + 1 ) {
+			return false;	// Shares a square
+		}
+		if ( ( table.type[ slot ] == pieceType_t::PAWN ) && ( ( TbRank( square ) == 0 ) || ( TbRank( square ) == 7 ) ) ) {
+			return false;
+		}
+	}
+
+	// The side that just moved can't be in check, this also keeps the kings apart
+	const int32_t waiting = board.sideToMove ^ 1;
+	return !IsAttacked( table, board, board.squares[ waiting ], board.sideToMove );
+}
+
+
+// Step and slide targets of a non-pawn, empty squares plus enemy pieces when captures are wanted
+static int32_t PieceTargets( const genTable_t& table, const genBoard_t& board, const int32_t slot, const bool captures, int32_t targets[ MaxTargets ] )
+{
+	const pieceType_t type = table.type[ slot ];
+	const int32_t from = board.squares[ slot ];
+	const bool slides = ( type == pieceType_t::ROOK ) || ( type == pieceType_t::BISHOP ) || ( type == pieceType_t::QUEEN );
+	const int32_t ( *steps )[ 2 ] = ( type == pieceType_t::KNIGHT ) ? KnightSteps : KingSteps;
+	const int32_t firstStep = ( type == pieceType_t::BISHOP ) ? 4 : 0;
+	const int32_t lastStep = ( type == pieceType_t::ROOK ) ? 4 : 8;
+
+	int32_t targetCount = 0;
+	for ( int32_t s = firstStep; s < lastStep; ++s )
+	{
+		int32_t file = TbFile( from );
+		int32_t rank = TbRank( from );
+		for ( ;; )
+		{
+			file += steps[ s ][ 0 ];
+			rank += steps[ s ][ 1 ];
+			if ( ( file < 0 ) || ( file > 7 ) || ( rank < 0 ) || ( rank > 7 ) ) {
+				break;
+			}
+
+			const int32_t square = rank * 8 + file;
+			const int32_t occupant = board.occupant[ square ] - 1;
+			if ( occupant >= 0 )
+			{
+				if ( captures && ( table.team[ occupant ] != table.team[ slot ] ) && ( table.type[ occupant ] != pieceType_t::KING ) ) {
+					targets[ targetCount++ ] = square;
+				}
+				break;
+			}
+
+			targets[ targetCount++ ] = square;
+			if ( !slides ) {
+				break;
+			}
+		}
+	}
+	return targetCount;
+}
+
+
+static int32_t GenerateMoves( const genTable_t& table, const genBoard_t& board, genMove_t moves[ MaxMoves ] )
+{
+	static const pieceType_t PromotionTypes[] = { pieceType_t::QUEEN, pieceType_t::ROOK, pieceType_t::BISHOP, pieceType_t::KNIGHT };
+
+	int32_t moveCount = 0;
+	for ( int32_t slot = 0; slot < table.pieceCount; ++slot )
+	{
+		if ( table.team[ slot ] != board.sideToMove ) {
+			continue;
+		}
+
+		int32_t targets[ MaxTargets ];
+		int32_t targetCount = 0;
+		const int32_t from = board.squares[ slot ];
+
+		if ( table.type[ slot ] == pieceType_t::PAWN )
+		{
+			const int32_t forward = ( table.team[ slot ] == 0 ) ? 8 : -8;
+			const int32_t startRank = ( table.team[ slot ] == 0 ) ? 1 : 6;
+			if ( board.occupant[ from + forward ] == 0 )
+			{
+				targets[ targetCount++ ] = from + forward;
+				if ( ( TbRank( from ) == startRank ) && ( board.occupant[ from + 2 * forward ] == 0 ) ) {
+					targets[ targetCount++ ] = from + 2 * forward;
+				}
+			}
+			for ( int32_t side = -1; side <= 1; side += 2 )
+			{
+				const int32_t file = TbFile( from ) + side;
+				const int32_t occupant = ( ( file >= 0 ) && ( file <= 7 ) ) ? ( board.occupant[ from + forward + side ] - 1 ) : -1;
+				if ( ( occupant >= 0 ) && ( table.team[ occupant ] != table.team[ slot ] ) && ( table.type[ occupant ] != pieceType_t::KING ) ) {
+					targets[ targetCount++ ] = from + forward + side;
+				}
+			}
+		}
+		else
+		{
+			targetCount = PieceTargets( table, board, slot, true, targets );
+		}
+
+		for ( int32_t t = 0; t < targetCount; ++t )
+		{
+			const int32_t to = targets[ t ];
+			const genMove_t move = { slot, to, board.occupant[ to ] - 1, pieceType_t::NONE };
+
+			// Legal when the own king isn't attacked afterwards
+			genBoard_t after = board;
+			if ( move.captured >= 0 ) {
+				after.squares[ move.captured ] = -1;
+			}
+			after.occupant[ from ] = 0;
+			after.occupant[ to ] = static_cast<int8_t>( slot + 1 );
+			after.squares[ slot ] = to;
+			if ( IsAttacked( table, after, after.squares[ board.sideToMove ], board.sideToMove ^ 1 ) ) {
+				continue;
+			}
+
+			if ( ( table.type[ slot ] == pieceType_t::PAWN ) && ( ( TbRank( to ) == 0 ) || ( TbRank( to ) == 7 ) ) )
+			{
+				for ( const pieceType_t promotion : PromotionTypes ) {
+					moves[ moveCount++ ] = genMove_t{ slot, to, move.captured, promotion };
+				}
+			}
+			else
+			{
+				moves[ moveCount++ ] = move;
+			}
+		}
+	}
+	return moveCount;
+}
+
+
+static void ApplyMove( const genBoard_t& board, const genMove_t& move, genBoard_t& after )
+{
+	after = board;
+	if ( move.captured >= 0 ) {
+		after.squares[ move.captured ] = -1;
+	}
+	after.occupant[ board.squares[ move.slot ] ] = 0;
+	after.occupant[ move.to ] = static_cast<int8_t>( move.slot + 1 );
+	after.squares[ move.slot ] = move.to;
+	after.sideToMove = board.sideToMove ^ 1;
+}
+
+
+// Value of a capture or promotion from the smaller table, for the side to move after it
+static uint8_t ExitValue( const genTable_t& table, const genBoard_t& after, const genMove_t& move )
+{
+	tbPiece_t pieces[ TablebaseMaxPieces ];
+	int32_t count = 0;
+	for ( int32_t slot = 0; slot < table.pieceCount; ++slot )
+	{
+		if ( after.squares[ slot ] < 0 ) {
+			continue;
+		}
+		const pieceType_t type = ( ( slot == move.slot ) && ( move.promotion != pieceType_t::NONE ) ) ? move.promotion : table.type[ slot ];
+		pieces[ count++ ] = tbPiece_t{ static_cast<teamCode_t>( table.team[ slot ] ), type, after.squares[ slot ] };
+	}
+
+	// Bare kings
+	if ( count == 2 ) {
+		return TbDraw;
+	}
+
+	tbPosition_t position;
+	TbSetup( pieces, count, static_cast<teamCode_t>( after.sideToMove ), position );
+	return LoadedTables.at( TbMaterialKey( position.material ) )[ TbIndex( position ) ];
+}
+
+
+static void ScheduleAt( genTable_t& table, const int32_t ply )
+{
+	int32_t scheduled = table.lastScheduled.load();
+	while ( ( ply > scheduled ) && !table.lastScheduled.compare_exchange_weak( scheduled, ply ) ) {}
+}
+
+
+static void InitEntry( genTable_t& table, const uint64_t index )
+{
+	table.value[ index ] = TbInvalid;
+	table.pending[ index ] = 0;
+	table.winExit[ index ] = 0;
+	table.lossFloor[ index ] = NoExit;
+
+	genBoard_t board;
+	Decode( table, index, board );
+	if ( !IsLegalPosition( table, board ) || ( IndexOf( table, board ) != index ) ) {
+		return;
+	}
+	table.value[ index ] = TbDraw;
+
+	genMove_t moves[ MaxMoves ];
+	const int32_t moveCount = GenerateMoves( table, board, moves );
+	if ( moveCount == 0 )
+	{
+		if ( IsAttacked( table, board, board.squares[ board.sideToMove ], board.sideToMove ^ 1 ) ) {
+			table.value[ index ] = TbLoss;
+		} else {
+			table.lossFloor[ index ] = ExitBlocksLoss;		// Stalemate
+		}
+		return;
+	}
+
+	int32_t internalCount = 0;
+	int32_t winExit = 0;
+	int32_t lossFloor = NoExit;
+
+	for ( int32_t i = 0; i < moveCount; ++i )
+	{
+		if ( ( moves[ i ].captured < 0 ) && ( moves[ i ].promotion == pieceType_t::NONE ) )
+		{
+			++internalCount;
+			continue;
+		}
+
+		genBoard_t after;
+		ApplyMove( board, moves[ i ], after );
+		const uint8_t value = ExitValue( table, after, moves[ i ] );
+
+		if ( IsLoss( value ) )
+		{
+			const int32_t ply = PlyOf( value ) + 1;
+			winExit = ( winExit == 0 ) ? ply : std::min( winExit, ply );
+			lossFloor = ExitBlocksLoss;
+		}
+		else if ( IsWin( value ) && ( lossFloor != ExitBlocksLoss ) )
+		{
+			lossFloor = std::max( lossFloor, PlyOf( value ) + 1 );
+		}
+		else
+		{
+			lossFloor = ExitBlocksLoss;
+		}
+	}
+
+	table.winExit[ index ] = static_cast<uint8_t>( winExit );
+	table.lossFloor[ index ] = static_cast<uint8_t>( lossFloor );
+
+	if ( winExit > 0 ) {
+		ScheduleAt( table, winExit );
+	} else if ( ( internalCount == 0 ) && ( lossFloor != ExitBlocksLoss ) ) {
+		table.pending[ index ] = static_cast<uint8_t>( lossFloor );
+		ScheduleAt( table, lossFloor );
+	}
+}
+
+
+// Lost when every move runs into a win, the distance is one past the longest of them
+static bool CheckLoss( genTable_t& table, const genBoard_t& board, const uint64_t index, const int32_t ply )
+{
+	const uint8_t lossFloor = table.lossFloor[ index ];
+	if ( lossFloor == ExitBlocksLoss ) {
+		return false;
+	}
+
+	int32_t lossPly = lossFloor;
+
+	genMove_t moves[ MaxMoves ];
+	const int32_t moveCount = GenerateMoves( table, board, moves );
+	for ( int32_t i = 0; i < moveCount; ++i )
+	{
+		if ( ( moves[ i ].captured >= 0 ) || ( moves[ i ].promotion != pieceType_t::NONE ) ) {
+			continue;
+		}
+
+		genBoard_t after;
+		ApplyMove( board, moves[ i ], after );
+		const uint8_t value = table.value[ IndexOf( table, after ) ].load( std::memory_order_relaxed );
+		if ( !IsWin( value ) ) {
+			return false;
+		}
+		lossPly = std::max( lossPly, PlyOf( value ) + 1 );
+	}
+
+	if ( lossPly > TbMaxLossPlies )
+	{
+		table.overflow = true;
+		return false;
+	}
+
+	if ( lossPly <= ply )
+	{
+		table.value[ index ].store( static_cast<uint8_t>( TbLoss + ply ), std::memory_order_relaxed );
+		return true;
+	}
+
+	table.pending[ index ].store( static_cast<uint8_t>( lossPly ), std::memory_order_relaxed );
+	ScheduleAt( table, lossPly );
+	return false;
+}
+
+
+// Positions one move before this one, never captures or promotions since those change the material
+static void VisitPredecessors( genTable_t& table, const genBoard_t& board, const int32_t ply, const bool fromLoss, std::atomic< bool >& changed )
+{
+	const int32_t mover = board.sideToMove ^ 1;
+
+	for ( int32_t slot = 0; slot < table.pieceCount; ++slot )
+	{
+		if ( table.team[ slot ] != mover ) {
+			continue;
+		}
+
+		int32_t origins[ MaxTargets ];
+		int32_t originCount = 0;
+		const int32_t square = board.squares[ slot ];
+
+		if ( table.type[ slot ] == pieceType_t::PAWN )
+		{
+			const int32_t back = ( mover == 0 ) ? -8 : 8;
+			const int32_t rank = TbRank( square );
+			const int32_t singleRank = ( mover == 0 ) ? 2 : 5;		// Furthest back a single step can land
+			const int32_t doubleRank = ( mover == 0 ) ? 3 : 4;
+
+			const bool canStep = ( mover == 0 ) ? ( rank >= singleRank ) : ( rank <= singleRank );
+			if ( canStep && ( board.occupant[ square + back ] == 0 ) ) {
+				origins[ originCount++ ] = square + back;
+			}
+			if ( ( rank == doubleRank ) && ( board.occupant[ square + back ] == 0 ) && ( board.occupant[ square + 2 * back ] == 0 ) ) {
+				origins[ originCount++ ] = square + 2 * back;
+			}
+		}
+		else
+		{
+			originCount = PieceTargets( table, board, slot, false, origins );
+		}
+
+		for ( int32_t o = 0; o < originCount; ++o )
+		{
+			genBoard_t before = board;
+			before.occupant[ square ] = 0;
+			before.occupant[ origins[ o ] ] = static_cast<int8_t>( slot + 1 );
+			before.squares[ slot ] = origins[ o ];
+			before.sideToMove = mover;
+
+			// The side to move here must not have been left in check
+			if ( IsAttacked( table, before, before.squares[ board.sideToMove ], mover ) ) {
+				continue;
+			}
+
+			const uint64_t index = IndexOf( table, before );
+			if ( table.value[ index ].load( std::memory_order_relaxed ) != TbDraw ) {
+				continue;
+			}
+
+			if ( fromLoss )
+			{
+				table.value[ index ].store( static_cast<uint8_t>( ply ), std::memory_order_relaxed );
+				changed = true;
+			}
+			else if ( CheckLoss( table, before, index, ply ) )
+			{
+				changed = true;
+			}
+		}
+	}
+}
+
+
+static void RetroPass( genTable_t& table, const uint64_t first, const uint64_t last, const int32_t ply, std::atomic< bool >& changed )
+{
+	for ( uint64_t index = first; index < last; ++index )
+	{
+		const uint8_t value = table.value[ index ].load( std::memory_order_relaxed );
+		if ( value == TbDraw )
+		{
+			if ( table.winExit[ index ] == ply )
+			{
+				table.value[ index ].store( static_cast<uint8_t>( ply ), std::memory_order_relaxed );
+				changed = true;
+			}
+			else if ( table.pending[ index ].load( std::memory_order_relaxed ) == ply )
+			{
+				table.value[ index ].store( static_cast<uint8_t>( TbLoss + ply ), std::memory_order_relaxed );
+				changed = true;
+			}
+			continue;
+		}
+
+		if ( ( value == TbInvalid ) || ( PlyOf( value ) != ply - 1 ) ) {
+			continue;
+		}
+
+		genBoard_t board;
+		Decode( table, index, board );
+		VisitPredecessors( table, board, ply, IsLoss( value ), changed );
+	}
+}
+
+
+static bool WriteTable( const std::string& fileName, const genTable_t& table, const std::vector< uint8_t >& entries )
+{
+	tbHeader_t header = {};
+	header.magic = TbMagic;
+	header.version = TbVersion;
+	header.entryCount = table.entryCount;
+	const std::string name = TbMaterialName( table.material );
+	memcpy( header.name, name.c_str(), std::min( name.size(), sizeof( header.name ) ) );
+
+	std::ofstream file( fileName, std::ios::binary );
+	file.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+	file.write( reinterpret_cast<const char*>( entries.data() ), entries.size() );
+	return file.good();
+}
+
+
+static bool LoadTable( const std::string& fileName, const tbMaterial_t& material )
+{
+	std::ifstream file( fileName, std::ios::binary );
+	if ( !file.good() ) {
+		return false;
+	}
+
+	tbHeader_t header;
+	file.read( reinterpret_cast<char*>( &header ), sizeof( header ) );
+	if ( !file.good() || ( header.magic != TbMagic ) || ( header.version != TbVersion ) || ( header.entryCount != TbEntryCount( material ) ) ) {
+		return false;
+	}
+
+	std::vector< uint8_t > entries( header.entryCount );
+	file.read( reinterpret_cast<char*>( entries.data() ), entries.size() );
+	if ( !file.good() ) {
+		return false;
+	}
+
+	LoadedTables[ TbMaterialKey( material ) ] = std::move( entries );
+	return true;
+}
+
+
+static bool Generate( const std::string& directory, const tbMaterial_t& material )
+{
+	const auto start = std::chrono::steady_clock::now();
+	const std::string name = TbMaterialName( material );
+
+	genTable_t table;
+	SetupTable( material, table );
+	table.value.reset( new std::atomic< uint8_t >[ table.entryCount ] );
+	table.pending.reset( new std::atomic< uint8_t >[ table.entryCount ] );
+	table.winExit.resize( table.entryCount );
+	table.lossFloor.resize( table.entryCount );
+
+	ParallelFor( table.entryCount, [ & ]( const uint64_t first, const uint64_t last )
+	{
+		for ( uint64_t index = first; index < last; ++index ) {
+			InitEntry( table, index );
+		}
+	} );
+
+	int32_t ply = 1;
+	for ( ;; ++ply )
+	{
+		std::atomic< bool > changed( false );
+		ParallelFor( table.entryCount, [ & ]( const uint64_t first, const uint64_t last ) {
+			RetroPass( table, first, last, ply, changed );
+		} );
+
+		if ( ( changed == false ) && ( ply >= table.lastScheduled ) ) {
+			break;
+		}
+		if ( ( ply >= TbMaxWinPlies ) || table.overflow )
+		{
+			printf( "%s: distances past %d plies don't fit the format\n", name.c_str(), TbMaxWinPlies );
+			return false;
+		}
+	}
+
+	std::vector< uint8_t > entries( table.entryCount );
+	uint64_t counts[ 3 ] = {};		// Win, draw, loss
+	int32_t longest = 0;
+	for ( uint64_t index = 0; index < table.entryCount; ++index )
+	{
+		const uint8_t value = table.value[ index ];
+		entries[ index ] = value;
+		if ( value == TbInvalid ) {
+			continue;
+		}
+		++counts[ IsWin( value ) ? 0 : ( ( value == TbDraw ) ? 1 : 2 ) ];
+		longest = std::max( longest, PlyOf( value ) );
+	}
+
+	if ( WriteTable( directory + "/" + name + ".ctb", table, entries ) == false )
+	{
+		printf( "Unable to write %s\n", name.c_str() );
+		return false;
+	}
+
+	const double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+	printf( "%s: %llu wins, %llu draws, %llu losses, longest mate %d plies, %d passes (%.1fs)\n", name.c_str(),
+		(unsigned long long)counts[ 0 ], (unsigned long long)counts[ 1 ], (unsigned long long)counts[ 2 ], longest, ply, seconds );
+
+	LoadedTables[ TbMaterialKey( material ) ] = std::move( entries );
+	return true;
+}
+
+
+// Generates or loads a set after everything it can capture or promote into
+static bool Require( const std::string& directory, const tbMaterial_t& material )
+{
+	if ( ( TbExtraCount( material ) == 0 ) || ( LoadedTables.count( TbMaterialKey( material ) ) != 0 ) ) {
+		return true;
+	}
+
+	tbPiece_t pieces[ TablebaseMaxPieces ];
+	int32_t count = 0;
+	for ( int32_t t = 0; t < TeamCount; ++t )
+	{
+		pieces[ count++ ] = tbPiece_t{ static_cast<teamCode_t>( t ), pieceType_t::KING, 0 };
+		for ( int32_t i = 0; i < material.count[ t ]; ++i ) {
+			pieces[ count++ ] = tbPiece_t{ static_cast<teamCode_t>( t ), material.pieces[ t ][ i ], 0 };
+		}
+	}
+
+	for ( int32_t i = 0; i < count; ++i )
+	{
+		if ( pieces[ i ].type == pieceType_t::KING ) {
+			continue;
+		}
+
+		tbPiece_t smaller[ TablebaseMaxPieces ];
+		int32_t smallerCount = 0;
+		for ( int32_t j = 0; j < count; ++j )
+		{
+			if ( j != i ) {
+				smaller[ smallerCount++ ] = pieces[ j ];
+			}
+		}
+
+		tbPosition_t position;
+		TbSetup( smaller, smallerCount, teamCode_t::WHITE, position );
+		if ( !Require( directory, position.material ) ) {
+			return false;
+		}
+
+		if ( pieces[ i ].type != pieceType_t::PAWN ) {
+			continue;
+		}
+
+		for ( const pieceType_t promotion : { pieceType_t::QUEEN, pieceType_t::ROOK, pieceType_t::BISHOP, pieceType_t::KNIGHT } )
+		{
+			tbPiece_t promoted[ TablebaseMaxPieces ];
+			memcpy( promoted, pieces, sizeof( promoted ) );
+			promoted[ i ].type = promotion;
+
+			TbSetup( promoted, count, teamCode_t::WHITE, position );
+			if ( !Require( directory, position.material ) ) {
+				return false;
+			}
+		}
+	}
+
+	const std::string name = TbMaterialName( material );
+	if ( LoadTable( directory + "/" + name + ".ctb", material ) )
+	{
+		printf( "%s: loaded\n", name.c_str() );
+		return true;
+	}
+	return Generate( directory, material );
+}
+
+
+static bool ParseMaterial( const std::string& text, tbMaterial_t& material )
+{
+	tbPiece_t pieces[ TablebaseMaxPieces ];
+	int32_t count = 0;
+	int32_t team = -1;
+
+	for ( const char c : text )
+	{
+		pieceType_t type = pieceType_t::NONE;
+		switch ( toupper( c ) )
+		{
+		case 'K': type = pieceType_t::KING; ++team; break;
+		case 'Q': type = pieceType_t::QUEEN; break;
+		case 'R': type = pieceType_t::ROOK; break;
+		case 'B': type = pieceType_t::BISHOP; break;
+		case 'N': type = pieceType_t::KNIGHT; break;
+		case 'P': type = pieceType_t::PAWN; break;
+		case 'V': continue;
+		default: return false;
+		}
+
+		if ( ( team < 0 ) || ( team >= TeamCount ) || ( count >= TablebaseMaxPieces ) ) {
+			return false;
+		}
+		pieces[ count++ ] = tbPiece_t{ static_cast<teamCode_t>( team ), type, 0 };
+	}
+
+	tbPosition_t position;
+	if ( ( team != 1 ) || !TbSetup( pieces, count, teamCode_t::WHITE, position ) ) {
+		return false;
+	}
+	material = position.material;
+	return true;
+}
+
+
+int main( int argc, char** argv )
+{
+	if ( argc < 2 )
+	{
+		printf( "Usage: tbgen <directory> [-t threads] [material ...]\n" );
+		return 1;
+	}
+
+	const std::string directory = argv[ 1 ];
+	ThreadCount = std::max( static_cast<int32_t>( std::thread::hardware_concurrency() ), 1 );
+
+	std::vector< tbMaterial_t > materials;
+	for ( int32_t i = 2; i < argc; ++i )
+	{
+		if ( ( strcmp( argv[ i ], "-t" ) == 0 ) && ( i + 1 < argc ) )
+		{
+			ThreadCount = std::max( atoi( argv[ ++i ] ), 1 );
+			continue;
+		}
+
+		tbMaterial_t material;
+		if ( ParseMaterial( argv[ i ], material ) == false )
+		{
+			printf( "Unknown material set %s\n", argv[ i ] );
+			return 1;
+		}
+		materials.push_back( material );
+	}
+
+	if ( materials.empty() ) {
+		TbAllMaterials( materials );
+	}
+
+	for ( const tbMaterial_t& material : materials )
+	{
+		if ( Require( directory, material ) == false ) {
+			return 1;
+		}
+	}
+	return 0;
+}
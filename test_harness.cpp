@@ -1,4 +1,4 @@
-#include "Chess.h"
+#include "chess.h"
 
 #include <iostream>
 #include <fstream>
@@ -10,6 +10,10 @@
 #include <functional>
 #include <sstream>
 #include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 
 #include "timer.h"
 
@@ -51,6 +55,7 @@ struct TestCase
 	resultCode_t					expectedOutcome;	// RESULT_SUCCESS = game in progress, or a RESULT_GAME_COMPLETE_* flag
 	std::vector< MoveExpectation >	moveExpectations;
 	std::vector< PieceExpectation >	pieceExpectations;
+	std::function< bool( ChessEngine&, std::string& ) >	check = nullptr;	// Optional, runs after the commands, before the expectations, and appends to the details on failure
 };
 
 
@@ -227,7 +232,16 @@ static TestResult RunSingleTest( const TestCase& tc )
 		}
 	}
 
-	result.averageMoveTimer /= static_cast<float>( result.totalMoves );
+	if ( result.totalMoves > 0 )
+	{
+		result.averageMoveTimer /= static_cast<float>( result.totalMoves );
+	}
+
+	// Engine checks, before the expectations so they see what the check played
+	if ( tc.check && !tc.check( engine, result.details ) )
+	{
+		result.passed = false;
+	}
 
 	// Check final outcome
 	const resultCode_t actualOutcome = ( lastResult & RESULT_GAME_COMPLETE ) ? lastResult : RESULT_SUCCESS;
@@ -304,205 +318,1730 @@ static TestResult RunSingleTest( const TestCase& tc )
 		}
 	}
 
-	return result;
-}
+	return result;
+}
+
+
+// ============================================================
+// Engine checks
+// ============================================================
+
+// Sets the engine up from a FEN, nullptr keeps the board the test loaded
+static bool LoadFen( ChessEngine& engine, const char* fen, std::string& details )
+{
+	if ( ( fen != nullptr ) && !engine.InitFromFen( fen ) )
+	{
+		details += "  Could not load '" + std::string( fen ) + "'\n";
+		return false;
+	}
+	return true;
+}
+
+static bool CheckPerft( ChessEngine& engine, const char* fen, const int32_t depth, const uint64_t expected, std::string& details )
+{
+	if ( !LoadFen( engine, fen, details ) ) {
+		return false;
+	}
+
+	const uint64_t nodes = engine.Perft( depth );
+	if ( nodes != expected )
+	{
+		details += "  Perft( " + std::to_string( depth ) + " ): expected " + std::to_string( expected ) + ", got " + std::to_string( nodes ) + "\n";
+		return false;
+	}
+	return true;
+}
+
+
+// Plays coordinate moves from a FEN, the last must end the game with the expected result
+static bool CheckGameEnd( ChessEngine& engine, const char* fen, const std::vector< std::string >& moves, const resultCode_t expected, std::string& details )
+{
+	if ( !LoadFen( engine, fen, details ) ) {
+		return false;
+	}
+
+	for ( size_t i = 0; i < moves.size(); ++i )
+	{
+		const resultCode_t result = engine.ExecuteMove( engine.ParseMoveString( moves[ i ] ) );
+		const resultCode_t wanted = ( i + 1 == moves.size() ) ? expected : RESULT_SUCCESS;
+		if ( result != wanted )
+		{
+			details += "  Move '" + moves[ i ] + "': expected ";
+			details += ( wanted == RESULT_SUCCESS ) ? "SUCCESS" : GetErrorMsg( wanted );
+			details += ", got ";
+			details += ( result == RESULT_SUCCESS ) ? "SUCCESS" : GetErrorMsg( result );
+			details += "\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+
+static const char* GetTeamName( const teamCode_t team )
+{
+	return ( team == teamCode_t::WHITE ) ? "white" : ( ( team == teamCode_t::BLACK ) ? "black" : "none" );
+}
+
+static std::string GetResultName( const resultCode_t result )
+{
+	return ( result == RESULT_SUCCESS ) ? "SUCCESS" : GetErrorMsg( result );
+}
+
+// Loads a FEN in eager or lazy game state mode, the result and checked team must be known at once.
+// A finished game then answers any move with its result.
+static bool CheckFenGameState( ChessEngine& engine, const char* fen, const bool lazy, const resultCode_t expected, const teamCode_t checkedTeam, std::string& details )
+{
+	engine.SetLazyGameState( lazy );
+	const bool loaded = LoadFen( engine, fen, details );
+	const std::string where = "  '" + std::string( fen ) + ( lazy ? "' lazy: " : "' eager: " );
+
+	bool passed = loaded;
+	if ( loaded && ( ( engine.GetGameResult() != expected ) || ( engine.GetCheckedTeam() != checkedTeam ) ) )
+	{
+		details += where + GetResultName( engine.GetGameResult() ) + ", " + GetTeamName( engine.GetCheckedTeam() ) + " checked, expected ";
+		details += GetResultName( expected ) + ", " + GetTeamName( checkedTeam ) + " checked\n";
+		passed = false;
+	}
+
+	if ( loaded && ( expected != RESULT_SUCCESS ) )
+	{
+		const resultCode_t result = engine.ExecuteMove( engine.ParseMoveString( "a1a2" ) );
+		if ( result != expected )
+		{
+			details += where + "a move after the end returned " + GetResultName( result ) + "\n";
+			passed = false;
+		}
+	}
+
+	engine.SetLazyGameState( false );
+	return passed;
+}
+
+
+struct gameStateStep_t
+{
+	resultCode_t	moveResult;
+	resultCode_t	gameResult;
+	teamCode_t		checkedTeam;
+};
+
+// Plays the moves, querying the game state after each one when asked to
+static bool PlayGameStateLine( ChessEngine& engine, const char* fen, const std::vector< std::string >& moves, const bool lazy, const bool queryEachMove,
+							   std::vector< gameStateStep_t >& steps, std::string& details )
+{
+	steps.clear();
+	engine.SetLazyGameState( lazy );
+	if ( !LoadFen( engine, fen, details ) )
+	{
+		engine.SetLazyGameState( false );
+		return false;
+	}
+
+	for ( size_t i = 0; i < moves.size(); ++i )
+	{
+		gameStateStep_t step = {};
+		step.moveResult = engine.ExecuteMove( engine.ParseMoveString( moves[ i ] ) );
+		if ( queryEachMove || ( i + 1 == moves.size() ) )
+		{
+			step.gameResult = engine.GetGameResult();
+			step.checkedTeam = engine.GetCheckedTeam();
+		}
+		steps.push_back( step );
+	}
+
+	engine.SetLazyGameState( false );
+	return true;
+}
+
+// A lazy game state, queried after every move or only at the end, must report what the eager one does.
+// Its moves may return SUCCESS for a mate or stalemate they left unanalysed.
+static bool CheckLazyGameState( ChessEngine& engine, const char* fen, const std::vector< std::string >& moves, const resultCode_t expected, std::string& details )
+{
+	std::vector< gameStateStep_t > eager;
+	std::vector< gameStateStep_t > lazy;
+	std::vector< gameStateStep_t > lazyAtEnd;
+	if ( !PlayGameStateLine( engine, fen, moves, false, true, eager, details ) ||
+		 !PlayGameStateLine( engine, fen, moves, true, true, lazy, details ) ||
+		 !PlayGameStateLine( engine, fen, moves, true, false, lazyAtEnd, details ) ) {
+		return false;
+	}
+
+	bool passed = true;
+	if ( eager.back().gameResult != expected )
+	{
+		details += "  '" + std::string( fen ) + "' ends " + GetResultName( eager.back().gameResult ) + ", expected " + GetResultName( expected ) + "\n";
+		passed = false;
+	}
+
+	auto SameStep = []( const gameStateStep_t& step, const gameStateStep_t& reference, const bool queried )
+	{
+		const bool moveResult = ( step.moveResult == reference.moveResult ) || ( step.moveResult == RESULT_SUCCESS );
+		return moveResult && ( !queried || ( ( step.gameResult == reference.gameResult ) && ( step.checkedTeam == reference.checkedTeam ) ) );
+	};
+
+	for ( size_t i = 0; i < moves.size(); ++i )
+	{
+		const std::vector< gameStateStep_t >* runs[] = { &lazy, &lazyAtEnd };
+		for ( const std::vector< gameStateStep_t >* run : runs )
+		{
+			const gameStateStep_t& step = ( *run )[ i ];
+			if ( SameStep( step, eager[ i ], ( run == &lazy ) || ( i + 1 == moves.size() ) ) ) {
+				continue;
+			}
+			details += "  '" + std::string( fen ) + "' move '" + moves[ i ] + ( ( run == &lazy ) ? "', lazy: " : "', lazy queried at the end: " );
+			details += GetResultName( step.moveResult ) + " then " + GetResultName( step.gameResult ) + ", " + GetTeamName( step.checkedTeam ) + " checked, eager: ";
+			details += GetResultName( eager[ i ].moveResult ) + " then " + GetResultName( eager[ i ].gameResult ) + ", " + GetTeamName( eager[ i ].checkedTeam ) + " checked\n";
+			passed = false;
+		}
+	}
+	return passed;
+}
+
+// Replays coordinate moves from the loaded board, packed without a legality check of their own
+static bool CheckReplay( ChessEngine& engine, const std::vector< std::string >& moves, const size_t failedIndex, const resultCode_t failure, std::string& details )
+{
+	std::vector< packedMove_t > packed;
+	for ( const std::string& move : moves )
+	{
+		const pieceType_t promotion = ( move.size() > 4 ) ? GetPieceType( move[ 4 ] ) : pieceType_t::NONE;
+		packed.push_back( PackMove( move[ 0 ] - 'a', '8' - move[ 1 ], move[ 2 ] - 'a', '8' - move[ 3 ], promotion ) );
+	}
+
+	const replayResult_t result = engine.ReplayGame( packed.data(), packed.size() );
+	if ( ( result.failedIndex != failedIndex ) || ( result.failure != failure ) )
+	{
+		details += "  Replay: expected stop at " + std::to_string( failedIndex ) + " (";
+		details += ( failure == RESULT_SUCCESS ) ? "SUCCESS" : GetErrorMsg( failure );
+		details += "), got " + std::to_string( result.failedIndex ) + " (";
+		details += ( result.failure == RESULT_SUCCESS ) ? "SUCCESS" : GetErrorMsg( result.failure );
+		details += ")\n";
+		return false;
+	}
+	return true;
+}
+
+
+static bool SameInfo( const pieceInfo_t& lhs, const pieceInfo_t& rhs )
+{
+	return ( lhs.isPiece == rhs.isPiece ) && ( !lhs.isPiece || ( ( lhs.team == rhs.team ) && ( lhs.pieceType == rhs.pieceType ) && ( lhs.instance == rhs.instance ) ) );
+}
+
+// Keeps a board view current from the move deltas alone and compares it with GetInfo() after every move
+static bool CheckMoveDeltas( ChessEngine& engine, const char* fen, const std::vector< std::string >& moves, std::string& details )
+{
+	if ( !LoadFen( engine, fen, details ) ) {
+		return false;
+	}
+
+	pieceInfo_t view[ BoardSize ][ BoardSize ];
+	for ( num_t y = 0; y < BoardSize; ++y )
+	{
+		for ( num_t x = 0; x < BoardSize; ++x ) {
+			view[ y ][ x ] = engine.GetInfo( x, y );
+		}
+	}
+
+	bool passed = true;
+	for ( const std::string& move : moves )
+	{
+		moveDelta_t delta;
+		if ( engine.ExecuteMove( engine.ParseMoveString( move ), &delta ) & RESULT_GAME_ERROR_MASK )
+		{
+			details += "  Move '" + move + "' was not played\n";
+			return false;
+		}
+
+		const pieceInfo_t rook = delta.castle ? view[ delta.rookFrom.y ][ delta.rookFrom.x ] : pieceInfo_t{};
+		for ( int32_t i = 0; i < delta.vacatedCount; ++i ) {
+			view[ delta.vacated[ i ].y ][ delta.vacated[ i ].x ] = pieceInfo_t{ teamCode_t::NONE, pieceType_t::NONE, 0, false, false };
+		}
+		view[ delta.occupied[ 0 ].y ][ delta.occupied[ 0 ].x ] = delta.moved;
+		if ( delta.castle ) {
+			view[ delta.rookTo.y ][ delta.rookTo.x ] = rook;
+		}
+
+		for ( num_t y = 0; y < BoardSize; ++y )
+		{
+			for ( num_t x = 0; x < BoardSize; ++x )
+			{
+				if ( !SameInfo( view[ y ][ x ], engine.GetInfo( x, y ) ) )
+				{
+					passed = false;
+					details += "  After '" + move + "': delta view differs at ";
+					details += GetFile( x );
+					details += GetRank( y );
+					details += "\n";
+				}
+			}
+		}
+
+		if ( ( delta.checkedTeam != engine.GetCheckedTeam() ) || ( delta.result != engine.GetGameResult() ) )
+		{
+			passed = false;
+			details += "  After '" + move + "': delta check or result differs from the engine\n";
+		}
+	}
+	return passed;
+}
+
+
+// Snapshot squares and occupancy masks against GetInfo() on every square
+static bool SnapshotMatches( const ChessEngine& engine, const std::string& where, std::string& details )
+{
+	const boardSnapshot_t& snapshot = engine.GetBoardSnapshot();
+
+	bool passed = true;
+	for ( num_t y = 0; y < BoardSize; ++y )
+	{
+		for ( num_t x = 0; x < BoardSize; ++x )
+		{
+			const pieceInfo_t info = engine.GetInfo( x, y );
+			const uint8_t code = info.isPiece ? PackPiece( info.team, info.pieceType ) : PackedEmpty;
+			const uint64_t bit = 1ull << ( y * BoardSize + x );
+
+			bool match = ( snapshot.squares[ y ][ x ] == code );
+			for ( int32_t t = 0; t < TeamCount; ++t )
+			{
+				for ( int32_t type = 0; type < (int32_t)pieceType_t::COUNT; ++type )
+				{
+					const bool expected = info.isPiece && ( (int32_t)info.team == t ) && ( (int32_t)info.pieceType == type );
+					match = match && ( ( ( snapshot.occupancy[ t ][ type ] & bit ) != 0 ) == expected );
+				}
+			}
+
+			if ( !match )
+			{
+				passed = false;
+				details += "  " + where + ": snapshot differs at ";
+				details += GetFile( x );
+				details += GetRank( y );
+				details += "\n";
+			}
+		}
+	}
+	return passed;
+}
+
+static bool CheckSnapshot( ChessEngine& engine, const char* fen, const std::vector< std::string >& moves, std::string& details )
+{
+	if ( !LoadFen( engine, fen, details ) ) {
+		return false;
+	}
+
+	bool passed = SnapshotMatches( engine, "Initial position", details );
+	for ( const std::string& move : moves )
+	{
+		if ( engine.ExecuteMove( engine.ParseMoveString( move ) ) & RESULT_GAME_ERROR_MASK )
+		{
+			details += "  Move '" + move + "' was not played\n";
+			return false;
+		}
+		passed = SnapshotMatches( engine, "After '" + move + "'", details ) && passed;
+	}
+	return passed;
+}
+
+
+// Both GetLegalTargets() forms against the generated moves of the side to move
+static bool CheckLegalTargets( ChessEngine& engine, const char* fen, std::string& details )
+{
+	if ( !LoadFen( engine, fen, details ) ) {
+		return false;
+	}
+
+	uint64_t expected[ BoardSize * BoardSize ] = {};
+	move_t moves[ MaxMoves ];
+	const int32_t moveCount = engine.GenerateMoves( moves );
+	for ( int32_t i = 0; i < moveCount; ++i )
+	{
+		num_t x, y;
+		engine.GetLocation( moves[ i ].piece, x, y );
+		expected[ y * BoardSize + x ] |= 1ull << ( moves[ i ].y * BoardSize + moves[ i ].x );
+	}
+
+	uint64_t targets[ BoardSize * BoardSize ];
+	engine.GetLegalTargets( engine.GetCurrentPlayer(), targets );
+
+	bool passed = true;
+	for ( num_t y = 0; y < BoardSize; ++y )
+	{
+		for ( num_t x = 0; x < BoardSize; ++x )
+		{
+			const int32_t square = y * BoardSize + x;
+			const pieceInfo_t info = engine.GetInfo( x, y );
+			const bool own = info.isPiece && ( info.team == engine.GetCurrentPlayer() );
+			const uint64_t single = own ? engine.GetLegalTargets( engine.FindPiece( info.team, info.pieceType, info.instance ) ) : 0;
+
+			if ( ( targets[ square ] != expected[ square ] ) || ( single != expected[ square ] ) )
+			{
+				passed = false;
+				details += "  '" + std::string( fen ) + "': targets differ from the generated moves at ";
+				details += GetFile( x );
+				details += GetRank( y );
+				details += "\n";
+			}
+		}
+	}
+	return passed;
+}
+
+
+// Before each move a short search evaluates the coming positions through make/unmake, the cached
+// score of the position the move reaches must equal a fresh evaluation of it
+static bool CheckEvalCache( ChessEngine& engine, const std::vector< std::string >& moves, std::string& details )
+{
+	searchLimits_t limits;
+	limits.depth = 2;
+	limits.useBook = false;
+
+	bool passed = true;
+	for ( const std::string& move : moves )
+	{
+		engine.Search( limits );
+		if ( engine.ExecuteMove( engine.ParseMoveString( move ) ) & RESULT_GAME_ERROR_MASK )
+		{
+			details += "  Move '" + move + "' was not played\n";
+			return false;
+		}
+
+		const int32_t cached = engine.Evaluate();
+		engine.SetNetwork( nullptr );		// Clears the evaluation cache
+		const int32_t fresh = engine.Evaluate();
+		if ( cached != fresh )
+		{
+			passed = false;
+			details += "  After '" + move + "': cached score " + std::to_string( cached ) + ", fresh " + std::to_string( fresh ) + "\n";
+		}
+	}
+	return passed;
+}
+
+// Static evaluation, relative to the side to move, within [ minScore, maxScore ]
+static bool CheckEvaluation( ChessEngine& engine, const char* fen, const int32_t minScore, const int32_t maxScore, std::string& details )
+{
+	if ( !LoadFen( engine, fen, details ) ) {
+		return false;
+	}
+
+	const int32_t score = engine.Evaluate();
+	if ( ( score < minScore ) || ( score > maxScore ) )
+	{
+		details += "  '" + std::string( fen ) + "': score " + std::to_string( score ) + " outside [ " + std::to_string( minScore ) + ", " + std::to_string( maxScore ) + " ]\n";
+		return false;
+	}
+	return true;
+}
+
+static int32_t EvaluateFen( ChessEngine& engine, const char* fen )
+{
+	engine.InitFromFen( fen );
+	return engine.Evaluate();
+}
+
+// Small pseudo-random weights in the LoadNetwork() file layout, the same network on every run
+static const nnueNetwork_t* CreateTestNetwork()
+{
+	uint64_t random = 0x2545F4914F6CDD1Dull;
+	auto Next = [ &random ]( const int32_t range ) -> int32_t
+	{
+		random ^= random << 13;
+		random ^= random >> 7;
+		random ^= random << 17;
+		return static_cast<int32_t>( random % ( 2 * range + 1 ) ) - range;
+	};
+
+	const std::string fileName = ( std::filesystem::temp_directory_path() / "chess_test_network.nnue" ).string();
+	{
+		std::ofstream file( fileName, std::ios::binary | std::ios::trunc );
+		auto Write = [ &file ]( const auto value ) { file.write( reinterpret_cast<const char*>( &value ), sizeof( value ) ); };
+
+		Write( uint32_t( 0x554E4E43 ) );		// 'CNNU'
+		Write( uint32_t( 1 ) );
+		Write( uint32_t( NnueInputDimensions ) );
+		Write( uint32_t( NnueHalfDimensions ) );
+		Write( uint32_t( NnueHiddenDimensions ) );
+
+		for ( int32_t i = 0; i < NnueHalfDimensions; ++i ) {
+			Write( int16_t( 32 + Next( 32 ) ) );
+		}
+		for ( int32_t i = 0; i < NnueInputDimensions * NnueHalfDimensions; ++i ) {
+			Write( int16_t( Next( 16 ) ) );
+		}
+		for ( int32_t layer = 0; layer < 2; ++layer )
+		{
+			const int32_t inputs = ( layer == 0 ) ? ( 2 * NnueHalfDimensions ) : NnueHiddenDimensions;
+			for ( int32_t i = 0; i < NnueHiddenDimensions; ++i ) {
+				Write( int32_t( Next( 256 ) ) );
+			}
+			for ( int32_t i = 0; i < NnueHiddenDimensions * inputs; ++i ) {
+				Write( int8_t( Next( 8 ) ) );
+			}
+		}
+		Write( int32_t( Next( 256 ) ) );
+		for ( int32_t i = 0; i < NnueHiddenDimensions; ++i ) {
+			Write( int8_t( Next( 64 ) ) );
+		}
+	}
+
+	const nnueNetwork_t* network = LoadNetwork( fileName );
+	std::filesystem::remove( fileName );
+	return network;
+}
+
+// Packed positions along pseudo-random games, the vector batch path against the scalar reference
+static bool CheckBatchEvaluation( ChessEngine& engine, const size_t count, std::string& details )
+{
+	gameConfig_t cfg;
+	GetDefaultConfig( cfg );
+
+	std::vector< packedPosition_t > positions;
+	uint64_t random = 0x9E3779B97F4A7C15ull;
+	while ( positions.size() < count )
+	{
+		engine.Init( cfg );
+		for ( int32_t ply = 0; ( ply < 80 ) && ( positions.size() < count ); ++ply )
+		{
+			move_t moves[ MaxMoves ];
+			const int32_t moveCount = engine.GenerateMoves( moves );
+			if ( ( moveCount == 0 ) || engine.IsGameOver() ) {
+				break;
+			}
+
+			random ^= random << 13;
+			random ^= random >> 7;
+			random ^= random << 17;
+			engine.ExecuteMove( moves[ random % moveCount ] );
+
+			packedPosition_t position;
+			engine.GetPackedPosition( position );
+			positions.push_back( position );
+		}
+	}
+
+	std::vector< int32_t > batch( count );
+	std::vector< int32_t > reference( count );
+	EvaluateBatch( positions.data(), count, batch.data() );
+	EvaluateBatchReference( positions.data(), count, reference.data() );
+
+	for ( size_t i = 0; i < count; ++i )
+	{
+		if ( batch[ i ] != reference[ i ] )
+		{
+			details += "  Position " + std::to_string( i ) + ": batch score " + std::to_string( batch[ i ] ) + ", reference " + std::to_string( reference[ i ] ) + "\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+// Scores from the incrementally updated accumulator, with searches through make/unmake in between,
+// against a full rebuild after every move
+static bool CheckNnueIncremental( ChessEngine& engine, const nnueNetwork_t* network, const char* fen, const std::vector< std::string >& moves, std::string& details )
+{
+	bool passed = LoadFen( engine, fen, details );
+	engine.SetNetwork( network );
+
+	searchLimits_t limits;
+	limits.depth = 2;
+	limits.useBook = false;
+
+	for ( size_t i = 0; passed && ( i < moves.size() ); ++i )
+	{
+		engine.Search( limits );
+		if ( engine.ExecuteMove( engine.ParseMoveString( moves[ i ] ) ) & RESULT_GAME_ERROR_MASK )
+		{
+			details += "  Move '" + moves[ i ] + "' was not played\n";
+			passed = false;
+			break;
+		}
+
+		const int32_t incremental = engine.Evaluate();
+		engine.SetNetwork( network );		// Marks both halves for a rebuild and clears the cache
+		const int32_t rebuilt = engine.Evaluate();
+		if ( incremental != rebuilt )
+		{
+			passed = false;
+			details += "  After '" + moves[ i ] + "': incremental score " + std::to_string( incremental ) + ", rebuilt " + std::to_string( rebuilt ) + "\n";
+		}
+	}
+	return passed;
+}
+
+// The scalar, SSE4.1 and AVX2 builds (CHESS_SIMD) must all give the scalar score
+static bool CheckNnueScore( ChessEngine& engine, const nnueNetwork_t* network, const char* fen, const int32_t expected, std::string& details )
+{
+	if ( !LoadFen( engine, fen, details ) ) {
+		return false;
+	}
+
+	engine.SetNetwork( network );
+	const int32_t score = engine.Evaluate();
+	if ( score != expected )
+	{
+		details += "  '" + std::string( fen ) + "': network score " + std::to_string( score ) + ", expected " + std::to_string( expected ) + "\n";
+		return false;
+	}
+	return true;
+}
+
+
+static const char* GetMateStatusName( const mateStatus_t status )
+{
+	switch ( status )
+	{
+		case mateStatus_t::MATE:				return "MATE";
+		case mateStatus_t::NO_CHECKING_MATE:	return "NO_CHECKING_MATE";
+		default:								return "UNKNOWN";
+	}
+}
+
+// Solves a FEN for mate, a found line must be the expected one and end the game. Each defence in it
+// must hold out as long as the line says, no shorter mate may exist after it.
+static bool CheckMateSolver( ChessEngine& engine, const char* fen, const int32_t maxMoves, const uint64_t maxNodes,
+							 const mateStatus_t expected, const std::string& expectedLine, std::string& details )
+{
+	if ( !LoadFen( engine, fen, details ) ) {
+		return false;
+	}
+
+	const mateResult_t result = engine.SolveMate( maxMoves, maxNodes );
+	if ( result.status != expected )
+	{
+		details += "  '" + std::string( fen ) + "': " + GetMateStatusName( result.status ) + ", expected " + GetMateStatusName( expected ) + "\n";
+		return false;
+	}
+	if ( expected != mateStatus_t::MATE ) {
+		return true;
+	}
+
+	const std::string line = engine.GetLineString( result.line );
+	if ( ( line != expectedLine ) || ( result.mateIn != static_cast<int32_t>( result.line.size() + 1 ) / 2 ) )
+	{
+		details += "  Mate in " + std::to_string( result.mateIn ) + " '" + line + "', expected '" + expectedLine + "'\n";
+		return false;
+	}
+
+	for ( size_t i = 0; i < result.line.size(); ++i )
+	{
+		const std::string move = engine.GetMoveString( result.line[ i ] );
+		const resultCode_t code = engine.ExecuteMove( result.line[ i ] );
+		const bool last = ( i + 1 == result.line.size() );
+		if ( last ? ( ( code & ( RESULT_GAME_COMPLETE_WHITE_WINS | RESULT_GAME_COMPLETE_BLACK_WINS ) ) == 0 ) : ( code != RESULT_SUCCESS ) )
+		{
+			details += "  Move '" + move + "': " + ( ( code == RESULT_SUCCESS ) ? "SUCCESS" : GetErrorMsg( code ) ) + "\n";
+			return false;
+		}
+
+		const int32_t remaining = result.mateIn - static_cast<int32_t>( i + 1 ) / 2;
+		if ( !last && ( ( i % 2 ) == 1 ) && ( remaining > 1 ) && ( engine.SolveMate( remaining - 1 ).status == mateStatus_t::MATE ) )
+		{
+			details += "  '" + move + "' is not the longest defence, a shorter mate follows\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+// Multi-PV lines must start with distinct legal root moves, best score first, as many as asked or legal
+static bool CheckMultiPv( ChessEngine& engine, const char* fen, const int32_t lineCount, const int32_t depth, const size_t expectedLines, std::string& details )
+{
+	if ( !LoadFen( engine, fen, details ) ) {
+		return false;
+	}
+
+	searchLimits_t limits;
+	limits.depth = depth;
+	const multiPvResult_t result = engine.AnalyzeMultiPV( lineCount, limits );
+	if ( result.lines.size() != expectedLines )
+	{
+		details += "  '" + std::string( fen ) + "': " + std::to_string( result.lines.size() ) + " lines, expected " + std::to_string( expectedLines ) + "\n";
+		return false;
+	}
+
+	bool passed = true;
+	for ( size_t i = 0; i < result.lines.size(); ++i )
+	{
+		const searchLine_t& line = result.lines[ i ];
+		const std::string move = line.pv.empty() ? "(none)" : engine.GetMoveString( line.pv[ 0 ] );
+		if ( line.pv.empty() || ( engine.ParseMoveString( move ) != line.pv[ 0 ] ) || ( line.depth != depth ) )
+		{
+			details += "  Line " + std::to_string( i ) + " '" + move + "' at depth " + std::to_string( line.depth ) + " is not a legal root move at depth " + std::to_string( depth ) + "\n";
+			passed = false;
+			continue;
+		}
+
+		for ( size_t j = 0; j < i; ++j )
+		{
+			if ( !result.lines[ j ].pv.empty() && ( result.lines[ j ].pv[ 0 ] == line.pv[ 0 ] ) )
+			{
+				details += "  Lines " + std::to_string( j ) + " and " + std::to_string( i ) + " both rank " + move + "\n";
+				passed = false;
+			}
+		}
+
+		if ( ( i > 0 ) && ( line.score > result.lines[ i - 1 ].score ) )
+		{
+			details += "  Line " + std::to_string( i ) + " scores " + std::to_string( line.score ) + ", above the line before it\n";
+			passed = false;
+		}
+	}
+	return passed;
+}
+
+static uint64_t SearchNodes( ChessEngine& engine, const int32_t depth )
+{
+	searchLimits_t limits;
+	limits.depth = depth;
+	limits.useBook = false;
+	return engine.Search( limits ).nodes;
+}
+
+// A saved search warms the next one through the hash file. Saves without a search in between age the
+// entries, they still help after HashFileMaxAge (8) saves and are gone after one more.
+static bool CheckHashFileAgeing( ChessEngine& engine, const char* fen, const int32_t depth, std::string& details )
+{
+	if ( !LoadFen( engine, fen, details ) ) {
+		return false;
+	}
+
+	const std::string fileName = ( std::filesystem::temp_directory_path() / "chess_test_ageing.hash" ).string();
+	std::filesystem::remove( fileName );
+
+	engine.SetHashSize( 1 );
+	engine.OpenHashFile( fileName, 1 );
+	const uint64_t coldNodes = SearchNodes( engine, depth );
+	engine.SaveHashFile();
+
+	bool passed = true;
+	engine.ClearHash();
+	const uint64_t warmNodes = SearchNodes( engine, depth );
+	if ( warmNodes >= coldNodes )
+	{
+		details += "  The hash file did not warm the search: " + std::to_string( warmNodes ) + " nodes, " + std::to_string( coldNodes ) + " cold\n";
+		passed = false;
+	}
+
+	for ( int32_t save = 1; save <= 9; ++save )
+	{
+		engine.ClearHash();
+		engine.SaveHashFile();
+		if ( save < 8 ) {
+			continue;
+		}
+
+		engine.ClearHash();
+		const uint64_t nodes = SearchNodes( engine, depth );
+		const bool warm = ( save == 8 );
+		if ( warm ? ( nodes >= coldNodes ) : ( nodes != coldNodes ) )
+		{
+			details += "  After " + std::to_string( save ) + " saves without a search: " + std::to_string( nodes ) + " nodes, expected ";
+			details += warm ? "fewer than " + std::to_string( coldNodes ) + "\n" : std::to_string( coldNodes ) + " as cold\n";
+			passed = false;
+		}
+	}
+
+	engine.OpenHashFile( "" );
+	std::filesystem::remove( fileName );
+	return passed;
+}
+
+// The sliced search must walk the same tree as Search(), in small slices, from an equally sized empty table
+static bool CheckSlicedSearch( ChessEngine& engine, const char* fen, const int32_t depth, const uint64_t sliceNodes, std::string& details )
+{
+	if ( !LoadFen( engine, fen, details ) ) {
+		return false;
+	}
+
+	searchLimits_t limits;
+	limits.depth = depth;
+	limits.useBook = false;
+
+	engine.SetHashSize( 1 );
+	const searchResult_t expected = engine.Search( limits );
+
+	engine.ClearHash();
+	sliceSearch_t* search = engine.BeginSlicedSearch( limits );
+	int32_t slices = 1;
+	while ( !engine.ResumeSlicedSearch( search, sliceNodes ) ) {
+		++slices;
+	}
+	const searchResult_t result = engine.EndSlicedSearch( search );
+
+	if ( ( result.nodes != expected.nodes ) || ( result.bestMove != expected.bestMove ) || ( result.score != expected.score ) || ( result.depth != expected.depth ) )
+	{
+		details += "  '" + std::string( fen ) + "': " + std::to_string( slices ) + " slices gave " + engine.GetMoveString( result.bestMove ) + " " + std::to_string( result.score );
+		details += " in " + std::to_string( result.nodes ) + " nodes, Search() " + engine.GetMoveString( expected.bestMove ) + " " + std::to_string( expected.score );
+		details += " in " + std::to_string( expected.nodes ) + "\n";
+		return false;
+	}
+	return true;
+}
+
+// Collects the onDone calls of background searches
+struct searchWatch_t
+{
+	std::mutex				mutex;
+	std::condition_variable	wake;
+	int32_t					doneCount = 0;
+	searchResult_t			result;
+
+	searchDoneCallback_t OnDone()
+	{
+		return [ this ]( const searchResult_t& done )
+		{
+			std::lock_guard< std::mutex > lock( mutex );
+			++doneCount;
+			result = done;
+			wake.notify_all();
+		};
+	}
+
+	bool WaitDone( const int32_t count )
+	{
+		std::unique_lock< std::mutex > lock( mutex );
+		return wake.wait_for( lock, std::chrono::seconds( 30 ), [ this, count ]() { return doneCount >= count; } );
+	}
+
+	int32_t DoneCount()
+	{
+		std::lock_guard< std::mutex > lock( mutex );
+		return doneCount;
+	}
+};
+
+static bool CheckDoneCount( searchWatch_t& watch, const int32_t expected, const char* where, std::string& details )
+{
+	const int32_t count = watch.DoneCount();
+	if ( count != expected )
+	{
+		details += "  " + std::string( where ) + ": onDone ran " + std::to_string( count ) + " times, expected " + std::to_string( expected ) + "\n";
+		return false;
+	}
+	return true;
+}
+
+// Stops an unbounded search from outside, then one from inside its own onInfo, then runs a fresh search to its depth.
+// onDone must run exactly once for each of them.
+static bool CheckStopSearch( ChessEngine& engine, const char* fen, std::string& details )
+{
+	if ( !LoadFen( engine, fen, details ) ) {
+		return false;
+	}
+
+	searchWatch_t watch;
+	searchLimits_t limits;
+	limits.useBook = false;
+
+	engine.StartSearch( limits, nullptr, watch.OnDone() );
+	std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+	engine.Stop();
+	bool passed = CheckDoneCount( watch, 1, "Stop() from outside", details );
+	if ( engine.IsSearching() || ( watch.result.bestMove == NoMove ) )
+	{
+		details += "  Stop() from outside left the search running or without a move\n";
+		passed = false;
+	}
+
+	engine.StartSearch( limits, [ &engine ]( const searchInfo_t& info )
+	{
+		if ( info.depth >= 2 ) {
+			engine.Stop();
+		}
+	}, watch.OnDone() );
+	if ( !watch.WaitDone( 2 ) )
+	{
+		details += "  Stop() from onInfo did not end the search\n";
+		engine.Stop();
+		return false;
+	}
+
+	limits.depth = 4;
+	engine.StartSearch( limits, nullptr, watch.OnDone() );
+	if ( !watch.WaitDone( 3 ) )
+	{
+		details += "  The search after a stop from onInfo did not finish\n";
+		engine.Stop();
+		return false;
+	}
+	if ( watch.result.depth != limits.depth )
+	{
+		details += "  The search after a stop from onInfo reached depth " + std::to_string( watch.result.depth ) + "\n";
+		passed = false;
+	}
+
+	engine.Stop();
+	std::this_thread::sleep_for( std::chrono::milliseconds( 50 ) );
+	return CheckDoneCount( watch, 3, "After the three searches", details ) && passed;
+}
+
+// A ponder search finishes its depth but holds the bestmove until PonderHit()
+static bool CheckPonderSearch( ChessEngine& engine, const char* fen, std::string& details )
+{
+	if ( !LoadFen( engine, fen, details ) ) {
+		return false;
+	}
+
+	searchWatch_t watch;
+	searchLimits_t limits;
+	limits.depth = 3;
+	limits.useBook = false;
+	limits.ponder = true;
+
+	engine.StartSearch( limits, nullptr, watch.OnDone() );
+	std::this_thread::sleep_for( std::chrono::milliseconds( 200 ) );
+	bool passed = CheckDoneCount( watch, 0, "Before PonderHit()", details );
+	if ( !engine.IsSearching() )
+	{
+		details += "  The ponder search stopped before PonderHit()\n";
+		passed = false;
+	}
+
+	engine.PonderHit();
+	if ( !watch.WaitDone( 1 ) )
+	{
+		details += "  PonderHit() did not release the bestmove\n";
+		engine.Stop();
+		return false;
+	}
+
+	engine.Stop();
+	passed = CheckDoneCount( watch, 1, "After PonderHit()", details ) && passed;
+	if ( watch.result.depth != limits.depth )
+	{
+		details += "  The ponder search reached depth " + std::to_string( watch.result.depth ) + "\n";
+		passed = false;
+	}
+	return passed;
+}
+
+// Runs a fixed-seed MCTS, the expected move must be most visited and hold at least minShare of the playouts.
+// A single thread must also give the same visit counts when run again.
+static bool CheckMcts( ChessEngine& engine, const char* fen, const int32_t threads, const char* expected, const double minShare, std::string& details )
+{
+	if ( !LoadFen( engine, fen, details ) ) {
+		return false;
+	}
+
+	mctsLimits_t limits;
+	limits.playouts = 2000;
+	limits.threads = threads;
+	limits.seed = 1;
+
+	const mctsResult_t result = engine.SearchMcts( limits );
+	if ( ( result.playouts != limits.playouts ) || result.moves.empty() )
+	{
+		details += "  " + std::to_string( result.playouts ) + " playouts over " + std::to_string( result.moves.size() ) + " root moves\n";
+		return false;
+	}
+
+	bool passed = true;
+	const std::string bestMove = engine.GetMoveString( result.bestMove );
+	if ( ( bestMove != expected ) || ( result.moves[ 0 ].move != result.bestMove ) )
+	{
+		details += "  Best move " + bestMove + ", expected " + expected + "\n";
+		passed = false;
+	}
+
+	const double share = result.moves[ 0 ].visits / static_cast<double>( result.playouts );
+	if ( share < minShare )
+	{
+		details += "  " + bestMove + " got " + std::to_string( result.moves[ 0 ].visits ) + " of " + std::to_string( result.playouts ) + " visits\n";
+		passed = false;
+	}
+
+	for ( size_t i = 1; i < result.moves.size(); ++i )
+	{
+		if ( result.moves[ i ].visits > result.moves[ i - 1 ].visits )
+		{
+			details += "  Root moves are not sorted by visits at " + engine.GetMoveString( result.moves[ i ].move ) + "\n";
+			passed = false;
+			break;
+		}
+	}
+
+	if ( threads == 1 )
+	{
+		const mctsResult_t rerun = engine.SearchMcts( limits );
+		bool same = ( rerun.moves.size() == result.moves.size() );
+		for ( size_t i = 0; same && ( i < result.moves.size() ); ++i ) {
+			same = ( rerun.moves[ i ].move == result.moves[ i ].move ) && ( rerun.moves[ i ].visits == result.moves[ i ].visits );
+		}
+		if ( !same )
+		{
+			details += "  The same seed gave different visit counts\n";
+			passed = false;
+		}
+	}
+	return passed;
+}
+
+
+// ============================================================
+// Test case definitions
+// ============================================================
+
+// --- Opening games (default board) ---
+
+static TestCase TestFoolsMate =
+{
+	"Fools Mate",
+	"Shortest possible checkmate: 1.f3 e5 2.g4 Qh4#",
+	"tests/default_board.txt",
+	"tests/fools_mate.txt",
+	{},
+	RESULT_GAME_COMPLETE_BLACK_WINS,
+	{},
+	{}
+};
+REGISTER_TEST( TestFoolsMate );
+
+static TestCase TestScholarsMate =
+{
+	"Scholars Mate",
+	"Classic 4-move checkmate: 1.e4 e5 2.Bc4 Nc6 3.Qh5 Nf6 4.Qxf7#",
+	"tests/default_board.txt",
+	"tests/scholars_mate.txt",
+	{},
+	RESULT_GAME_COMPLETE_WHITE_WINS,
+	{},
+	{
+		{ pieceType_t::PAWN, teamCode_t::BLACK, 5, -1, -1 },	// f7 pawn captured
+	}
+};
+REGISTER_TEST( TestScholarsMate );
+
+static TestCase TestItalianOpening =
+{
+	"Italian Opening",
+	"Italian Game with both sides castling kingside",
+	"tests/default_board.txt",
+	"tests/italian_opening.txt",
+	{},
+	RESULT_SUCCESS,
+	{},
+	{
+		// White castled: king on g1, rook on f1
+		{ pieceType_t::KING, teamCode_t::WHITE, 0, 6, 7 },
+		// Black castled: king on g8, rook on f8
+		{ pieceType_t::KING, teamCode_t::BLACK, 0, 6, 0 },
+	}
+};
+REGISTER_TEST( TestItalianOpening );
+
+static TestCase TestQueensGambit =
+{
+	"Queens Gambit Declined",
+	"Queen's Gambit Declined: 1.d4 d5 2.c4 e6 3.Nc3 Nf6 4.Bg5 Be7",
+	"tests/default_board.txt",
+	"tests/queens_gambit.txt",
+	{},
+	RESULT_SUCCESS,
+	{},
+	{}
+};
+REGISTER_TEST( TestQueensGambit );
+
+static TestCase TestBasicCommands =
+{
+	"Basic Pawn Moves",
+	"Sequence of pawn advances from default board",
+	"tests/default_board.txt",
+	"tests/commands_basic.txt",
+	{},
+	RESULT_SUCCESS,
+	{},
+	{}
+};
+REGISTER_TEST( TestBasicCommands );
+
+
+// --- Tactical tests (custom boards) ---
+
+static TestCase TestBackRankMate =
+{
+	"Back Rank Mate",
+	"Rook delivers checkmate on 8th rank, king trapped by own pawns",
+	"tests/back_rank_mate_board.txt",
+	"tests/back_rank_mate_cmds.txt",
+	{},
+	RESULT_GAME_COMPLETE_WHITE_WINS,
+	{
+		{ 0, RESULT_GAME_COMPLETE_WHITE_WINS },
+	},
+	{}
+};
+REGISTER_TEST( TestBackRankMate );
+
+static TestCase TestPromotion =
+{
+	"Pawn Promotion",
+	"White pawn on 7th rank promotes to queen",
+	"tests/promotion_board.txt",
+	"tests/promotion_cmds.txt",
+	{},
+	RESULT_SUCCESS,
+	{
+		{ 0, RESULT_SUCCESS },
+	},
+	{}
+};
+REGISTER_TEST( TestPromotion );
+
+static TestCase TestUnderpromotion =
+{
+	"Underpromotion",
+	"e7-e8=N+ -- the command's choice wins over the queen the promotion callback would pick",
+	"tests/underpromotion_board.txt",
+	"tests/underpromotion_cmds.txt",
+	{},
+	RESULT_SUCCESS,
+	{
+		{ 0, RESULT_SUCCESS },
+	},
+	{},
+	[]( ChessEngine& engine, std::string& details )
+	{
+		const pieceInfo_t info = engine.GetInfo( 4, 0 );
+		if ( ( info.team != teamCode_t::WHITE ) || ( info.pieceType != pieceType_t::KNIGHT ) || ( engine.GetCheckedTeam() != teamCode_t::BLACK ) )
+		{
+			details += "  Expected a white knight on e8 checking black\n";
+			return false;
+		}
+		return true;
+	}
+};
+REGISTER_TEST( TestUnderpromotion );
+
+static TestCase TestUnderpromotionMove =
+{
+	"Underpromotion From Coordinates",
+	"\"e7e8n\" parsed and turned into a command keeps the knight",
+	"tests/underpromotion_board.txt",
+	nullptr,
+	{},
+	RESULT_SUCCESS,
+	{},
+	{},
+	[]( ChessEngine& engine, std::string& details )
+	{
+		const move_t move = engine.ParseMoveString( "e7e8n" );
+		const command_t cmd = engine.GetMoveCommand( move );
+		if ( ( move == NoMove ) || ( cmd.promotion != pieceType_t::KNIGHT ) || ( engine.Execute( cmd ) != RESULT_SUCCESS ) )
+		{
+			details += "  'e7e8n' did not play as a command\n";
+			return false;
+		}
+		if ( engine.GetInfo( 4, 0 ).pieceType != pieceType_t::KNIGHT )
+		{
+			details += "  Expected a knight on e8\n";
+			return false;
+		}
+		return true;
+	}
+};
+REGISTER_TEST( TestUnderpromotionMove );
+
+static TestCase TestEnPassant =
+{
+	"En Passant",
+	"White double-pushes a2-a4, black captures en passant b4xa3",
+	"tests/enpassant.txt",
+	"tests/enpassant_cmds.txt",
+	{},
+	RESULT_SUCCESS,
+	{
+		{ 0, RESULT_SUCCESS },		// a2-a4 double push
+		{ 1, RESULT_SUCCESS },		// bxa3 en passant
+	},
+	{
+		{ pieceType_t::PAWN, teamCode_t::WHITE, 0, -1, -1 },	// white pawn captured via en passant
+	}
+};
+REGISTER_TEST( TestEnPassant );
+
+static TestCase TestKnightFork =
+{
+	"Knight Fork",
+	"Knight forks king and queen at e7, captures queen after king flees, leaving a dead draw",
+	"tests/knight_fork_board.txt",
+	"tests/knight_fork_cmds.txt",
+	{},
+	RESULT_GAME_COMPLETE_NO_MATERIAL,
+	{
+		{ 0, RESULT_SUCCESS },						// Ne7+ fork
+		{ 1, RESULT_SUCCESS },						// Kf8
+		{ 2, RESULT_GAME_COMPLETE_NO_MATERIAL },	// Nxc8, king and knight can't mate
+	},
+	{
+		{ pieceType_t::QUEEN, teamCode_t::BLACK, 0, -1, -1 },	// queen captured
+		{ pieceType_t::KING, teamCode_t::BLACK, 0, 5, 0 },	// king on f8
+	}
+};
+REGISTER_TEST( TestKnightFork );
+
+
+// --- Bug-exposing tests ---
+
+static TestCase TestStalemate =
+{
+	"Stalemate Detection",
+	"Qb6 creates stalemate -- black has no legal moves but is not in check",
+	"tests/stalemate_board.txt",
+	"tests/stalemate_cmds.txt",
+	{},
+	RESULT_GAME_COMPLETE_STALEMATE,
+	{},
+	{}
+};
+REGISTER_TEST( TestStalemate );
+
+static TestCase TestFenGameState =
+{
+	"FEN Game State",
+	"A FEN position that is already mate, stalemate or check reports it straight away, eager and lazy",
+	nullptr,
+	nullptr,
+	{},
+	RESULT_SUCCESS,
+	{},
+	{},
+	[]( ChessEngine& engine, std::string& details )
+	{
+		bool passed = true;
+		for ( const bool lazy : { false, true } )
+		{
+			passed = CheckFenGameState( engine, "R5k1/5ppp/8/8/8/8/8/6K1 b - - 0 1", lazy, RESULT_GAME_COMPLETE_WHITE_WINS, teamCode_t::BLACK, details ) && passed;
+			passed = CheckFenGameState( engine, "7k/5Q2/6K1/8/8/8/8/8 b - - 0 1", lazy, RESULT_GAME_COMPLETE_STALEMATE, teamCode_t::NONE, details ) && passed;
+			passed = CheckFenGameState( engine, "4k3/8/8/8/8/8/8/4R1K1 b - - 0 1", lazy, RESULT_SUCCESS, teamCode_t::BLACK, details ) && passed;
+			passed = CheckFenGameState( engine, "4k3/8/8/8/8/8/8/3R2K1 b - - 0 1", lazy, RESULT_SUCCESS, teamCode_t::NONE, details ) && passed;
+		}
+		return passed;
+	}
+};
+REGISTER_TEST( TestFenGameState );
+
+static TestCase TestLazyGameState =
+{
+	"Lazy Game State",
+	"Lazy and eager game states agree through checks, mate, stalemate, the fifty-move rule and a mate on the move that reaches it",
+	nullptr,
+	nullptr,
+	{},
+	RESULT_SUCCESS,
+	{},
+	{},
+	[]( ChessEngine& engine, std::string& details )
+	{
+		bool passed = CheckLazyGameState( engine, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", { "f2f3", "e7e5", "g2g4", "d8h4" }, RESULT_GAME_COMPLETE_BLACK_WINS, details );
+		passed = CheckLazyGameState( engine, "4k3/8/8/8/8/8/8/R3K3 w - - 0 1", { "a1a8", "e8d7", "a8a7", "d7c6" }, RESULT_SUCCESS, details ) && passed;
+		passed = CheckLazyGameState( engine, "7k/5Q2/5K2/8/8/8/8/8 w - - 0 1", { "f6g6" }, RESULT_GAME_COMPLETE_STALEMATE, details ) && passed;
+		passed = CheckLazyGameState( engine, "6k1/5ppp/8/8/8/8/8/R5K1 w - - 99 80", { "a1a8" }, RESULT_GAME_COMPLETE_WHITE_WINS, details ) && passed;
+		passed = CheckLazyGameState( engine, "6k1/5ppp/8/8/8/8/8/R5K1 w - - 99 80", { "a1a2" }, RESULT_GAME_COMPLETE_FIFTY_MOVES, details ) && passed;
+		return passed;
+	}
+};
+REGISTER_TEST( TestLazyGameState );
+
+static TestCase TestPin =
+{
+	"Pinned Piece Cannot Move",
+	"Black knight pinned to king by white bishop -- n0f6 should be illegal",
+	"tests/pin_board.txt",
+	"tests/pin_cmds.txt",
+	{},
+	RESULT_SUCCESS,
+	{
+		{ 0, RESULT_SUCCESS },						// White Kb1 (waiting move)
+		{ 1, RESULT_GAME_INVALID_MOVE },			// Black Nf6 should be rejected (pinned)
+	},
+	{}
+};
+REGISTER_TEST( TestPin );
+
+static TestCase TestCastleThroughCheck =
+{
+	"Castle Through Check",
+	"Black rook controls f-file -- white cannot castle kingside through f1",
+	"tests/castle_through_check_board.txt",
+	"tests/castle_through_check_cmds.txt",
+	{},
+	RESULT_SUCCESS,
+	{
+		{ 0, RESULT_GAME_INVALID_MOVE },			// O-O should be rejected
+	},
+	{}
+};
+REGISTER_TEST( TestCastleThroughCheck );
+
+static TestCase TestCornerCapture =
+{
+	"King Captures Bishop Near Corner",
+	"Kxb7 is legal -- the captured bishop, lifted off the board, must not attack b7 along the long diagonal",
+	"tests/corner_capture_board.txt",
+	"tests/corner_capture_cmds.txt",
+	{},
+	RESULT_SUCCESS,
+	{
+		{ 0, RESULT_SUCCESS },						// Kxb7
+	},
+	{
+		{ pieceType_t::BISHOP, teamCode_t::BLACK, 0, -1, -1 },	// bishop captured
+		{ pieceType_t::KING, teamCode_t::WHITE, 0, 1, 1 },		// king on b7
+	}
+};
+REGISTER_TEST( TestCornerCapture );
+
+
+// --- Draw rules ---
+
+static TestCase TestThreefoldRepetition =
+{
+	"Threefold Repetition",
+	"Both sides shuffle a knight out and back, the initial position occurs a third time",
+	"tests/default_board.txt",
+	nullptr,
+	{ "n1f3", "n1f6", "n1g1", "n1g8", "n1f3", "n1f6", "n1g1", "n1g8" },
+	RESULT_GAME_COMPLETE_REPETITION,
+	{
+		{ 3, RESULT_SUCCESS },							// Second occurrence
+		{ 7, RESULT_GAME_COMPLETE_REPETITION },			// Third occurrence
+	},
+	{}
+};
+REGISTER_TEST( TestThreefoldRepetition );
+
+static TestCase TestFiftyMoveRule =
+{
+	"Fifty-Move Rule",
+	"A hundred plies without a capture or pawn move, starting from a FEN with the clock at 98",
+	nullptr,
+	nullptr,
+	{},
+	RESULT_SUCCESS,
+	{},
+	{},
+	[]( ChessEngine& engine, std::string& details ) { return CheckGameEnd( engine, "4k3/8/8/8/8/8/8/R3K3 w - - 98 80", { "a1a2", "e8d8" }, RESULT_GAME_COMPLETE_FIFTY_MOVES, details ); }
+};
+REGISTER_TEST( TestFiftyMoveRule );
+
+static TestCase TestInsufficientMaterial =
+{
+	"Insufficient Material",
+	"Nxd5 takes the last rook, king and knight against a bare king can't mate",
+	"tests/no_material_board.txt",
+	"tests/no_material_cmds.txt",
+	{},
+	RESULT_GAME_COMPLETE_NO_MATERIAL,
+	{
+		{ 0, RESULT_GAME_COMPLETE_NO_MATERIAL },		// Nxd5
+	},
+	{
+		{ pieceType_t::ROOK, teamCode_t::BLACK, 0, -1, -1 },	// rook captured
+	}
+};
+REGISTER_TEST( TestInsufficientMaterial );
+
+
+// --- Game replay ---
+
+static TestCase TestReplayInvalidMove =
+{
+	"Replay Stops At Invalid Move",
+	"1.e4 e5 then e4-e5 into a pawn, the replay stops there and keeps the moves before it",
+	"tests/default_board.txt",
+	nullptr,
+	{},
+	RESULT_SUCCESS,
+	{},
+	{
+		{ pieceType_t::PAWN, teamCode_t::WHITE, 4, 4, 4 },		// e4
+		{ pieceType_t::PAWN, teamCode_t::BLACK, 4, 4, 3 },		// e5
+	},
+	[]( ChessEngine& engine, std::string& details ) { return CheckReplay( engine, { "e2e4", "e7e5", "e4e5", "d2d4" }, 2, RESULT_GAME_INVALID_MOVE, details ); }
+};
+REGISTER_TEST( TestReplayInvalidMove );
+
+static TestCase TestReplayInvalidPiece =
+{
+	"Replay Stops At Wrong Piece",
+	"A black pawn move on white's turn fails as an invalid piece",
+	"tests/default_board.txt",
+	nullptr,
+	{},
+	RESULT_SUCCESS,
+	{},
+	{},
+	[]( ChessEngine& engine, std::string& details ) { return CheckReplay( engine, { "d2d4", "d7d5", "e7e5" }, 2, RESULT_GAME_INVALID_PIECE, details ); }
+};
+REGISTER_TEST( TestReplayInvalidPiece );
+
+static TestCase TestReplayAfterMate =
+{
+	"Replay Stops After Mate",
+	"Fool's mate followed by another move, the replay reports the finished game",
+	"tests/default_board.txt",
+	nullptr,
+	{},
+	RESULT_SUCCESS,
+	{},
+	{},
+	[]( ChessEngine& engine, std::string& details ) { return CheckReplay( engine, { "f2f3", "e7e5", "g2g4", "d8h4", "a2a3" }, 4, RESULT_GAME_COMPLETE_BLACK_WINS, details ); }
+};
+REGISTER_TEST( TestReplayAfterMate );
 
 
-// ============================================================
-// Test case definitions
-// ============================================================
+// --- Board views ---
 
-// --- Opening games (default board) ---
+static TestCase TestMoveDeltas =
+{
+	"Move Deltas",
+	"En passant, castling both ways, a capture promotion and a recapture, each delta rebuilds the board",
+	nullptr,
+	nullptr,
+	{},
+	RESULT_SUCCESS,
+	{},
+	{},
+	[]( ChessEngine& engine, std::string& details ) { return CheckMoveDeltas( engine, "r3k2r/1P6/8/3pP3/8/8/8/R3K2R w KQkq d6 0 1", { "e5d6", "e8g8", "b7a8q", "f8a8", "e1c1" }, details ); }
+};
+REGISTER_TEST( TestMoveDeltas );
 
-static TestCase TestFoolsMate =
+static TestCase TestBoardSnapshot =
 {
-	"Fools Mate",
-	"Shortest possible checkmate: 1.f3 e5 2.g4 Qh4#",
-	"tests/default_board.txt",
-	"tests/fools_mate.txt",
+	"Board Snapshot",
+	"The packed snapshot and occupancy masks match the pieces after every move of the same line",
+	nullptr,
+	nullptr,
 	{},
-	RESULT_GAME_COMPLETE_BLACK_WINS,
+	RESULT_SUCCESS,
 	{},
-	{}
+	{},
+	[]( ChessEngine& engine, std::string& details ) { return CheckSnapshot( engine, "r3k2r/1P6/8/3pP3/8/8/8/R3K2R w KQkq d6 0 1", { "e5d6", "e8g8", "b7a8q", "f8a8", "e1c1" }, details ); }
 };
-REGISTER_TEST( TestFoolsMate );
+REGISTER_TEST( TestBoardSnapshot );
 
-static TestCase TestScholarsMate =
+static TestCase TestLegalTargets =
 {
-	"Scholars Mate",
-	"Classic 4-move checkmate: 1.e4 e5 2.Bc4 Nc6 3.Qh5 Nf6 4.Qxf7#",
-	"tests/default_board.txt",
-	"tests/scholars_mate.txt",
+	"Legal Targets",
+	"Highlight masks per piece and per team equal the generated moves, with pins, checks, castling and en passant",
+	nullptr,
+	nullptr,
+	{},
+	RESULT_SUCCESS,
 	{},
-	RESULT_GAME_COMPLETE_WHITE_WINS,
 	{},
+	[]( ChessEngine& engine, std::string& details )
 	{
-		{ pieceType_t::PAWN, teamCode_t::BLACK, 5, -1, -1 },	// f7 pawn captured
+		const bool start = CheckLegalTargets( engine, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", details );
+		const bool enpassant = CheckLegalTargets( engine, "8/8/3p4/KPp4r/1R3p1k/8/4P1P1/8 w - c6 0 2", details );
+		const bool castling = CheckLegalTargets( engine, "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", details );
+		const bool check = CheckLegalTargets( engine, "rnbqkbnr/ppp2ppp/8/1B1pp3/4P3/8/PPPP1PPP/RNBQK1NR b KQkq - 1 3", details );
+		return start && enpassant && castling && check;
 	}
 };
-REGISTER_TEST( TestScholarsMate );
+REGISTER_TEST( TestLegalTargets );
 
-static TestCase TestItalianOpening =
+
+// --- Evaluation ---
+
+static TestCase TestEvalCache =
 {
-	"Italian Opening",
-	"Italian Game with both sides castling kingside",
+	"Evaluation Cache",
+	"Opera game line, cached scores left by searches through make/unmake equal fresh evaluations",
 	"tests/default_board.txt",
-	"tests/italian_opening.txt",
+	nullptr,
 	{},
 	RESULT_SUCCESS,
 	{},
+	{},
+	[]( ChessEngine& engine, std::string& details )
 	{
-		// White castled: king on g1, rook on f1
-		{ pieceType_t::KING, teamCode_t::WHITE, 0, 6, 7 },
-		// Black castled: king on g8, rook on f8
-		{ pieceType_t::KING, teamCode_t::BLACK, 0, 6, 0 },
+		return CheckEvalCache( engine, { "e2e4", "e7e5", "g1f3", "d7d6", "d2d4", "c8g4", "d4e5", "g4f3", "d1f3", "d6e5", "f1c4", "g8f6",
+										 "f3b3", "d8e7", "b1c3", "c7c6", "c1g5", "b7b5", "c3b5", "c6b5", "c4b5", "b8d7", "e1c1" }, details );
 	}
 };
-REGISTER_TEST( TestItalianOpening );
+REGISTER_TEST( TestEvalCache );
 
-static TestCase TestQueensGambit =
+static TestCase TestEndgameEvaluators =
 {
-	"Queens Gambit Declined",
-	"Queen's Gambit Declined: 1.d4 d5 2.c4 e6 3.Nc3 Nf6 4.Bg5 Be7",
-	"tests/default_board.txt",
-	"tests/queens_gambit.txt",
+	"Endgame Evaluators",
+	"Material table endgames: KPK wins and draws, KBNK and KRK drive the king, a lone knight is a draw",
+	nullptr,
+	nullptr,
 	{},
 	RESULT_SUCCESS,
 	{},
-	{}
+	{},
+	[]( ChessEngine& engine, std::string& details )
+	{
+		bool passed = true;
+		passed = CheckEvaluation( engine, "7k/8/8/8/8/8/P7/K7 w - - 0 1", KnownWinValue, InfiniteValue, details ) && passed;		// Outside the square
+		passed = CheckEvaluation( engine, "7k/8/8/8/8/8/P7/K7 b - - 0 1", -InfiniteValue, -KnownWinValue, details ) && passed;		// Same, the loser to move
+		passed = CheckEvaluation( engine, "k7/8/8/8/8/8/P7/K7 w - - 0 1", 0, 100, details ) && passed;								// Rook pawn, king in the corner
+		passed = CheckEvaluation( engine, "8/8/8/8/8/4k3/4P3/4K3 w - - 0 1", 0, 100, details ) && passed;							// King in front of the pawn
+		passed = CheckEvaluation( engine, "8/8/8/3k4/8/3K4/8/6N1 w - - 0 1", 0, 0, details ) && passed;								// Lone knight
+		passed = CheckEvaluation( engine, "8/8/8/8/8/2K5/8/1BN4k w - - 0 1", KnownWinValue, InfiniteValue, details ) && passed;		// KBNK
+
+		// Mate needs a corner of the bishop's colour, and the rook mates on the edge
+		if ( EvaluateFen( engine, "8/8/8/8/8/2K5/8/1BN4k w - - 0 1" ) <= EvaluateFen( engine, "7k/8/8/8/8/2K5/8/1BN5 w - - 0 1" ) )
+		{
+			passed = false;
+			details += "  KBNK: the bishop's corner should score above the other one\n";
+		}
+		if ( EvaluateFen( engine, "8/8/8/k7/8/3K4/8/7R w - - 0 1" ) <= EvaluateFen( engine, "8/8/3k4/8/8/3K4/8/7R w - - 0 1" ) )
+		{
+			passed = false;
+			details += "  KRK: the king on the edge should score above the centre\n";
+		}
+		return passed;
+	}
 };
-REGISTER_TEST( TestQueensGambit );
+REGISTER_TEST( TestEndgameEvaluators );
 
-static TestCase TestBasicCommands =
+static TestCase TestNnueIncremental =
 {
-	"Basic Pawn Moves",
-	"Sequence of pawn advances from default board",
-	"tests/default_board.txt",
-	"tests/commands_basic.txt",
+	"NNUE Incremental Updates",
+	"A fixed test network scores the same from the updated accumulator as from a rebuild, through en passant, castling, capture promotions and king moves",
+	nullptr,
+	nullptr,
 	{},
 	RESULT_SUCCESS,
 	{},
-	{}
+	{},
+	[]( ChessEngine& engine, std::string& details )
+	{
+		const nnueNetwork_t* network = CreateTestNetwork();
+		if ( network == nullptr )
+		{
+			details += "  Could not create the test network\n";
+			return false;
+		}
+
+		bool passed = CheckNnueIncremental( engine, network, "r3k2r/1P4p1/8/3pP3/8/8/6p1/R3K2R w KQkq d6 0 1",
+											{ "e5d6", "e8g8", "b7a8q", "f8a8", "e1c1", "g2g1q", "d1g1", "g8f8", "c1b1", "a8a1", "b1a1" }, details );
+		passed = CheckNnueScore( engine, network, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", -28, details ) && passed;
+		passed = CheckNnueScore( engine, network, "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3", 31, details ) && passed;
+
+		engine.SetNetwork( nullptr );
+		DestroyNetwork( network );
+		return passed;
+	}
 };
-REGISTER_TEST( TestBasicCommands );
+REGISTER_TEST( TestNnueIncremental );
+
+static TestCase TestBatchEvaluation =
+{
+	"Batch Evaluation",
+	"EvaluateBatch() equals the scalar reference over 389 positions, blocks of eight and a tail of five",
+	nullptr,
+	nullptr,
+	{},
+	RESULT_SUCCESS,
+	{},
+	{},
+	[]( ChessEngine& engine, std::string& details ) { return CheckBatchEvaluation( engine, 389, details ); }
+};
+REGISTER_TEST( TestBatchEvaluation );
 
 
-// --- Tactical tests (custom boards) ---
+// --- Search ---
 
-static TestCase TestBackRankMate =
+static TestCase TestMateSolver =
 {
-	"Back Rank Mate",
-	"Rook delivers checkmate on 8th rank, king trapped by own pawns",
-	"tests/back_rank_mate_board.txt",
-	"tests/back_rank_mate_cmds.txt",
+	"Mate Solver",
+	"Mates in one, two and three with the longest defence, a quiet mate the checks-only solver does not claim, and a node limit",
+	nullptr,
+	nullptr,
 	{},
-	RESULT_GAME_COMPLETE_WHITE_WINS,
+	RESULT_SUCCESS,
+	{},
+	{},
+	[]( ChessEngine& engine, std::string& details )
 	{
-		{ 0, RESULT_GAME_COMPLETE_WHITE_WINS },
-	},
-	{}
+		bool passed = CheckMateSolver( engine, "6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1", 3, 0, mateStatus_t::MATE, "a1a8", details );
+		passed = CheckMateSolver( engine, "r2qkb1r/pp2nppp/3p4/2pNN1B1/2BnP3/3P4/PPP2PPP/R2bK2R w KQkq - 1 1", 3, 0, mateStatus_t::MATE, "d5f6 g7f6 c4f7", details ) && passed;
+		passed = CheckMateSolver( engine, "r1b1kb1r/pppp1ppp/5q2/4n3/3KP3/2N3PN/PPP4P/R1BQ1B1R b kq - 0 1", 3, 0, mateStatus_t::MATE, "f8c5 d4c5 f6b6 c5d5 b6d6", details ) && passed;
+		passed = CheckMateSolver( engine, "6k1/8/6K1/8/8/8/8/7R w - - 0 1", 4, 0, mateStatus_t::NO_CHECKING_MATE, "", details ) && passed;	// Quiet Kf6 first, Search finds the mate in 2
+		passed = CheckMateSolver( engine, "r1b1kb1r/pppp1ppp/5q2/4n3/3KP3/2N3PN/PPP4P/R1BQ1B1R b kq - 0 1", 3, 10, mateStatus_t::UNKNOWN, "", details ) && passed;
+		return passed;
+	}
 };
-REGISTER_TEST( TestBackRankMate );
+REGISTER_TEST( TestMateSolver );
 
-static TestCase TestPromotion =
+static TestCase TestMultiPv =
 {
-	"Pawn Promotion",
-	"White pawn on 7th rank promotes to queen",
-	"tests/promotion_board.txt",
-	"tests/promotion_cmds.txt",
+	"Multi-PV Lines",
+	"AnalyzeMultiPV() ranks distinct root moves best first, and stops at the legal move count",
+	nullptr,
+	nullptr,
 	{},
 	RESULT_SUCCESS,
+	{},
+	{},
+	[]( ChessEngine& engine, std::string& details )
 	{
-		{ 0, RESULT_SUCCESS },
-	},
-	{}
+		bool passed = CheckMultiPv( engine, "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3", 4, 4, 4, details );
+		passed = CheckMultiPv( engine, "7k/8/8/8/8/8/8/R6K b - - 0 1", 5, 3, 3, details ) && passed;
+		return passed;
+	}
 };
-REGISTER_TEST( TestPromotion );
+REGISTER_TEST( TestMultiPv );
 
-static TestCase TestEnPassant =
+static TestCase TestSlicedSearch =
 {
-	"En Passant",
-	"White double-pushes a2-a4, black captures en passant b4xa3",
-	"tests/enpassant.txt",
-	"tests/enpassant_cmds.txt",
+	"Sliced Search",
+	"A search resumed 1000 nodes at a time gives Search()'s move, score and node count at the same depth and hash size",
+	nullptr,
+	nullptr,
 	{},
 	RESULT_SUCCESS,
+	{},
+	{},
+	[]( ChessEngine& engine, std::string& details )
 	{
-		{ 0, RESULT_SUCCESS },		// a2-a4 double push
-		{ 1, RESULT_SUCCESS },		// bxa3 en passant
-	},
-	{
-		{ pieceType_t::PAWN, teamCode_t::WHITE, 0, -1, -1 },	// white pawn captured via en passant
+		bool passed = CheckSlicedSearch( engine, "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 5, 1000, details );
+		passed = CheckSlicedSearch( engine, "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3", 5, 1000, details ) && passed;
+		passed = CheckSlicedSearch( engine, "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4, 1000, details ) && passed;
+		return passed;
 	}
 };
-REGISTER_TEST( TestEnPassant );
+REGISTER_TEST( TestSlicedSearch );
 
-static TestCase TestKnightFork =
+static TestCase TestHashFileAgeing =
 {
-	"Knight Fork",
-	"Knight forks king and queen at e7, captures queen after king flees",
-	"tests/knight_fork_board.txt",
-	"tests/knight_fork_cmds.txt",
+	"Hash File Ageing",
+	"Entries saved by a search warm later searches, and age out of the file after eight saves without being searched again",
+	nullptr,
+	nullptr,
 	{},
 	RESULT_SUCCESS,
+	{},
+	{},
+	[]( ChessEngine& engine, std::string& details ) { return CheckHashFileAgeing( engine, "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3", 5, details ); }
+};
+REGISTER_TEST( TestHashFileAgeing );
+
+static TestCase TestBackgroundSearch =
+{
+	"Background Search",
+	"Stop() from outside and from onInfo, a new search after that, and a ponder search held until PonderHit(), onDone once each",
+	nullptr,
+	nullptr,
+	{},
+	RESULT_SUCCESS,
+	{},
+	{},
+	[]( ChessEngine& engine, std::string& details )
 	{
-		{ 0, RESULT_SUCCESS },		// Ne7+ fork
-		{ 1, RESULT_SUCCESS },		// Kf8
-		{ 2, RESULT_SUCCESS },		// Nxc8
-	},
-	{
-		{ pieceType_t::QUEEN, teamCode_t::BLACK, 0, -1, -1 },	// queen captured
-		{ pieceType_t::KING, teamCode_t::BLACK, 0, 5, 0 },	// king on f8
+		const char* fen = "r1bqkbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 2 3";
+		bool passed = CheckStopSearch( engine, fen, details );
+		passed = CheckPonderSearch( engine, fen, details ) && passed;
+		return passed;
 	}
 };
-REGISTER_TEST( TestKnightFork );
+REGISTER_TEST( TestBackgroundSearch );
 
+static TestCase TestMctsBackRankMate =
+{
+	"MCTS Back Rank Mate",
+	"A fixed-seed Monte Carlo search finds Ra8# and spends most of its playouts on it, the same counts on a rerun",
+	nullptr,
+	nullptr,
+	{},
+	RESULT_SUCCESS,
+	{},
+	{},
+	[]( ChessEngine& engine, std::string& details ) { return CheckMcts( engine, "6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1", 1, "a1a8", 0.8, details ); }
+};
+REGISTER_TEST( TestMctsBackRankMate );
 
-// --- Bug-exposing tests ---
+static TestCase TestMctsThreads =
+{
+	"MCTS Threads",
+	"Four threads share the tree, still find Ra8# and play exactly the playout budget",
+	nullptr,
+	nullptr,
+	{},
+	RESULT_SUCCESS,
+	{},
+	{},
+	[]( ChessEngine& engine, std::string& details ) { return CheckMcts( engine, "6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1", 4, "a1a8", 0.8, details ); }
+};
+REGISTER_TEST( TestMctsThreads );
 
-static TestCase TestStalemate =
+
+// --- Move generation (perft) ---
+
+static TestCase TestPerftStart =
 {
-	"Stalemate Detection",
-	"Qb6 creates stalemate -- black has no legal moves but is not in check",
-	"tests/stalemate_board.txt",
-	"tests/stalemate_cmds.txt",
+	"Perft Start Position",
+	"Leaf count of the legal move tree from the initial position, 4 plies",
+	"tests/default_board.txt",
+	nullptr,
 	{},
-	RESULT_GAME_COMPLETE_STALEMATE,
+	RESULT_SUCCESS,
 	{},
-	{}
+	{},
+	[]( ChessEngine& engine, std::string& details ) { return CheckPerft( engine, nullptr, 4, 197281, details ); }
 };
-REGISTER_TEST( TestStalemate );
+REGISTER_TEST( TestPerftStart );
 
-static TestCase TestPin =
+static TestCase TestPerftEnPassant =
 {
-	"Pinned Piece Cannot Move",
-	"Black knight pinned to king by white bishop -- n0f6 should be illegal",
-	"tests/pin_board.txt",
-	"tests/pin_cmds.txt",
+	"Perft En Passant",
+	"Rook and pawn endgame with en passant captures and discovered checks, 4 plies",
+	nullptr,
+	nullptr,
 	{},
 	RESULT_SUCCESS,
-	{
-		{ 0, RESULT_SUCCESS },						// White Kb1 (waiting move)
-		{ 1, RESULT_GAME_INVALID_MOVE },			// Black Nf6 should be rejected (pinned)
-	},
-	{}
+	{},
+	{},
+	[]( ChessEngine& engine, std::string& details ) { return CheckPerft( engine, "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 4, 43238, details ); }
 };
-REGISTER_TEST( TestPin );
+REGISTER_TEST( TestPerftEnPassant );
 
-static TestCase TestCastleThroughCheck =
+static TestCase TestPerftPromotion =
 {
-	"Castle Through Check",
-	"Black rook controls f-file -- white cannot castle kingside through f1",
-	"tests/castle_through_check_board.txt",
-	"tests/castle_through_check_cmds.txt",
+	"Perft Castling And Promotion",
+	"Castling rights on one side only, capture promotions for both teams, 3 plies",
+	nullptr,
+	nullptr,
 	{},
 	RESULT_SUCCESS,
-	{
-		{ 0, RESULT_GAME_INVALID_MOVE },			// O-O should be rejected
-	},
-	{}
+	{},
+	{},
+	[]( ChessEngine& engine, std::string& details ) { return CheckPerft( engine, "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 3, 9467, details ); }
 };
-REGISTER_TEST( TestCastleThroughCheck );
+REGISTER_TEST( TestPerftPromotion );
+
+static TestCase TestPerftKiwipete =
+{
+	"Perft Kiwipete",
+	"Castling both ways for both teams past pins, checks and a pawn on h3, 3 plies",
+	nullptr,
+	nullptr,
+	{},
+	RESULT_SUCCESS,
+	{},
+	{},
+	[]( ChessEngine& engine, std::string& details ) { return CheckPerft( engine, "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 3, 97862, details ); }
+};
+REGISTER_TEST( TestPerftKiwipete );
+
+static TestCase TestPerftPawnGuardsCastling =
+{
+	"Perft Pawn Guards Castling",
+	"A black pawn on g2 covers the empty f1 square, white may only castle long",
+	nullptr,
+	nullptr,
+	{},
+	RESULT_SUCCESS,
+	{},
+	{},
+	[]( ChessEngine& engine, std::string& details ) { return CheckPerft( engine, "r3k2r/8/8/8/8/8/6p1/R3K2R w KQkq - 0 1", 1, 24, details ); }
+};
+REGISTER_TEST( TestPerftPawnGuardsCastling );
 
 
 // --- Inline command tests ---
@@ -653,7 +2192,11 @@ int main()
 
 		char timeBuf[ 64 ];
 		struct tm tmBuf;
+#if defined( _WIN32 )
 		localtime_s( &tmBuf, &t );
+#else
+		localtime_r( &t, &tmBuf );
+#endif
 		std::strftime( timeBuf, sizeof( timeBuf ), "%Y-%m-%d %H:%M:%S", &tmBuf );
 
 		logger.Write( "=============================================" );
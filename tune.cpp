@@ -0,0 +1,493 @@
+// Texel-style tuner for the piece values and piece-square tables.
+//
+// Usage:	tune <corpus> [output header] [epochs] [threads]
+//
+// Each corpus line is a FEN followed by the game result from white's point of view, as
+// "1-0", "0-1", "1/2-1/2" or a bracketed score like "[0.5]". Positions should be quiet
+// (no captures or checks pending), the model is the search-free material and tapered
+// piece-square sum that EvaluateBatch() computes.
+//
+// The scaling constant K is fitted to the current tables first, then all weights are
+// optimised with Adam on the logistic (cross-entropy) loss. The result is written as a
+// drop-in replacement for the tables in piece.cpp; build with CHESS_TUNED_TABLES to use it.
+//
+// Not part of the solution build. The CMake build has a tune target, compiled for AVX2.
+
+#include "chess.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#define TUNE_USE_AVX2 1
+#endif
+
+static const int32_t Lanes				= 8;
+static const int32_t SquareCount		= BoardSize * BoardSize;
+static const int32_t TypeCount			= (int32_t)pieceType_t::COUNT;
+static const int32_t FeatureCount		= TypeCount * SquareCount;		// One piece-square entry per type
+static const int32_t PaddingFeature		= FeatureCount;					// Unused slot, its weights stay zero
+static const uint16_t BlackFlag			= 0x8000;
+
+static const double AdamRate			= 1.0;
+static const double AdamBeta1			= 0.9;
+static const double AdamBeta2			= 0.999;
+static const double AdamEpsilon			= 1e-8;
+
+
+// Positions are grouped in blocks of Lanes with equal slot counts (sorted by piece count),
+// stored slot-major so one load fetches the same slot of every position in the block
+struct sampleBlock_t
+{
+	size_t		offset;						// First slot in tuner_t::features
+	int32_t		slotCount;
+	float		phase[ Lanes ];				// Middlegame weight, [0, 1]
+	float		result[ Lanes ];			// White relative, 1 = win
+};
+
+struct weights_t
+{
+	float		material[ TypeCount + 1 ];
+	float		middlegame[ FeatureCount + 1 ];
+	float		endgame[ FeatureCount + 1 ];
+};
+
+struct gradient_t
+{
+	double		material[ TypeCount + 1 ];
+	double		middlegame[ FeatureCount + 1 ];
+	double		endgame[ FeatureCount + 1 ];
+	double		loss;
+};
+
+struct tuner_t
+{
+	std::vector< sampleBlock_t >	blocks;
+	std::vector< uint16_t >			features;		// [ slot ][ lane ] per block, BlackFlag marks black pieces
+	size_t							sampleCount;
+	int32_t							threadCount;
+};
+
+
+static bool ParseResult( const std::string& line, const size_t start, float& result )
+{
+	if ( line.find( "1/2", start ) != std::string::npos ) {
+		result = 0.5f;
+	} else if ( line.find( "1-0", start ) != std::string::npos ) {
+		result = 1.0f;
+	} else if ( line.find( "0-1", start ) != std::string::npos ) {
+		result = 0.0f;
+	} else
+	{
+		const size_t bracket = line.find( '[', start );
+		if ( bracket == std::string::npos ) {
+			return false;
+		}
+		result = static_cast<float>( atof( line.c_str() + bracket + 1 ) );
+	}
+	return ( result >= 0.0f ) && ( result <= 1.0f );
+}
+
+
+static bool LoadCorpus( const std::string& fileName, tuner_t& tuner )
+{
+	static const int32_t PhaseWeight[ TypeCount ] = { 0, 2, 1, 1, 0, 4 };
+
+	struct sample_t
+	{
+		uint16_t	features[ TeamPieceCount * TeamCount ];
+		int32_t		count;
+		float		phase;
+		float		result;
+	};
+
+	std::ifstream file( fileName );
+	if ( file.is_open() == false ) {
+		return false;
+	}
+
+	std::vector< sample_t > samples;
+	std::string line;
+	size_t skipped = 0;
+
+	while ( getline( file, line ) )
+	{
+		packedPosition_t position;
+		sample_t sample;
+		if ( ( ParseFen( line, position ) == false ) || ( ParseResult( line, line.find( ' ' ), sample.result ) == false ) )
+		{
+			skipped += line.empty() ? 0 : 1;
+			continue;
+		}
+
+		int32_t phase = 0;
+		sample.count = 0;
+		for ( int32_t y = 0; y < BoardSize; ++y )
+		{
+			for ( int32_t x = 0; x < BoardSize; ++x )
+			{
+				const uint8_t code = position.squares[ y ][ x ];
+				if ( ( code == PackedEmpty ) || ( sample.count == ( TeamPieceCount * TeamCount ) ) ) {
+					continue;
+				}
+
+				const bool white = ( ( code >> 3 ) == (int32_t)teamCode_t::WHITE );
+				const int32_t type = ( code & 7 ) - 1;
+				const int32_t row = white ? y : ( BoardSize - 1 - y );
+
+				sample.features[ sample.count++ ] = static_cast<uint16_t>( type * SquareCount + row * BoardSize + x ) | ( white ? 0 : BlackFlag );
+				phase += PhaseWeight[ type ];
+			}
+		}
+		sample.phase = std::min( phase, MaxGamePhase ) / static_cast<float>( MaxGamePhase );
+		samples.push_back( sample );
+	}
+
+	if ( skipped > 0 ) {
+		printf( "Skipped %zu malformed lines\n", skipped );
+	}
+
+	std::sort( samples.begin(), samples.end(), []( const sample_t& a, const sample_t& b ) { return a.count < b.count; } );
+
+	tuner.sampleCount = samples.size();
+	tuner.blocks.clear();
+	tuner.features.clear();
+
+	for ( size_t first = 0; first < samples.size(); first += Lanes )
+	{
+		sampleBlock_t block;
+		block.offset = tuner.features.size();
+		block.slotCount = 0;
+
+		// A short last block is padded with lanes marked by a negative result, they are skipped
+		for ( int32_t lane = 0; lane < Lanes; ++lane )
+		{
+			const size_t i = first + lane;
+			block.phase[ lane ] = ( i < samples.size() ) ? samples[ i ].phase : 0.0f;
+			block.result[ lane ] = ( i < samples.size() ) ? samples[ i ].result : -1.0f;
+			block.slotCount = ( i < samples.size() ) ? std::max( block.slotCount, samples[ i ].count ) : block.slotCount;
+		}
+
+		for ( int32_t slot = 0; slot < block.slotCount; ++slot )
+		{
+			for ( int32_t lane = 0; lane < Lanes; ++lane )
+			{
+				const size_t i = first + lane;
+				const bool used = ( i < samples.size() ) && ( slot < samples[ i ].count );
+				tuner.features.push_back( used ? samples[ i ].features[ slot ] : PaddingFeature );
+			}
+		}
+		tuner.blocks.push_back( block );
+	}
+	return true;
+}
+
+
+// White relative evaluation of every lane in a block
+static void EvaluateBlock( const tuner_t& tuner, const weights_t& weights, const sampleBlock_t& block, float scores[ Lanes ] )
+{
+	const uint16_t* features = &tuner.features[ block.offset ];
+
+#if defined( TUNE_USE_AVX2 )
+	__m256 material = _mm256_setzero_ps();
+	__m256 middlegame = _mm256_setzero_ps();
+	__m256 endgame = _mm256_setzero_ps();
+
+	for ( int32_t slot = 0; slot < block.slotCount; ++slot )
+	{
+		const __m256i packed = _mm256_cvtepu16_epi32( _mm_loadu_si128( reinterpret_cast<const __m128i*>( features + slot * Lanes ) ) );
+		const __m256i feature = _mm256_and_si256( packed, _mm256_set1_epi32( ~BlackFlag & 0xFFFF ) );
+		const __m256 sign = _mm256_cvtepi32_ps( _mm256_sub_epi32( _mm256_set1_epi32( 1 ), _mm256_srli_epi32( packed, 14 ) ) );
+
+		material = _mm256_add_ps( material, _mm256_mul_ps( sign, _mm256_i32gather_ps( weights.material, _mm256_srli_epi32( feature, 6 ), 4 ) ) );
+		middlegame = _mm256_add_ps( middlegame, _mm256_mul_ps( sign, _mm256_i32gather_ps( weights.middlegame, feature, 4 ) ) );
+		endgame = _mm256_add_ps( endgame, _mm256_mul_ps( sign, _mm256_i32gather_ps( weights.endgame, feature, 4 ) ) );
+	}
+
+	const __m256 phase = _mm256_loadu_ps( block.phase );
+	const __m256 tapered = _mm256_add_ps( _mm256_mul_ps( phase, _mm256_sub_ps( middlegame, endgame ) ), endgame );
+	_mm256_storeu_ps( scores, _mm256_add_ps( material, tapered ) );
+#else
+	for ( int32_t lane = 0; lane < Lanes; ++lane )
+	{
+		float material = 0.0f;
+		float middlegame = 0.0f;
+		float endgame = 0.0f;
+
+		for ( int32_t slot = 0; slot < block.slotCount; ++slot )
+		{
+			const uint16_t packed = features[ slot * Lanes + lane ];
+			const int32_t feature = packed & ~BlackFlag;
+			const float sign = ( packed & BlackFlag ) ? -1.0f : 1.0f;
+
+			material += sign * weights.material[ feature / SquareCount ];
+			middlegame += sign * weights.middlegame[ feature ];
+			endgame += sign * weights.endgame[ feature ];
+		}
+		scores[ lane ] = material + block.phase[ lane ] * ( middlegame - endgame ) + endgame;
+	}
+#endif
+}
+
+
+static void AccumulateRange( const tuner_t& tuner, const weights_t& weights, const double k, const size_t first, const size_t last, const bool withGradient, gradient_t& gradient )
+{
+	for ( size_t b = first; b < last; ++b )
+	{
+		const sampleBlock_t& block = tuner.blocks[ b ];
+
+		float scores[ Lanes ];
+		EvaluateBlock( tuner, weights, block, scores );
+
+		double delta[ Lanes ];
+		for ( int32_t lane = 0; lane < Lanes; ++lane )
+		{
+			delta[ lane ] = 0.0;
+			if ( block.result[ lane ] < 0.0f ) {
+				continue;
+			}
+
+			const double p = std::clamp( 1.0 / ( 1.0 + exp( -k * scores[ lane ] ) ), 1e-9, 1.0 - 1e-9 );
+			const double r = block.result[ lane ];
+			gradient.loss -= r * log( p ) + ( 1.0 - r ) * log( 1.0 - p );
+			delta[ lane ] = k * ( p - r );
+		}
+
+		if ( withGradient == false ) {
+			continue;
+		}
+
+		const uint16_t* features = &tuner.features[ block.offset ];
+		for ( int32_t slot = 0; slot < block.slotCount; ++slot )
+		{
+			for ( int32_t lane = 0; lane < Lanes; ++lane )
+			{
+				const uint16_t packed = features[ slot * Lanes + lane ];
+				const int32_t feature = packed & ~BlackFlag;
+				const double d = ( packed & BlackFlag ) ? -delta[ lane ] : delta[ lane ];
+
+				gradient.material[ feature / SquareCount ] += d;
+				gradient.middlegame[ feature ] += d * block.phase[ lane ];
+				gradient.endgame[ feature ] += d * ( 1.0 - block.phase[ lane ] );
+			}
+		}
+	}
+}
+
+
+// Mean loss over the corpus, and its gradient when requested
+static double ComputeLoss( const tuner_t& tuner, const weights_t& weights, const double k, gradient_t* gradient )
+{
+	std::vector< gradient_t > partial( tuner.threadCount );
+	std::vector< std::thread > threads;
+
+	const size_t blockCount = tuner.blocks.size();
+	for ( int32_t t = 0; t < tuner.threadCount; ++t )
+	{
+		memset( &partial[ t ], 0, sizeof( gradient_t ) );
+		const size_t first = ( blockCount * t ) / tuner.threadCount;
+		const size_t last = ( blockCount * ( t + 1 ) ) / tuner.threadCount;
+		threads.emplace_back( [ &, first, last, t ]()
+		{
+			AccumulateRange( tuner, weights, k, first, last, ( gradient != nullptr ), partial[ t ] );
+		} );
+	}
+
+	double loss = 0.0;
+	if ( gradient != nullptr ) {
+		memset( gradient, 0, sizeof( gradient_t ) );
+	}
+
+	for ( int32_t t = 0; t < tuner.threadCount; ++t )
+	{
+		threads[ t ].join();
+		loss += partial[ t ].loss;
+
+		if ( gradient == nullptr ) {
+			continue;
+		}
+		for ( int32_t i = 0; i <= TypeCount; ++i ) {
+			gradient->material[ i ] += partial[ t ].material[ i ];
+		}
+		for ( int32_t i = 0; i <= FeatureCount; ++i )
+		{
+			gradient->middlegame[ i ] += partial[ t ].middlegame[ i ];
+			gradient->endgame[ i ] += partial[ t ].endgame[ i ];
+		}
+	}
+	return loss / std::max< size_t >( tuner.sampleCount, 1 );
+}
+
+
+// Golden-section search for the sigmoid scale that best fits the starting tables
+static double FitScale( const tuner_t& tuner, const weights_t& weights )
+{
+	const double ratio = ( sqrt( 5.0 ) - 1.0 ) / 2.0;
+	double lo = 0.0005;
+	double hi = 0.05;
+
+	for ( int32_t i = 0; i < 40; ++i )
+	{
+		const double a = hi - ratio * ( hi - lo );
+		const double b = lo + ratio * ( hi - lo );
+		if ( ComputeLoss( tuner, weights, a, nullptr ) < ComputeLoss( tuner, weights, b, nullptr ) ) {
+			hi = b;
+		} else {
+			lo = a;
+		}
+	}
+	return ( lo + hi ) / 2.0;
+}
+
+
+static void AdamStep( float* weights, double* m, double* v, const double* gradient, const int32_t count, const double scale, const int32_t step )
+{
+	const double correction1 = 1.0 - pow( AdamBeta1, step );
+	const double correction2 = 1.0 - pow( AdamBeta2, step );
+
+	for ( int32_t i = 0; i < count; ++i )
+	{
+		const double g = gradient[ i ] * scale;
+		m[ i ] = AdamBeta1 * m[ i ] + ( 1.0 - AdamBeta1 ) * g;
+		v[ i ] = AdamBeta2 * v[ i ] + ( 1.0 - AdamBeta2 ) * g * g;
+		weights[ i ] -= static_cast<float>( AdamRate * ( m[ i ] / correction1 ) / ( sqrt( v[ i ] / correction2 ) + AdamEpsilon ) );
+	}
+}
+
+
+static void InitWeights( weights_t& weights )
+{
+	memset( &weights, 0, sizeof( weights_t ) );
+	for ( int32_t type = 0; type < TypeCount; ++type )
+	{
+		// Both kings are always on the board, their value cancels out
+		weights.material[ type ] = ( type == (int32_t)pieceType_t::KING ) ? 0.0f : static_cast<float>( PieceValue[ type ] );
+		for ( int32_t sq = 0; sq < SquareCount; ++sq )
+		{
+			weights.middlegame[ type * SquareCount + sq ] = static_cast<float>( PST[ type ][ sq / BoardSize ][ sq % BoardSize ] );
+			weights.endgame[ type * SquareCount + sq ] = static_cast<float>( PSTEndgame[ type ][ sq / BoardSize ][ sq % BoardSize ] );
+		}
+	}
+}
+
+
+static bool WriteTables( const std::string& fileName, const weights_t& weights, const std::string& corpus, const size_t sampleCount, const double loss )
+{
+	static const char* TableNames[ TypeCount ] = { "Pawn", "Rook", "Knight", "Bishop", "King", "Queen" };
+	static const char* TypeNames[ TypeCount ] = { "PAWN", "ROOK", "KNIGHT", "BISHOP", "KING", "QUEEN" };
+
+	FILE* file = fopen( fileName.c_str(), "w" );
+	if ( file == nullptr ) {
+		return false;
+	}
+
+	fprintf( file, "// Generated by tune from %s (%zu positions, loss %.6f), do not edit.\n", corpus.c_str(), sampleCount, loss );
+	fprintf( file, "// Included by piece.cpp in place of its hand-written tables when CHESS_TUNED_TABLES is defined.\n\n" );
+	fprintf( file, "const int32_t PieceValue[ (int32_t)pieceType_t::COUNT ] =\n{\n" );
+	for ( int32_t type = 0; type < TypeCount; ++type )
+	{
+		const int32_t value = ( type == (int32_t)pieceType_t::KING ) ? PieceValue[ type ] : static_cast<int32_t>( lround( weights.material[ type ] ) );
+		fprintf( file, "\t%d,\t// %s\n", value, TypeNames[ type ] );
+	}
+	fprintf( file, "};\n" );
+
+	for ( int32_t phase = 0; phase < 2; ++phase )
+	{
+		const float* table = ( phase == 0 ) ? weights.middlegame : weights.endgame;
+		for ( int32_t type = 0; type < TypeCount; ++type )
+		{
+			fprintf( file, "\nstatic const int32_t %s%sPST[ BoardSize ][ BoardSize ] =\n{\n", TableNames[ type ], ( phase == 0 ) ? "" : "Endgame" );
+			for ( int32_t row = 0; row < BoardSize; ++row )
+			{
+				fprintf( file, "\t{" );
+				for ( int32_t x = 0; x < BoardSize; ++x ) {
+					fprintf( file, "%s%4ld", ( x == 0 ) ? " " : ", ", lround( table[ type * SquareCount + row * BoardSize + x ] ) );
+				}
+				fprintf( file, " },\t// rank %d\n", BoardSize - row );
+			}
+			fprintf( file, "};\n" );
+		}
+	}
+
+	for ( int32_t phase = 0; phase < 2; ++phase )
+	{
+		fprintf( file, "\nconst int32_t( *%s[ (int32_t)pieceType_t::COUNT ] )[ BoardSize ] =\n{\n", ( phase == 0 ) ? "PST" : "PSTEndgame" );
+		for ( int32_t type = 0; type < TypeCount; ++type ) {
+			fprintf( file, "\t%s%sPST,\n", TableNames[ type ], ( phase == 0 ) ? "" : "Endgame" );
+		}
+		fprintf( file, "};\n" );
+	}
+
+	fclose( file );
+	return true;
+}
+
+
+int main( int argc, char** argv )
+{
+	if ( argc < 2 )
+	{
+		printf( "Usage: tune <corpus> [output header] [epochs] [threads]\n" );
+		return 1;
+	}
+
+	const std::string corpus = argv[ 1 ];
+	const std::string output = ( argc > 2 ) ? argv[ 2 ] : "tunedTables.h";
+	const int32_t epochs = ( argc > 3 ) ? atoi( argv[ 3 ] ) : 1000;
+
+	tuner_t tuner;
+	tuner.threadCount = ( argc > 4 ) ? atoi( argv[ 4 ] ) : static_cast<int32_t>( std::thread::hardware_concurrency() );
+	tuner.threadCount = std::max( tuner.threadCount, 1 );
+
+	const auto loadStart = std::chrono::steady_clock::now();
+	if ( ( LoadCorpus( corpus, tuner ) == false ) || ( tuner.sampleCount == 0 ) )
+	{
+		printf( "No positions loaded from %s\n", corpus.c_str() );
+		return 1;
+	}
+	printf( "Loaded %zu positions in %.1fs\n", tuner.sampleCount, std::chrono::duration<double>( std::chrono::steady_clock::now() - loadStart ).count() );
+
+	static weights_t weights;
+	static gradient_t gradient;
+	static gradient_t m;
+	static gradient_t v;
+	InitWeights( weights );
+
+	const double k = FitScale( tuner, weights );
+	const double startLoss = ComputeLoss( tuner, weights, k, nullptr );
+	printf( "K = %.6f, starting loss %.6f\n", k, startLoss );
+
+	const auto tuneStart = std::chrono::steady_clock::now();
+	const double scale = 1.0 / tuner.sampleCount;
+	double loss = startLoss;
+
+	for ( int32_t epoch = 1; epoch <= epochs; ++epoch )
+	{
+		loss = ComputeLoss( tuner, weights, k, &gradient );
+
+		// King material is fixed, padding weights stay zero
+		gradient.material[ (int32_t)pieceType_t::KING ] = 0.0;
+		AdamStep( weights.material, m.material, v.material, gradient.material, TypeCount, scale, epoch );
+		AdamStep( weights.middlegame, m.middlegame, v.middlegame, gradient.middlegame, FeatureCount, scale, epoch );
+		AdamStep( weights.endgame, m.endgame, v.endgame, gradient.endgame, FeatureCount, scale, epoch );
+
+		if ( ( epoch % 50 ) == 0 || ( epoch == epochs ) )
+		{
+			const double seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - tuneStart ).count();
+			printf( "Epoch %d: loss %.6f (%.1fs, %.1fM positions/s)\n", epoch, loss, seconds, ( epoch * (double)tuner.sampleCount ) / ( seconds * 1e6 ) );
+		}
+	}
+
+	loss = ComputeLoss( tuner, weights, k, nullptr );
+	if ( WriteTables( output, weights, corpus, tuner.sampleCount, loss ) == false )
+	{
+		printf( "Unable to write %s\n", output.c_str() );
+		return 1;
+	}
+	printf( "Wrote %s, loss %.6f -> %.6f\n", output.c_str(), startLoss, loss );
+	return 0;
+}
@@ -0,0 +1,247 @@
+#include "chess.h"
+
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+// UCI front end. The main thread keeps reading stdin while a search runs on the engine's
+// worker, so stop, ponderhit and isready are answered at once. Output from both threads goes
+// through Send() to keep lines whole.
+
+static const char* EngineName		= "Chess";
+static const char* EngineAuthor		= "Thomas Griebel";
+static const char* StartFen			= "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1";
+static const int32_t MaxHashMB		= 4096;
+static const int32_t MovesToGo		= 30;		// Assumed moves left when the GUI does not say
+static const int64_t MoveOverheadMs	= 30;		// Kept back for GUI and pipe latency
+
+static std::mutex outputLock;
+
+
+static void Send( const std::string& line )
+{
+	std::lock_guard< std::mutex > lock( outputLock );
+	std::cout << line << std::endl;
+}
+
+
+static std::string ScoreString( const int32_t score )
+{
+	if ( abs( score ) > MateBound )
+	{
+		const int32_t moves = ( MateValue - abs( score ) + 1 ) / 2;
+		return "mate " + std::to_string( ( score > 0 ) ? moves : -moves );
+	}
+	return "cp " + std::to_string( score );
+}
+
+
+// Rest of the line after the keyword, empty when it is missing
+static std::string After( const std::string& line, const std::string& keyword )
+{
+	const size_t pos = line.find( keyword );
+	if ( pos == std::string::npos ) {
+		return "";
+	}
+	const size_t start = line.find_first_not_of( ' ', pos + keyword.size() );
+	return ( start == std::string::npos ) ? "" : line.substr( start );
+}
+
+
+static void SetPosition( ChessEngine& engine, const std::string& line )
+{
+	std::istringstream stream( line );
+	std::string token;
+	stream >> token;	// position
+	stream >> token;
+
+	std::string fen;
+	if ( token == "startpos" )
+	{
+		fen = StartFen;
+		stream >> token;
+	}
+	else if ( token == "fen" )
+	{
+		while ( ( stream >> token ) && ( token != "moves" ) ) {
+			fen += fen.empty() ? token : ( " " + token );
+		}
+	}
+
+	if ( engine.InitFromFen( fen ) == false )
+	{
+		Send( "info string invalid position" );
+		engine.InitFromFen( StartFen );
+		return;
+	}
+
+	if ( token != "moves" ) {
+		return;
+	}
+
+	while ( stream >> token )
+	{
+		const move_t move = engine.ParseMoveString( token );
+		if ( move == NoMove )
+		{
+			Send( "info string illegal move " + token );
+			return;
+		}
+		engine.ExecuteTrusted( move );
+	}
+}
+
+
+static void Go( ChessEngine& engine, const std::string& line )
+{
+	std::istringstream stream( line );
+	std::string token;
+	stream >> token;	// go
+
+	int64_t time[ 2 ] = { 0, 0 };
+	int64_t increment[ 2 ] = { 0, 0 };
+	int64_t moveTime = 0;
+	int32_t movesToGo = 0;
+	bool infinite = false;
+
+	searchLimits_t limits;
+	while ( stream >> token )
+	{
+		if ( token == "wtime" )				stream >> time[ 0 ];
+		else if ( token == "btime" )		stream >> time[ 1 ];
+		else if ( token == "winc" )			stream >> increment[ 0 ];
+		else if ( token == "binc" )			stream >> increment[ 1 ];
+		else if ( token == "movestogo" )	stream >> movesToGo;
+		else if ( token == "movetime" )		stream >> moveTime;
+		else if ( token == "depth" )		stream >> limits.depth;
+		else if ( token == "nodes" )		stream >> limits.nodes;
+		else if ( token == "infinite" )		infinite = true;
+		else if ( token == "ponder" )		limits.ponder = true;
+	}
+
+	const int32_t side = ( engine.GetCurrentPlayer() == teamCode_t::WHITE ) ? 0 : 1;
+	if ( moveTime > 0 )
+	{
+		limits.timeMs = std::max< int64_t >( moveTime - MoveOverheadMs, 1 );
+	}
+	else if ( time[ side ] > 0 )
+	{
+		const int64_t budget = time[ side ] / ( ( movesToGo > 0 ) ? movesToGo : MovesToGo ) + ( increment[ side ] * 3 ) / 4;
+		const int64_t ceiling = std::max< int64_t >( time[ side ] / 2 - MoveOverheadMs, 1 );
+		limits.timeMs = std::min( std::max< int64_t >( budget - MoveOverheadMs, 1 ), ceiling );
+	}
+
+	// A held search runs without a clock and reports only after stop
+	if ( infinite ) {
+		limits.ponder = true;
+	}
+	limits.depth = std::min( std::max( limits.depth, 1 ), MaxSearchDepth );
+
+	engine.StartSearch( limits,
+		[ &engine ]( const searchInfo_t& info )
+		{
+			Send( "info depth " + std::to_string( info.depth ) +
+				" score " + ScoreString( info.score ) +
+				" nodes " + std::to_string( info.nodes ) +
+				" nps " + std::to_string( info.nps ) +
+				" time " + std::to_string( info.timeMs ) +
+				" pv " + engine.GetLineString( info.pv ) );
+		},
+		[ &engine ]( const searchResult_t& result )
+		{
+			std::vector< move_t > line = result.pv;
+			if ( line.empty() || ( line[ 0 ] != result.bestMove ) ) {
+				line.assign( 1, result.bestMove );
+			}
+			line.resize( std::min< size_t >( line.size(), 2 ) );
+
+			std::istringstream moves( engine.GetLineString( line ) );
+			std::string best;
+			std::string ponder;
+			moves >> best >> ponder;
+
+			std::string text = "bestmove " + ( best.empty() ? std::string( "0000" ) : best );
+			if ( ponder.empty() == false ) {
+				text += " ponder " + ponder;
+			}
+			Send( text );
+		} );
+}
+
+
+int main()
+{
+	std::ios::sync_with_stdio( false );
+
+	ChessEngine engine;
+	engine.InitFromFen( StartFen );
+
+	std::string line;
+	while ( std::getline( std::cin, line ) )
+	{
+		if ( ( line.empty() == false ) && ( line.back() == '\r' ) ) {
+			line.pop_back();
+		}
+
+		std::istringstream stream( line );
+		std::string command;
+		stream >> command;
+
+		if ( command == "uci" )
+		{
+			Send( std::string( "id name " ) + EngineName );
+			Send( std::string( "id author " ) + EngineAuthor );
+			Send( "option name Hash type spin default " + std::to_string( DefaultHashMB ) + " min 1 max " + std::to_string( MaxHashMB ) );
+			Send( "option name Threads type spin default 1 min 1 max 1" );
+			Send( "option name Ponder type check default false" );
+			Send( "uciok" );
+		}
+		else if ( command == "isready" )
+		{
+			Send( "readyok" );
+		}
+		else if ( command == "setoption" )
+		{
+			const std::string name = After( line, "name" );
+			const std::string value = After( line, "value" );
+			if ( ( name.compare( 0, 4, "Hash" ) == 0 ) && ( value.empty() == false ) )
+			{
+				engine.Stop();
+				engine.SetHashSize( std::min( std::max( atoi( value.c_str() ), 1 ), MaxHashMB ) );
+			}
+			// Threads accepts its only value, Ponder needs nothing from the engine
+		}
+		else if ( command == "ucinewgame" )
+		{
+			engine.Stop();
+			engine.ClearHash();
+		}
+		else if ( command == "position" )
+		{
+			engine.Stop();
+			SetPosition( engine, line );
+		}
+		else if ( command == "go" )
+		{
+			engine.Stop();
+			Go( engine, line );
+		}
+		else if ( command == "ponderhit" )
+		{
+			engine.PonderHit();
+		}
+		else if ( command == "stop" )
+		{
+			engine.Stop();
+		}
+		else if ( command == "quit" )
+		{
+			break;
+		}
+	}
+
+	engine.Stop();
+	return 0;
+}
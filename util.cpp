@@ -1,4 +1,4 @@
-#include "Chess.h"
+#include "chess.h"
 
 using namespace std;
 
@@ -186,4 +186,57 @@ void LoadHistory( const std::string& fileName, std::vector< std::string >& comma
         }
         configFile.close();
     }
-}
\ No newline at end of file
+}
+
+bool ParseFen( const std::string& fen, packedPosition_t& position )
+{
+	memset( position.squares, PackedEmpty, sizeof( position.squares ) );
+	position.sideToMove = teamCode_t::WHITE;
+
+	int32_t x = 0;
+	int32_t y = 0;
+	size_t i = 0;
+
+	for ( ; ( i < fen.size() ) && ( fen[ i ] != ' ' ); ++i )
+	{
+		const char c = fen[ i ];
+		if ( c == '/' )
+		{
+			if ( x != BoardSize ) {
+				return false;
+			}
+			x = 0;
+			++y;
+		}
+		else if ( ( c >= '1' ) && ( c <= '8' ) )
+		{
+			x += c - '0';
+		}
+		else
+		{
+			const pieceType_t type = GetPieceType( c );
+			if ( ( type == pieceType_t::NONE ) || ( x >= BoardSize ) || ( y >= BoardSize ) ) {
+				return false;
+			}
+			const teamCode_t team = isupper( c ) ? teamCode_t::WHITE : teamCode_t::BLACK;
+			position.squares[ y ][ x++ ] = PackPiece( team, type );
+		}
+
+		if ( x > BoardSize ) {
+			return false;
+		}
+	}
+
+	if ( ( y != ( BoardSize - 1 ) ) || ( x != BoardSize ) ) {
+		return false;
+	}
+
+	while ( ( i < fen.size() ) && ( fen[ i ] == ' ' ) ) {
+		++i;
+	}
+
+	if ( i < fen.size() ) {
+		position.sideToMove = ( fen[ i ] == 'b' ) ? teamCode_t::BLACK : teamCode_t::WHITE;
+	}
+	return true;
+}